@@ -0,0 +1,83 @@
+/**
+ * Contains all functionality for arenas, bump
+ * allocators whose memory is freed all at once
+ * when the query that used them is done.
+ **/
+
+#include "arena.h"
+
+// alignment of every allocation, one cache line
+#define ARENA_ALIGNMENT 64
+
+
+/**
+ * Creates empty arena that allocates blocks of block_size bytes.
+ **/
+Arena* create_arena(size_t block_size) {
+    Arena* arena = malloc(sizeof(Arena));
+    arena->blocks = NULL;
+    arena->block_size = block_size;
+    return arena;
+}
+
+
+/**
+ * Returns num_bytes from arena's current block, starting a new
+ * block if it doesn't fit. Oversized requests get their own block.
+ **/
+void* arena_alloc(Arena* arena, size_t num_bytes) {
+    num_bytes = (num_bytes + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+
+    ArenaBlock* block = arena->blocks;
+    if (block == NULL || block->size - block->used < num_bytes) {
+        size_t size = num_bytes > arena->block_size ? num_bytes : arena->block_size;
+        block = malloc(sizeof(ArenaBlock) + size + ARENA_ALIGNMENT);
+        block->size = size;
+        block->next = arena->blocks;
+        arena->blocks = block;
+
+        // align start of data
+        block->used = (ARENA_ALIGNMENT - ((size_t) block->data % ARENA_ALIGNMENT)) % ARENA_ALIGNMENT;
+        block->size += block->used;
+    }
+
+    void* ptr = &block->data[block->used];
+    block->used += num_bytes;
+    return ptr;
+}
+
+
+/**
+ * Moves all of other's blocks into arena, so they're freed
+ * with it, and frees other. Arena keeps allocating from its
+ * own current block.
+ **/
+void arena_absorb(Arena* arena, Arena* other) {
+    if (other->blocks != NULL) {
+        if (arena->blocks == NULL) {
+            arena->blocks = other->blocks;
+        } else {
+            ArenaBlock* last = other->blocks;
+            while (last->next != NULL) {
+                last = last->next;
+            }
+            last->next = arena->blocks->next;
+            arena->blocks->next = other->blocks;
+        }
+    }
+    free(other);
+}
+
+
+/**
+ * Frees arena and everything allocated from it.
+ **/
+void free_arena(Arena* arena) {
+    ArenaBlock* block = arena->blocks;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
@@ -0,0 +1,884 @@
+/**
+ * Contains all functionality
+ * for adaptive radix tree;
+ **/
+
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "art.h"
+#include "sort.h"
+#include "position_map.h"
+
+
+/**
+ * Returns val as an ART key, sign bit flipped so
+ * unsigned byte order matches int order.
+ **/
+static inline uint32_t art_key(int val) {
+    return (uint32_t) val ^ 0x80000000u;
+}
+
+
+/**
+ * Returns val of an ART key.
+ **/
+static inline int art_key_val(uint32_t key) {
+    return (int) (key ^ 0x80000000u);
+}
+
+
+/**
+ * Returns key's byte at depth, most significant first.
+ **/
+static inline uint8_t key_byte(uint32_t key, int depth) {
+    return (uint8_t) (key >> (8 * (ART_KEY_BYTES - 1 - depth)));
+}
+
+
+/**
+ * Returns bytes of an inner node of type.
+ **/
+static inline size_t inner_node_size(ArtNodeType type) {
+    switch (type) {
+        case ART_NODE4:
+            return sizeof(ArtNode4);
+        case ART_NODE16:
+            return sizeof(ArtNode16);
+        case ART_NODE48:
+            return sizeof(ArtNode48);
+        default:
+            return sizeof(ArtNode256);
+    }
+}
+
+
+/**
+ * Returns new inner node of type without children.
+ **/
+static ArtNode* create_art_node(ArtNodeType type) {
+    ArtNode* node = calloc(1, inner_node_size(type));
+    node->type = type;
+    return node;
+}
+
+
+/**
+ * Returns new leaf for key without row ids, with room for capacity.
+ **/
+static ArtNode* create_art_leaf(int key, int capacity) {
+    ArtLeaf* leaf = malloc(sizeof(ArtLeaf) + sizeof(int) * capacity);
+    memset(&leaf->node, 0, sizeof(ArtNode));
+    leaf->node.type = ART_LEAF;
+    leaf->key = key;
+    leaf->num_row_ids = 0;
+    leaf->capacity = capacity;
+    return (ArtNode*) leaf;
+}
+
+
+/**
+ * A key with a single non-negative row id is packed into its
+ * parent's child slot in place of a leaf, row id in the top 31 bits,
+ * ART key in the next 32 and a set low bit to tell it from a pointer.
+ * Most keys of a column have one row, so this saves most leaves and
+ * the cache miss of reading one. Needs 64 bit pointers.
+ **/
+static inline ArtNode* pack_entry(int key, int row_id) {
+    return (ArtNode*) (uintptr_t) ((uint64_t) row_id << 33 | (uint64_t) art_key(key) << 1 | 1);
+}
+
+
+/**
+ * Returns 1 if child slot holds a packed entry.
+ **/
+static inline int is_packed(ArtNode* child) {
+    return (uintptr_t) child & 1;
+}
+
+
+/**
+ * Returns 1 if child slot holds a packed entry or leaf.
+ **/
+static inline int is_leaf(ArtNode* child) {
+    return is_packed(child) || child->type == ART_LEAF;
+}
+
+
+/**
+ * Returns key of a packed entry or leaf.
+ **/
+static inline int leaf_key(ArtNode* child) {
+    if (is_packed(child)) {
+        return art_key_val((uint32_t) ((uint64_t) (uintptr_t) child >> 1));
+    }
+    return ((ArtLeaf*) child)->key;
+}
+
+
+/**
+ * Returns number of row ids of a packed entry or leaf, pointing
+ * row_ids at them. A packed entry's row id is copied to
+ * packed_row_id for row_ids to point at.
+ **/
+static inline int leaf_row_ids(ArtNode* child, int* packed_row_id, int** row_ids) {
+    if (is_packed(child)) {
+        *packed_row_id = (int) ((uint64_t) (uintptr_t) child >> 33);
+        *row_ids = packed_row_id;
+        return 1;
+    }
+    *row_ids = ((ArtLeaf*) child)->row_ids;
+    return ((ArtLeaf*) child)->num_row_ids;
+}
+
+
+/**
+ * Returns packed entry or new leaf for key's num_row_ids row ids.
+ **/
+static ArtNode* create_leaf_entry(int key, int* row_ids, int num_row_ids) {
+    if (num_row_ids == 1 && row_ids[0] >= 0) {
+        return pack_entry(key, row_ids[0]);
+    }
+
+    ArtLeaf* leaf = (ArtLeaf*) create_art_leaf(key, num_row_ids);
+    memcpy(leaf->row_ids, row_ids, sizeof(int) * num_row_ids);
+    leaf->num_row_ids = num_row_ids;
+    return (ArtNode*) leaf;
+}
+
+
+/**
+ * Returns new empty tree.
+ **/
+ArtTree* create_art() {
+    return calloc(1, sizeof(ArtTree));
+}
+
+
+/**
+ * Returns key bytes of a node4 or node16's children.
+ **/
+static inline uint8_t* sorted_keys(ArtNode* node) {
+    return node->type == ART_NODE4 ? ((ArtNode4*) node)->keys : ((ArtNode16*) node)->keys;
+}
+
+
+/**
+ * Returns children of a node4 or node16.
+ **/
+static inline ArtNode** sorted_children(ArtNode* node) {
+    return node->type == ART_NODE4 ? ((ArtNode4*) node)->children : ((ArtNode16*) node)->children;
+}
+
+
+/**
+ * Returns number of child slots nth_child walks for node,
+ * its children for node4 and node16, else every key byte.
+ **/
+static inline int num_child_slots(ArtNode* node) {
+    return node->type == ART_NODE4 || node->type == ART_NODE16 ? node->num_children : 256;
+}
+
+
+/**
+ * Returns child at slot i of node, in key byte order, setting
+ * byte to its key byte. NULL if node48 or node256 has no child there.
+ **/
+static ArtNode* nth_child(ArtNode* node, int i, uint8_t* byte) {
+    switch (node->type) {
+        case ART_NODE4:
+        case ART_NODE16:
+            *byte = sorted_keys(node)[i];
+            return sorted_children(node)[i];
+        case ART_NODE48: {
+            ArtNode48* node48 = (ArtNode48*) node;
+            *byte = (uint8_t) i;
+            return node48->child_index[i] ? node48->children[node48->child_index[i] - 1] : NULL;
+        } default:
+            *byte = (uint8_t) i;
+            return ((ArtNode256*) node)->children[i];
+    }
+}
+
+
+/**
+ * Returns slot of node's child for key byte, NULL if none.
+ **/
+static ArtNode** find_child(ArtNode* node, uint8_t byte) {
+    switch (node->type) {
+        case ART_NODE4: {
+            ArtNode4* node4 = (ArtNode4*) node;
+            for (int i = 0; i < node->num_children; i++) {
+                if (node4->keys[i] == byte) {
+                    return &node4->children[i];
+                }
+            }
+            return NULL;
+        } case ART_NODE16: {
+            ArtNode16* node16 = (ArtNode16*) node;
+#ifdef __SSE2__
+            // compare all 16 key bytes at once
+            __m128i keys = _mm_loadu_si128((__m128i*) node16->keys);
+            int matches = _mm_movemask_epi8(_mm_cmpeq_epi8(keys, _mm_set1_epi8((char) byte)));
+            matches &= (1 << node->num_children) - 1;
+            return matches ? &node16->children[__builtin_ctz(matches)] : NULL;
+#else
+            for (int i = 0; i < node->num_children; i++) {
+                if (node16->keys[i] == byte) {
+                    return &node16->children[i];
+                }
+            }
+            return NULL;
+#endif
+        } case ART_NODE48: {
+            ArtNode48* node48 = (ArtNode48*) node;
+            return node48->child_index[byte] ? &node48->children[node48->child_index[byte] - 1] : NULL;
+        } case ART_NODE256: {
+            ArtNode256* node256 = (ArtNode256*) node;
+            return node256->children[byte] != NULL ? &node256->children[byte] : NULL;
+        } default:
+            return NULL;
+    }
+}
+
+
+static ArtNode* resize_node(ArtNode* node, ArtNodeType type);
+
+
+/**
+ * Adds child under key byte to node at ref, growing
+ * node into the next larger type if it's full.
+ **/
+static void add_child(ArtNode** ref, uint8_t byte, ArtNode* child) {
+    ArtNode* node = *ref;
+    switch (node->type) {
+        case ART_NODE4:
+        case ART_NODE16: {
+            if (node->num_children == (node->type == ART_NODE4 ? 4 : 16)) {
+                *ref = resize_node(node, node->type + 1);
+                add_child(ref, byte, child);
+                return;
+            }
+
+            // shift larger keys over to keep keys sorted
+            uint8_t* keys = sorted_keys(node);
+            ArtNode** children = sorted_children(node);
+            int i = node->num_children;
+            while (i > 0 && keys[i - 1] > byte) {
+                keys[i] = keys[i - 1];
+                children[i] = children[i - 1];
+                i--;
+            }
+            keys[i] = byte;
+            children[i] = child;
+            break;
+        } case ART_NODE48: {
+            if (node->num_children == 48) {
+                *ref = resize_node(node, ART_NODE256);
+                add_child(ref, byte, child);
+                return;
+            }
+
+            // children are kept packed, so next free slot is at end
+            ArtNode48* node48 = (ArtNode48*) node;
+            node48->children[node->num_children] = child;
+            node48->child_index[byte] = node->num_children + 1;
+            break;
+        } default:
+            ((ArtNode256*) node)->children[byte] = child;
+    }
+    node->num_children++;
+}
+
+
+/**
+ * Returns copy of node as type, which must have room for its
+ * children, and frees node.
+ **/
+static ArtNode* resize_node(ArtNode* node, ArtNodeType type) {
+    ArtNode* resized = create_art_node(type);
+    resized->prefix_len = node->prefix_len;
+    memcpy(resized->prefix, node->prefix, ART_KEY_BYTES);
+
+    int num_slots = num_child_slots(node);
+    for (int i = 0; i < num_slots; i++) {
+        uint8_t byte;
+        ArtNode* child = nth_child(node, i, &byte);
+        if (child != NULL) {
+            add_child(&resized, byte, child);
+        }
+    }
+
+    free(node);
+    return resized;
+}
+
+
+/**
+ * Removes child under key byte from node at ref. Shrinks node into
+ * the next smaller type once it holds a few less than that fits,
+ * and replaces a node4 left with one child by that child, moving
+ * node's prefix and key byte onto the child's prefix.
+ **/
+static void remove_child(ArtNode** ref, uint8_t byte) {
+    ArtNode* node = *ref;
+    switch (node->type) {
+        case ART_NODE4:
+        case ART_NODE16: {
+            uint8_t* keys = sorted_keys(node);
+            ArtNode** children = sorted_children(node);
+            int i = 0;
+            while (keys[i] != byte) {
+                i++;
+            }
+            memmove(&keys[i], &keys[i + 1], node->num_children - 1 - i);
+            memmove(&children[i], &children[i + 1], sizeof(ArtNode*) * (node->num_children - 1 - i));
+            break;
+        } case ART_NODE48: {
+            // move last child into removed child's slot to keep slots packed
+            ArtNode48* node48 = (ArtNode48*) node;
+            int slot = node48->child_index[byte] - 1;
+            int last = node->num_children - 1;
+            node48->child_index[byte] = 0;
+            if (slot != last) {
+                node48->children[slot] = node48->children[last];
+                for (int i = 0; i < 256; i++) {
+                    if (node48->child_index[i] == last + 1) {
+                        node48->child_index[i] = slot + 1;
+                        break;
+                    }
+                }
+            }
+            node48->children[last] = NULL;
+            break;
+        } default:
+            ((ArtNode256*) node)->children[byte] = NULL;
+    }
+    node->num_children--;
+
+    if (node->type == ART_NODE4 && node->num_children == 1) {
+        ArtNode4* node4 = (ArtNode4*) node;
+        ArtNode* child = node4->children[0];
+
+        // leaves hold whole keys, only inner nodes need the path
+        if (!is_leaf(child)) {
+            uint8_t prefix[ART_KEY_BYTES];
+            int prefix_len = node->prefix_len;
+            memcpy(prefix, node->prefix, prefix_len);
+            prefix[prefix_len++] = node4->keys[0];
+            memcpy(&prefix[prefix_len], child->prefix, child->prefix_len);
+            prefix_len += child->prefix_len;
+
+            memcpy(child->prefix, prefix, prefix_len);
+            child->prefix_len = prefix_len;
+        }
+
+        free(node);
+        *ref = child;
+    } else if ((node->type == ART_NODE16 && node->num_children <= 3)
+            || (node->type == ART_NODE48 && node->num_children <= 12)
+            || (node->type == ART_NODE256 && node->num_children <= 40)) {
+        *ref = resize_node(node, node->type - 1);
+    }
+}
+
+
+/**
+ * Returns number of node's prefix bytes key matches at depth.
+ **/
+static inline int matched_prefix(ArtNode* node, uint32_t key, int depth) {
+    int matched = 0;
+    while (matched < node->prefix_len && node->prefix[matched] == key_byte(key, depth + matched)) {
+        matched++;
+    }
+    return matched;
+}
+
+
+/**
+ * Returns slot holding val's packed entry or leaf if tree has
+ * val, else adds entry, a packed entry or leaf for val, and returns
+ * NULL. A new entry goes under a new node4 where it meets another
+ * entry or leaves a node's prefix, else under the node where its
+ * path ends.
+ **/
+static ArtNode** leaf_slot(ArtTree* tree, int val, ArtNode* entry) {
+    uint32_t key = art_key(val);
+    ArtNode** ref = &tree->root;
+    int depth = 0;
+
+    while (*ref != NULL) {
+        ArtNode* node = *ref;
+        if (is_leaf(node)) {
+            uint32_t other_key = art_key(leaf_key(node));
+            if (other_key == key) {
+                return ref;
+            }
+
+            // put both entries under a node4 after bytes they share
+            ArtNode* parent = create_art_node(ART_NODE4);
+            while (key_byte(key, depth) == key_byte(other_key, depth)) {
+                parent->prefix[parent->prefix_len++] = key_byte(key, depth++);
+            }
+            add_child(&parent, key_byte(other_key, depth), node);
+            *ref = parent;
+            break;
+        }
+
+        int matched = matched_prefix(node, key, depth);
+        if (matched < node->prefix_len) {
+            // split node's prefix where key leaves it
+            ArtNode* parent = create_art_node(ART_NODE4);
+            parent->prefix_len = matched;
+            memcpy(parent->prefix, node->prefix, matched);
+            add_child(&parent, node->prefix[matched], node);
+
+            node->prefix_len -= matched + 1;
+            memmove(node->prefix, &node->prefix[matched + 1], node->prefix_len);
+            *ref = parent;
+            depth += matched;
+            break;
+        }
+
+        depth += node->prefix_len;
+        ArtNode** child = find_child(node, key_byte(key, depth));
+        if (child == NULL) {
+            break;
+        }
+        ref = child;
+        depth++;
+    }
+
+    tree->num_keys++;
+    if (*ref == NULL) {
+        *ref = entry;
+    } else {
+        add_child(ref, key_byte(key, depth), entry);
+    }
+    return NULL;
+}
+
+
+/**
+ * Returns leaf at ref with room for num_row_ids more row ids,
+ * growing it in place of the old leaf if needed.
+ **/
+static ArtLeaf* leaf_reserve(ArtNode** ref, int num_row_ids) {
+    ArtLeaf* leaf = (ArtLeaf*) *ref;
+    if (leaf->num_row_ids + num_row_ids > leaf->capacity) {
+        int capacity = leaf->capacity * 2;
+        if (capacity < leaf->num_row_ids + num_row_ids) {
+            capacity = leaf->num_row_ids + num_row_ids;
+        }
+        leaf = realloc(leaf, sizeof(ArtLeaf) + sizeof(int) * capacity);
+        leaf->capacity = capacity;
+        *ref = (ArtNode*) leaf;
+    }
+    return leaf;
+}
+
+
+/**
+ * Inserts row id under key into tree. A key's second
+ * row id moves it from a packed entry to a leaf.
+ **/
+void art_insert(ArtTree* tree, int key, int row_id) {
+    ArtNode* entry = create_leaf_entry(key, &row_id, 1);
+    ArtNode** slot = leaf_slot(tree, key, entry);
+    if (slot == NULL) {
+        return;
+    }
+    if (!is_packed(entry)) {
+        free(entry);
+    }
+
+    if (is_packed(*slot)) {
+        int packed_row_id;
+        int* row_ids;
+        leaf_row_ids(*slot, &packed_row_id, &row_ids);
+
+        ArtLeaf* leaf = (ArtLeaf*) create_art_leaf(key, 2);
+        leaf->row_ids[leaf->num_row_ids++] = packed_row_id;
+        *slot = (ArtNode*) leaf;
+    }
+
+    ArtLeaf* leaf = leaf_reserve(slot, 1);
+    leaf->row_ids[leaf->num_row_ids++] = row_id;
+}
+
+
+/**
+ * Builds tree over num_vals vals of data. Row ids are positions,
+ * or positions' ids in position_map if given. Adds each distinct
+ * val's entry once with all its row ids, in val order.
+ **/
+ArtTree* art_bulk_load(int* data, size_t num_vals, PositionMap* position_map) {
+    ArtTree* tree = create_art();
+    if (!num_vals) {
+        return tree;
+    }
+
+    // sort a copy of vals with their row ids, stable so
+    // equal vals keep position order like repeated inserts
+    int* vals = malloc(sizeof(int) * num_vals);
+    int* row_ids = malloc(sizeof(int) * num_vals);
+    memcpy(vals, data, sizeof(int) * num_vals);
+    if (position_map != NULL) {
+        position_map_row_ids(position_map, row_ids);
+    } else {
+        for (size_t i = 0; i < num_vals; i++) {
+            row_ids[i] = i;
+        }
+    }
+    radix_sort_pairs(vals, row_ids, num_vals);
+
+    size_t start = 0;
+    while (start < num_vals) {
+        size_t end = start + 1;
+        while (end < num_vals && vals[end] == vals[start]) {
+            end++;
+        }
+        leaf_slot(tree, vals[start], create_leaf_entry(vals[start], &row_ids[start], end - start));
+        start = end;
+    }
+
+    free(vals);
+    free(row_ids);
+    return tree;
+}
+
+
+/**
+ * Returns number of row ids under key in tree, pointing row_ids
+ * at them. If key's only row id is packed into its parent, it's
+ * copied to packed_row_id for row_ids to point at.
+ **/
+int art_search(ArtTree* tree, int key, int* packed_row_id, int** row_ids) {
+    uint32_t art_val = art_key(key);
+    ArtNode* node = tree->root;
+    int depth = 0;
+
+    while (node != NULL && !is_leaf(node)) {
+        if (matched_prefix(node, art_val, depth) < node->prefix_len) {
+            return 0;
+        }
+        depth += node->prefix_len;
+
+        ArtNode** child = find_child(node, key_byte(art_val, depth));
+        node = child != NULL ? *child : NULL;
+        depth++;
+    }
+
+    if (node == NULL || leaf_key(node) != key) {
+        return 0;
+    }
+    return leaf_row_ids(node, packed_row_id, row_ids);
+}
+
+
+/**
+ * Removes row id under key from tree, and key's entry once it
+ * has no row ids left. A leaf left with one row id is packed.
+ **/
+void art_remove(ArtTree* tree, int key, int row_id) {
+    uint32_t art_val = art_key(key);
+    ArtNode** ref = &tree->root;
+    ArtNode** parent_ref = NULL;
+    uint8_t parent_byte = 0;
+    int depth = 0;
+
+    // find entry, keeping slot of its parent
+    while (*ref != NULL && !is_leaf(*ref)) {
+        ArtNode* node = *ref;
+        if (matched_prefix(node, art_val, depth) < node->prefix_len) {
+            return;
+        }
+        depth += node->prefix_len;
+
+        ArtNode** child = find_child(node, key_byte(art_val, depth));
+        if (child == NULL) {
+            return;
+        }
+        parent_ref = ref;
+        parent_byte = key_byte(art_val, depth);
+        ref = child;
+        depth++;
+    }
+
+    if (*ref == NULL || leaf_key(*ref) != key) {
+        return;
+    }
+
+    // take row id out of entry
+    int packed_row_id;
+    int* row_ids;
+    int num_row_ids = leaf_row_ids(*ref, &packed_row_id, &row_ids);
+    int i = 0;
+    while (i < num_row_ids && row_ids[i] != row_id) {
+        i++;
+    }
+    if (i == num_row_ids) {
+        return;
+    }
+
+    if (!is_packed(*ref)) {
+        ArtLeaf* leaf = (ArtLeaf*) *ref;
+        memmove(&leaf->row_ids[i], &leaf->row_ids[i + 1], sizeof(int) * (leaf->num_row_ids - 1 - i));
+        leaf->num_row_ids--;
+        if (leaf->num_row_ids == 1 && leaf->row_ids[0] >= 0) {
+            *ref = pack_entry(key, leaf->row_ids[0]);
+            free(leaf);
+            return;
+        }
+        if (leaf->num_row_ids) {
+            return;
+        }
+        free(leaf);
+    }
+
+    tree->num_keys--;
+    if (parent_ref == NULL) {
+        tree->root = NULL;
+    } else {
+        remove_child(parent_ref, parent_byte);
+    }
+}
+
+
+/**
+ * State of an ordered walk over keys in [low, high).
+ **/
+typedef struct ArtScan {
+    long low;
+    long high;
+    int descending;
+    size_t limit;       // most entries to read
+    int* vals;          // NULL if only row ids wanted
+    int* row_ids;
+    size_t num_read;
+} ArtScan;
+
+
+/**
+ * Reads entries under node in key order into scan, skipping
+ * subtrees whose keys all fall outside scan's range. Prefix holds
+ * key bytes above depth. Returns 0 once scan has read its limit.
+ **/
+static int scan_node(ArtNode* node, uint32_t prefix, int depth, ArtScan* scan) {
+    if (is_leaf(node)) {
+        int key = leaf_key(node);
+        if (key < scan->low || key >= scan->high) {
+            return 1;
+        }
+
+        int packed_row_id;
+        int* row_ids;
+        int num_row_ids = leaf_row_ids(node, &packed_row_id, &row_ids);
+        for (int j = 0; j < num_row_ids && scan->num_read < scan->limit; j++) {
+            if (scan->vals != NULL) {
+                scan->vals[scan->num_read] = key;
+            }
+            scan->row_ids[scan->num_read++] = row_ids[scan->descending ? num_row_ids - 1 - j : j];
+        }
+        return scan->num_read < scan->limit;
+    }
+
+    for (int i = 0; i < node->prefix_len; i++) {
+        prefix |= (uint32_t) node->prefix[i] << (8 * (ART_KEY_BYTES - 1 - depth - i));
+    }
+    depth += node->prefix_len;
+
+    // keys under node run from prefix followed by all 0s to all 1s
+    uint32_t rest = (uint32_t) (((uint64_t) 1 << (8 * (ART_KEY_BYTES - depth))) - 1);
+    if (art_key_val(prefix | rest) < scan->low || art_key_val(prefix) >= scan->high) {
+        return 1;
+    }
+
+    // only children with bytes between the range's ends at depth
+    // can hold keys in range, node48 and node256 walk just those
+    int first_byte = 0;
+    int last_byte = 255;
+    if (scan->low > art_key_val(prefix)) {
+        first_byte = key_byte(art_key((int) scan->low), depth);
+    }
+    if (scan->high - 1 < art_key_val(prefix | rest)) {
+        last_byte = key_byte(art_key((int) (scan->high - 1)), depth);
+    }
+
+    int first_slot = 0;
+    int last_slot = num_child_slots(node) - 1;
+    if (node->type == ART_NODE48 || node->type == ART_NODE256) {
+        first_slot = first_byte;
+        last_slot = last_byte;
+    }
+
+    for (int j = 0; j <= last_slot - first_slot; j++) {
+        uint8_t byte;
+        ArtNode* child = nth_child(node, scan->descending ? last_slot - j : first_slot + j, &byte);
+        if (child == NULL || byte < first_byte || byte > last_byte) {
+            continue;
+        }
+
+        uint32_t child_prefix = prefix | (uint32_t) byte << (8 * (ART_KEY_BYTES - 1 - depth));
+        if (!scan_node(child, child_prefix, depth + 1, scan)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/**
+ * Reads up to limit entries with keys in [low, high) into vals, if
+ * not NULL, and row_ids, ascending or descending by key. Entries with
+ * equal keys are read in leaf order, or reversed if descending.
+ *
+ * Returns number of entries read.
+ **/
+size_t art_scan(ArtTree* tree, long low, long high, int descending, size_t limit, int* vals, int* row_ids) {
+    ArtScan scan = {low, high, descending, limit, vals, row_ids, 0};
+    if (tree->root != NULL && limit) {
+        scan_node(tree->root, 0, 0, &scan);
+    }
+    return scan.num_read;
+}
+
+
+/**
+ * Returns bytes allocated for node and nodes under it.
+ **/
+static size_t node_size(ArtNode* node) {
+    if (is_packed(node)) {
+        return 0;
+    }
+    if (node->type == ART_LEAF) {
+        return sizeof(ArtLeaf) + sizeof(int) * ((ArtLeaf*) node)->capacity;
+    }
+
+    size_t size = inner_node_size(node->type);
+    int num_slots = num_child_slots(node);
+    for (int i = 0; i < num_slots; i++) {
+        uint8_t byte;
+        ArtNode* child = nth_child(node, i, &byte);
+        if (child != NULL) {
+            size += node_size(child);
+        }
+    }
+    return size;
+}
+
+
+/**
+ * Returns bytes allocated for tree.
+ **/
+size_t art_size(ArtTree* tree) {
+    return sizeof(ArtTree) + (tree->root != NULL ? node_size(tree->root) : 0);
+}
+
+
+/**
+ * Dumps entries under node to fd in key order.
+ **/
+static void dump_node(FILE* fd, ArtNode* node) {
+    if (is_leaf(node)) {
+        int key = leaf_key(node);
+        int packed_row_id;
+        int* row_ids;
+        int num_row_ids = leaf_row_ids(node, &packed_row_id, &row_ids);
+        fwrite(&key, sizeof(int), 1, fd);
+        fwrite(&num_row_ids, sizeof(int), 1, fd);
+        fwrite(row_ids, sizeof(int), num_row_ids, fd);
+        return;
+    }
+
+    int num_slots = num_child_slots(node);
+    for (int i = 0; i < num_slots; i++) {
+        uint8_t byte;
+        ArtNode* child = nth_child(node, i, &byte);
+        if (child != NULL) {
+            dump_node(fd, child);
+        }
+    }
+}
+
+
+/**
+ * Dumps tree to fd as its number of keys followed by each
+ * key and its row ids, in key order. Nodes aren't written,
+ * as their pointers won't hold on reload.
+ **/
+void dump_art(FILE* fd, ArtTree* tree) {
+    size_t num_keys = tree != NULL ? tree->num_keys : 0;
+    fwrite(&num_keys, sizeof(size_t), 1, fd);
+    if (num_keys) {
+        dump_node(fd, tree->root);
+    }
+}
+
+
+/**
+ * Loads tree dumped at fd's position, rebuilding
+ * its nodes from its entries in key order.
+ **/
+ArtTree* load_art(FILE* fd) {
+    ArtTree* tree = create_art();
+    size_t num_keys = 0;
+    if (fread(&num_keys, sizeof(size_t), 1, fd) != 1) {
+        return tree;
+    }
+
+    int capacity = 1;
+    int* row_ids = malloc(sizeof(int) * capacity);
+    for (size_t i = 0; i < num_keys; i++) {
+        int key;
+        int num_row_ids;
+        fread(&key, sizeof(int), 1, fd);
+        fread(&num_row_ids, sizeof(int), 1, fd);
+        if (num_row_ids > capacity) {
+            capacity = num_row_ids;
+            row_ids = realloc(row_ids, sizeof(int) * capacity);
+        }
+        fread(row_ids, sizeof(int), num_row_ids, fd);
+        leaf_slot(tree, key, create_leaf_entry(key, row_ids, num_row_ids));
+    }
+
+    free(row_ids);
+    return tree;
+}
+
+
+/**
+ * Frees node and nodes under it.
+ **/
+static void free_art_node(ArtNode* node) {
+    if (is_packed(node)) {
+        return;
+    }
+
+    if (node->type != ART_LEAF) {
+        int num_slots = num_child_slots(node);
+        for (int i = 0; i < num_slots; i++) {
+            uint8_t byte;
+            ArtNode* child = nth_child(node, i, &byte);
+            if (child != NULL) {
+                free_art_node(child);
+            }
+        }
+    }
+    free(node);
+}
+
+
+/**
+ * Frees tree and all its nodes.
+ **/
+void free_art(ArtTree* tree) {
+    if (tree == NULL) {
+        return;
+    }
+    if (tree->root != NULL) {
+        free_art_node(tree->root);
+    }
+    free(tree);
+}
@@ -0,0 +1,293 @@
+/**
+ * Microbenchmark for b+ tree and ART indexes. Built once per
+ * b+ tree node layout, with and without key blocks (see
+ * BPLUS_KEY_BLOCK) and compressed leaves (see BPLUS_COMPRESSED_LEAVES),
+ * so the layouts can be compared on the same workload. Each index
+ * is run over uniform, dense and duplicate heavy keys. Last, threads
+ * read and insert into one b+ tree at once, to check optimistic
+ * readers stay consistent and see how throughput scales with threads.
+ *
+ * usage: ./bench_index [num_vals]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "bplus.h"
+#include "art.h"
+#include "slab.h"
+
+#define DEFAULT_NUM_VALS 4000000
+#define NUM_LOOKUPS 2000000
+#define NUM_RANGES 20000
+#define RANGE_WIDTH 1000
+#define NUM_INSERTS 500000
+// vals per distinct key in duplicate heavy distribution
+#define DUPLICATE_RATIO 100
+// ops per thread in concurrent run, one in CONCURRENT_INSERT_EVERY inserts
+#define CONCURRENT_OPS 400000
+#define CONCURRENT_INSERT_EVERY 10
+#define MAX_THREADS 8
+
+
+/**
+ * Returns current time in ms.
+ **/
+double now_ms() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e3 + time.tv_nsec / 1e6;
+}
+
+
+/**
+ * Returns index of val's leaf and first index in it,
+ * the point lookup done for an equality select.
+ **/
+int point_lookup(BPTreeNode* root, int val) {
+    BPTreeNode* leaf = find_leaf_node(root, val);
+    int index = bplus_node_search(leaf, val);
+    return index < leaf->num_vals ? bplus_leaf_row_id(leaf, index) : -1;
+}
+
+
+/**
+ * Returns first row id of val in ART, -1 if none.
+ **/
+int art_point_lookup(ArtTree* tree, int val) {
+    int packed_row_id;
+    int* row_ids;
+    return art_search(tree, val, &packed_row_id, &row_ids) ? row_ids[0] : -1;
+}
+
+
+/**
+ * Runs workload on a b+ tree over data's num_vals vals
+ * in [0, max_val). Returns checksum of results.
+ **/
+long long bench_bplus(int* data, size_t num_vals, int max_val, int* positions) {
+    srand(165);
+
+    // bulk load
+    double start = now_ms();
+    BPTreeNode* root = bplus_bulk_load(data, num_vals, BPLUS_FILL_FACTOR, NULL);
+    printf("  b+ tree bulk load:     %8.1f ms\n", now_ms() - start);
+    size_t num_nodes = slab_of(root)->num_objects;
+    printf("  b+ tree index size:    %8.1f MB, %zu nodes\n", num_nodes * sizeof(BPTreeNode) / 1e6, num_nodes);
+
+    // point lookups
+    long long checksum = 0;
+    start = now_ms();
+    for (int i = 0; i < NUM_LOOKUPS; i++) {
+        checksum += point_lookup(root, data[rand() % num_vals]);
+    }
+    double elapsed = now_ms() - start;
+    printf("  b+ tree point lookups: %8.1f ms, %6.0f ns each\n", elapsed, elapsed * 1e6 / NUM_LOOKUPS);
+
+    // range lookups
+    start = now_ms();
+    for (int i = 0; i < NUM_RANGES; i++) {
+        int low = rand() % max_val;
+        int high = low + RANGE_WIDTH;
+        int num_results = 0;
+        find_pos_range(root, &num_results, &positions, (int) num_vals, &low, &high);
+        checksum += num_results;
+    }
+    elapsed = now_ms() - start;
+    printf("  b+ tree range lookups: %8.1f ms, %6.0f ns each\n", elapsed, elapsed * 1e6 / NUM_RANGES);
+
+    // inserts into loaded tree
+    start = now_ms();
+    for (int i = 0; i < NUM_INSERTS; i++) {
+        root = bplus_insert(root, rand() % max_val, num_vals + i);
+    }
+    elapsed = now_ms() - start;
+    printf("  b+ tree inserts:       %8.1f ms, %6.0f ns each\n", elapsed, elapsed * 1e6 / NUM_INSERTS);
+
+    free_node(root);
+    return checksum;
+}
+
+
+/**
+ * Runs bench_bplus's workload on an ART.
+ **/
+long long bench_art(int* data, size_t num_vals, int max_val, int* positions) {
+    srand(165);
+
+    // bulk load
+    double start = now_ms();
+    ArtTree* tree = art_bulk_load(data, num_vals, NULL);
+    printf("  ART bulk load:         %8.1f ms\n", now_ms() - start);
+    printf("  ART index size:        %8.1f MB, %zu keys\n", art_size(tree) / 1e6, tree->num_keys);
+
+    // point lookups
+    long long checksum = 0;
+    start = now_ms();
+    for (int i = 0; i < NUM_LOOKUPS; i++) {
+        checksum += art_point_lookup(tree, data[rand() % num_vals]);
+    }
+    double elapsed = now_ms() - start;
+    printf("  ART point lookups:     %8.1f ms, %6.0f ns each\n", elapsed, elapsed * 1e6 / NUM_LOOKUPS);
+
+    // range lookups
+    start = now_ms();
+    for (int i = 0; i < NUM_RANGES; i++) {
+        long low = rand() % max_val;
+        checksum += art_scan(tree, low, low + RANGE_WIDTH, 0, num_vals, NULL, positions);
+    }
+    elapsed = now_ms() - start;
+    printf("  ART range lookups:     %8.1f ms, %6.0f ns each\n", elapsed, elapsed * 1e6 / NUM_RANGES);
+
+    // inserts into loaded tree
+    start = now_ms();
+    for (int i = 0; i < NUM_INSERTS; i++) {
+        art_insert(tree, rand() % max_val, num_vals + i);
+    }
+    elapsed = now_ms() - start;
+    printf("  ART inserts:           %8.1f ms, %6.0f ns each\n", elapsed, elapsed * 1e6 / NUM_INSERTS);
+
+    free_art(tree);
+    return checksum;
+}
+
+
+/**
+ * One thread of the concurrent run, with its own random state
+ * and first row id for the vals it inserts.
+ **/
+typedef struct ConcurrentWorker {
+    BPTreeNode* root;
+    int max_val;
+    unsigned int seed;
+    int first_row_id;
+    long long checksum;
+} ConcurrentWorker;
+
+
+/**
+ * Mixes point lookups, small range lookups and inserts on a
+ * shared tree. Range buffers start small so they grow mid scan.
+ **/
+void* concurrent_worker(void* arg) {
+    ConcurrentWorker* worker = (ConcurrentWorker*) arg;
+    int capacity = 16;
+    int* row_ids = malloc(sizeof(int) * capacity);
+    BPTreeSpan span;
+
+    for (int i = 0; i < CONCURRENT_OPS; i++) {
+        int val = rand_r(&worker->seed) % worker->max_val;
+        if (i % CONCURRENT_INSERT_EVERY == 0) {
+            bplus_insert(worker->root, val, worker->first_row_id + i / CONCURRENT_INSERT_EVERY);
+        } else if (i % 2) {
+            find_span(worker->root, val, &span);
+            worker->checksum += span.count;
+        } else {
+            int high = val + RANGE_WIDTH / 10;
+            int num_results = 0;
+            find_pos_range(worker->root, &num_results, &row_ids, capacity, &val, &high);
+            capacity = num_results > capacity ? num_results : capacity;
+            worker->checksum += num_results;
+        }
+    }
+
+    free(row_ids);
+    return NULL;
+}
+
+
+/**
+ * Runs concurrent_worker on 1 to MAX_THREADS threads over a fresh
+ * tree each time, then checks leaves are in order and hold every
+ * loaded and inserted val.
+ **/
+void bench_concurrent(int* data, size_t num_vals, int max_val) {
+    printf("concurrent reads and inserts, %d ops per thread:\n", CONCURRENT_OPS);
+    for (int num_threads = 1; num_threads <= MAX_THREADS; num_threads *= 2) {
+        BPTreeNode* root = bplus_bulk_load(data, num_vals, BPLUS_FILL_FACTOR, NULL);
+        pthread_t threads[MAX_THREADS];
+        ConcurrentWorker workers[MAX_THREADS];
+
+        double start = now_ms();
+        for (int t = 0; t < num_threads; t++) {
+            workers[t].root = root;
+            workers[t].max_val = max_val;
+            workers[t].seed = 165 + t;
+            workers[t].first_row_id = (int) num_vals + t * (CONCURRENT_OPS / CONCURRENT_INSERT_EVERY);
+            workers[t].checksum = 0;
+            pthread_create(&threads[t], NULL, concurrent_worker, &workers[t]);
+        }
+        for (int t = 0; t < num_threads; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        double elapsed = now_ms() - start;
+
+        // every val loaded or inserted, in order
+        size_t num_entries = 0;
+        int in_order = 1;
+        int prev_val = 0;
+        for (BPTreeNode* leaf = find_first_leaf(root); leaf != NULL; leaf = bplus_next_leaf(leaf)) {
+            for (int i = 0; i < leaf->num_vals; i++) {
+                int val = bplus_leaf_val(leaf, i);
+                in_order &= !num_entries || val >= prev_val;
+                prev_val = val;
+                num_entries++;
+            }
+        }
+        size_t expected = num_vals + (size_t) num_threads * (CONCURRENT_OPS / CONCURRENT_INSERT_EVERY);
+
+        printf("  %d threads: %8.1f ms, %6.2f M ops/s, %s\n", num_threads, elapsed,
+            num_threads * (double) CONCURRENT_OPS / elapsed / 1e3,
+            in_order && num_entries == expected ? "consistent" : "INCONSISTENT");
+        free_node(root);
+    }
+}
+
+
+int main(int argc, char** argv) {
+    size_t num_vals = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_NUM_VALS;
+    int* data = malloc(sizeof(int) * num_vals);
+    int* positions = malloc(sizeof(int) * num_vals);
+
+    printf("b+ tree layout: %s, %s leaves, node %zu bytes, fanout %d, leaf size %d, %zu vals\n",
+        BPLUS_KEY_BLOCK ? "key block + simd search" : "binary search",
+        BPLUS_COMPRESSED_LEAVES ? "compressed" : "int",
+        sizeof(BPTreeNode), FANOUT, LEAF_MAX_ENTRIES, num_vals);
+
+    const char* distributions[] = {"uniform", "dense", "duplicates"};
+    for (int dist = 0; dist < 3; dist++) {
+        // uniform over 4x as many keys as vals, dense is a shuffled
+        // permutation of 0 to num_vals - 1, duplicates repeats each
+        // of num_vals / DUPLICATE_RATIO keys about that many times
+        int max_val = dist == 0 ? (int) (num_vals * 4) : dist == 1 ? (int) num_vals : (int) (num_vals / DUPLICATE_RATIO + 1);
+        srand(165);
+        for (size_t i = 0; i < num_vals; i++) {
+            data[i] = dist == 1 ? (int) i : rand() % max_val;
+        }
+        if (dist == 1) {
+            for (size_t i = num_vals - 1; i > 0; i--) {
+                size_t j = rand() % (i + 1);
+                int val = data[i];
+                data[i] = data[j];
+                data[j] = val;
+            }
+        }
+
+        printf("%s keys:\n", distributions[dist]);
+        long long checksum = bench_bplus(data, num_vals, max_val, positions);
+        long long art_checksum = bench_art(data, num_vals, max_val, positions);
+        printf("  checksums: %lld, %lld\n", checksum, art_checksum);
+    }
+
+    // uniform keys again for concurrent run
+    srand(165);
+    for (size_t i = 0; i < num_vals; i++) {
+        data[i] = rand() % (int) (num_vals * 4);
+    }
+    bench_concurrent(data, num_vals, (int) (num_vals * 4));
+
+    free(positions);
+    free(data);
+    return 0;
+}
@@ -0,0 +1,178 @@
+/**
+ * Microbenchmark for where nested loop join stops beating hashing.
+ * Built with and without SIMD nested loop compares (see
+ * NESTED_LOOP_SIMD), so the crossover of both kernels can be compared
+ * against the one the cost model predicts. Runs square joins, where
+ * both sides grow, and joins of a growing smaller side against a
+ * fixed bigger side.
+ *
+ * usage: ./bench_join [bigger_num_vals]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "join.h"
+#include "arena.h"
+
+#define DEFAULT_BIGGER_NUM_VALS (1 << 18)
+// minimum compares or tuples timed per trial, so
+// small joins are repeated enough to be measured
+#define MIN_WORK_PER_RUN (1 << 22)
+#define NUM_TRIALS 5
+#define NUM_SIZES 10
+
+
+/**
+ * Returns current time in ns.
+ **/
+double now_ns() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+
+/**
+ * Fills vals with num_vals random keys in [0, domain), and
+ * positions with 0 to num_vals - 1.
+ **/
+void random_input(int* vals, int* positions, int num_vals, int domain) {
+    for (int i = 0; i < num_vals; i++) {
+        vals[i] = rand() % domain;
+        positions[i] = i;
+    }
+}
+
+
+/**
+ * Returns ns of joining smaller against bigger with type, best of
+ * NUM_TRIALS averages over enough reps for MIN_WORK_PER_RUN compares
+ * or tuples, so noise only ever makes a join look slower.
+ **/
+double time_join(JoinType type,
+        int* smaller_vals, int* smaller_positions, int smaller_num_vals,
+        int* bigger_vals, int* bigger_positions, int bigger_num_vals) {
+    double work = type == NESTED_LOOP
+        ? (double) smaller_num_vals * bigger_num_vals : (double) smaller_num_vals + bigger_num_vals;
+    int reps = work < MIN_WORK_PER_RUN ? (int) (MIN_WORK_PER_RUN / work) : 1;
+
+    double best = 0;
+    for (int trial = 0; trial < NUM_TRIALS; trial++) {
+        double start = now_ns();
+        for (int rep = 0; rep < reps; rep++) {
+            JoinOutput output;
+            init_join_output(&output);
+            if (type == NESTED_LOOP) {
+                nested_loop_join(smaller_vals, smaller_positions, smaller_num_vals,
+                    bigger_vals, bigger_positions, bigger_num_vals, 1, &output);
+            } else if (type == ONE_PASS_HASH) {
+                hash_join(smaller_vals, smaller_positions, smaller_num_vals,
+                    bigger_vals, bigger_positions, bigger_num_vals, 1, &output);
+            } else {
+                radix_join(smaller_vals, smaller_positions, smaller_num_vals,
+                    bigger_vals, bigger_positions, bigger_num_vals, &output);
+            }
+            free_arena(output.arena);
+        }
+
+        double elapsed = (now_ns() - start) / reps;
+        if (!trial || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+
+/**
+ * Runs each smaller / bigger size pair, printing measured time of
+ * nested loop and both hash joins next to the cost model's estimates,
+ * then the first size where hashing measured and modeled cheaper.
+ **/
+void bench_sizes(const char* name, int* smaller_sizes, int* bigger_sizes, int num_sizes,
+        int* vals, int* positions, int* other_vals, int* other_positions) {
+    printf("%s:\n", name);
+    printf("  %8s %8s | %12s %12s %12s | %12s %12s  model picks\n",
+        "smaller", "bigger", "nested loop", "one pass", "radix", "model nl", "model hash");
+
+    int measured_crossover = -1;
+    int modeled_crossover = -1;
+    for (int i = 0; i < num_sizes; i++) {
+        int smaller_num_vals = smaller_sizes[i];
+        int bigger_num_vals = bigger_sizes[i];
+        int domain = bigger_num_vals;
+        random_input(vals, positions, smaller_num_vals, domain);
+        random_input(other_vals, other_positions, bigger_num_vals, domain);
+
+        double nested_loop = time_join(NESTED_LOOP, vals, positions, smaller_num_vals,
+            other_vals, other_positions, bigger_num_vals);
+        double one_pass = time_join(ONE_PASS_HASH, vals, positions, smaller_num_vals,
+            other_vals, other_positions, bigger_num_vals);
+        double radix = time_join(HASH, vals, positions, smaller_num_vals,
+            other_vals, other_positions, bigger_num_vals);
+
+        JoinStats stats;
+        stats.left_num_vals = smaller_num_vals;
+        stats.right_num_vals = bigger_num_vals;
+        stats.left_distinct = smaller_num_vals < domain ? smaller_num_vals : domain;
+        stats.right_distinct = bigger_num_vals < domain ? bigger_num_vals : domain;
+        stats.left_sorted = 0;
+        stats.right_sorted = 0;
+        stats.index_num_vals = 0;
+        stats.outer_num_vals = 0;
+
+        double model_nested_loop = estimate_join_cost(&stats, NESTED_LOOP);
+        double model_hash = estimate_join_cost(&stats, HASH);
+        double model_one_pass = estimate_join_cost(&stats, ONE_PASS_HASH);
+        if (model_one_pass < model_hash) {
+            model_hash = model_one_pass;
+        }
+
+        printf("  %8d %8d | %9.0f ns %9.0f ns %9.0f ns | %9.0f ns %9.0f ns  %s\n",
+            smaller_num_vals, bigger_num_vals, nested_loop, one_pass, radix,
+            model_nested_loop, model_hash, join_type_name(choose_join_type(&stats, AUTO_JOIN)));
+
+        if (measured_crossover < 0 && (one_pass < nested_loop || radix < nested_loop)) {
+            measured_crossover = smaller_num_vals;
+        }
+        if (modeled_crossover < 0 && model_hash < model_nested_loop) {
+            modeled_crossover = smaller_num_vals;
+        }
+    }
+    printf("  hashing cheaper from smaller side of %d measured, %d modeled\n\n",
+        measured_crossover, modeled_crossover);
+}
+
+
+int main(int argc, char** argv) {
+    int bigger_num_vals = argc > 1 ? atoi(argv[1]) : DEFAULT_BIGGER_NUM_VALS;
+    srand(42);
+
+    printf("nested loop compares: %s\n\n", NESTED_LOOP_SIMD ? "simd" : "scalar");
+
+    int* vals = malloc(sizeof(int) * bigger_num_vals);
+    int* positions = malloc(sizeof(int) * bigger_num_vals);
+    int* other_vals = malloc(sizeof(int) * bigger_num_vals);
+    int* other_positions = malloc(sizeof(int) * bigger_num_vals);
+
+    // both sides grow together
+    int square_sizes[NUM_SIZES] = {8, 16, 32, 48, 64, 96, 128, 256, 512, 1024};
+    bench_sizes("square joins", square_sizes, square_sizes, NUM_SIZES,
+        vals, positions, other_vals, other_positions);
+
+    // small side grows against fixed bigger side
+    int smaller_sizes[NUM_SIZES] = {1, 2, 4, 8, 12, 16, 24, 32, 64, 128};
+    int bigger_sizes[NUM_SIZES];
+    for (int i = 0; i < NUM_SIZES; i++) {
+        bigger_sizes[i] = bigger_num_vals;
+    }
+    bench_sizes("small against big joins", smaller_sizes, bigger_sizes, NUM_SIZES,
+        vals, positions, other_vals, other_positions);
+
+    free(vals);
+    free(positions);
+    free(other_vals);
+    free(other_positions);
+    return 0;
+}
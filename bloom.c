@@ -0,0 +1,106 @@
+/**
+ * Contains all functionality for blocked bloom
+ * filters. A filter built on one join side lets
+ * scans over the other side drop vals early.
+ **/
+
+#include <string.h>
+#include "bloom.h"
+
+
+/**
+ * Hashes val, high bits pick the block.
+ **/
+static inline unsigned long long bloom_hash(int val) {
+    unsigned long long hash = (unsigned int) val;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+
+/**
+ * Remixes val's hash for the bits set inside its block. Large
+ * filters use more than 16 high bits for the block, which would
+ * overlap the 48 low bits taken here if they came from hash itself.
+ **/
+static inline unsigned long long bloom_block_bits(unsigned long long hash) {
+    hash ^= hash >> 31;
+    hash *= 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+
+/**
+ * Returns first word of val's block.
+ **/
+static inline unsigned long long* bloom_block(BloomFilter* filter, unsigned long long hash) {
+    size_t block = filter->block_bits ? hash >> (64 - filter->block_bits) : 0;
+    return &filter->words[block * BLOOM_BLOCK_WORDS];
+}
+
+
+/**
+ * Builds bloom filter sized for num_vals
+ * and adds all vals to it.
+ **/
+BloomFilter* build_bloom(int* vals, size_t num_vals) {
+    BloomFilter* filter = malloc(sizeof(BloomFilter));
+
+    // power of two blocks with BLOOM_BITS_PER_KEY bits per val
+    size_t bits_per_block = BLOOM_BLOCK_WORDS * 64;
+    filter->block_bits = 0;
+    while (((size_t) 1 << filter->block_bits) * bits_per_block < num_vals * BLOOM_BITS_PER_KEY) {
+        filter->block_bits++;
+    }
+    filter->num_blocks = (size_t) 1 << filter->block_bits;
+    filter->words = calloc(filter->num_blocks * BLOOM_BLOCK_WORDS, sizeof(unsigned long long));
+
+    for (size_t i = 0; i < num_vals; i++) {
+        bloom_add(filter, vals[i]);
+    }
+
+    return filter;
+}
+
+
+void free_bloom(BloomFilter* filter) {
+    if (filter == NULL) {
+        return;
+    }
+    free(filter->words);
+    free(filter);
+}
+
+
+/**
+ * Sets one bit per word of val's block, each picked
+ * by the next 6 low bits of its remixed hash.
+ **/
+void bloom_add(BloomFilter* filter, int val) {
+    unsigned long long hash = bloom_hash(val);
+    unsigned long long* block = bloom_block(filter, hash);
+    unsigned long long bits = bloom_block_bits(hash);
+    for (int word = 0; word < BLOOM_BLOCK_WORDS; word++) {
+        block[word] |= 1ULL << ((bits >> (6 * word)) & 63);
+    }
+}
+
+
+/**
+ * Returns 1 if val may have been added, 0 if it definitely wasn't.
+ **/
+int bloom_contains(BloomFilter* filter, int val) {
+    unsigned long long hash = bloom_hash(val);
+    unsigned long long* block = bloom_block(filter, hash);
+    unsigned long long bits = bloom_block_bits(hash);
+    unsigned long long missing = 0;
+    for (int word = 0; word < BLOOM_BLOCK_WORDS; word++) {
+        missing |= ~block[word] & (1ULL << ((bits >> (6 * word)) & 63));
+    }
+    return !missing;
+}
@@ -1,313 +1,1344 @@
+#define _GNU_SOURCE
 /**
  * Contains all functionality
  * for b+ tree;
  **/
 
+#include <limits.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "bplus.h"
 #include "index.h"
+#include "sort.h"
+#include "slab.h"
+#include "position_map.h"
 #include <signal.h>
 
 
 void print_leaf(BPTreeNode* curr);
 void print_tree(BPTreeNode* curr);
 
+// every node layout must be exactly one page, so slab nodes
+// stay page and cache line aligned, fails to compile otherwise
+typedef char bptree_node_is_one_page[sizeof(BPTreeNode) == 4096 ? 1 : -1];
+
+
+#if BPLUS_COMPRESSED_LEAVES
+/**
+ * Compressed leaves store each key as its offset from the leaf's
+ * key_base and each row id as its offset from its row_id_base, both
+ * in the fewest of 1, 2 or 4 bytes that fit the leaf's range. Keys
+ * are packed from the front of packed, row ids from the back in
+ * reverse, so every entry a leaf may hold lies within packed at any
+ * widths, and a reader racing a rewrite never reads past the node.
+ * Keys are searched as offsets, without decoding them.
+ **/
+
+
+/**
+ * Returns bytes needed for offsets up to range, 1, 2 or 4.
+ **/
+static inline int offset_width(int64_t range) {
+    return range <= UINT8_MAX ? 1 : range <= UINT16_MAX ? 2 : 4;
+}
+
+
+/**
+ * Returns largest offset width bytes hold.
+ **/
+static inline int64_t width_max(int width) {
+    return ((int64_t) 1 << (8 * width)) - 1;
+}
+
+
+/**
+ * Returns entries a compressed leaf holds at given widths.
+ **/
+static inline int packed_capacity(int key_width, int row_id_width) {
+    int capacity = LEAF_PACKED_BYTES / (key_width + row_id_width);
+    return capacity < LEAF_MAX_ENTRIES ? capacity : LEAF_MAX_ENTRIES;
+}
+
+
+/**
+ * Returns offset at index of offsets of width bytes at packed.
+ **/
+static inline uint32_t load_offset(uint8_t* packed, int width, int index) {
+    if (width == 1) {
+        return packed[index];
+    } else if (width == 2) {
+        uint16_t offset;
+        memcpy(&offset, &packed[2 * index], sizeof(uint16_t));
+        return offset;
+    }
+    uint32_t offset;
+    memcpy(&offset, &packed[4 * index], sizeof(uint32_t));
+    return offset;
+}
+
+
+/**
+ * Sets offset at index of offsets of width bytes at packed.
+ **/
+static inline void store_offset(uint8_t* packed, int width, int index, uint32_t offset) {
+    if (width == 1) {
+        packed[index] = offset;
+    } else if (width == 2) {
+        uint16_t narrow = offset;
+        memcpy(&packed[2 * index], &narrow, sizeof(uint16_t));
+    } else {
+        memcpy(&packed[4 * index], &offset, sizeof(uint32_t));
+    }
+}
+
+
+/**
+ * Returns start of row id offsets in leaf up to entry end,
+ * they're stored last entry first, ending at packed's end.
+ **/
+static inline uint8_t* packed_row_ids(BPTreeLeafNode* leaf, int end) {
+    return &leaf->packed[LEAF_PACKED_BYTES - end * leaf->row_id_width];
+}
+
+
+/**
+ * Decodes count offsets of width bytes at packed into out, adding
+ * base. 1 and 2 byte offsets are widened 16 or 8 at once with SSE2.
+ **/
+static void decode_offsets(uint8_t* packed, int width, int base, int* out, int count) {
+    int i = 0;
+#ifdef __SSE2__
+    __m128i zero = _mm_setzero_si128();
+    __m128i broadcast = _mm_set1_epi32(base);
+    if (width == 1) {
+        for (; i + 16 <= count; i += 16) {
+            __m128i bytes = _mm_loadu_si128((__m128i*) &packed[i]);
+            __m128i low = _mm_unpacklo_epi8(bytes, zero);
+            __m128i high = _mm_unpackhi_epi8(bytes, zero);
+            _mm_storeu_si128((__m128i*) &out[i], _mm_add_epi32(_mm_unpacklo_epi16(low, zero), broadcast));
+            _mm_storeu_si128((__m128i*) &out[i + 4], _mm_add_epi32(_mm_unpackhi_epi16(low, zero), broadcast));
+            _mm_storeu_si128((__m128i*) &out[i + 8], _mm_add_epi32(_mm_unpacklo_epi16(high, zero), broadcast));
+            _mm_storeu_si128((__m128i*) &out[i + 12], _mm_add_epi32(_mm_unpackhi_epi16(high, zero), broadcast));
+        }
+    } else if (width == 2) {
+        for (; i + 8 <= count; i += 8) {
+            __m128i shorts = _mm_loadu_si128((__m128i*) &packed[2 * i]);
+            _mm_storeu_si128((__m128i*) &out[i], _mm_add_epi32(_mm_unpacklo_epi16(shorts, zero), broadcast));
+            _mm_storeu_si128((__m128i*) &out[i + 4], _mm_add_epi32(_mm_unpackhi_epi16(shorts, zero), broadcast));
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = (int) ((uint32_t) base + load_offset(packed, width, i));
+    }
+}
+
+
+/**
+ * Returns number of count offsets of width bytes at packed that are
+ * < target, comparing 16 bytes of them at once. SSE2 only compares
+ * signed lanes, so offsets and target have their sign bit flipped.
+ **/
+static inline int count_less_packed(uint8_t* packed, int width, int count, uint32_t target) {
+    int less = 0;
+    int i = 0;
+#ifdef __SSE2__
+    if (width == 1) {
+        __m128i bias = _mm_set1_epi8((char) 0x80);
+        __m128i broadcast = _mm_set1_epi8((char) (target ^ 0x80));
+        for (; i + 16 <= count; i += 16) {
+            __m128i lanes = _mm_xor_si128(_mm_loadu_si128((__m128i*) &packed[i]), bias);
+            less += __builtin_popcount(_mm_movemask_epi8(_mm_cmplt_epi8(lanes, broadcast)));
+        }
+    } else if (width == 2) {
+        __m128i bias = _mm_set1_epi16((short) 0x8000);
+        __m128i broadcast = _mm_set1_epi16((short) (target ^ 0x8000));
+        for (; i + 8 <= count; i += 8) {
+            __m128i lanes = _mm_xor_si128(_mm_loadu_si128((__m128i*) &packed[2 * i]), bias);
+            // each 16 bit lane sets 2 mask bits
+            less += __builtin_popcount(_mm_movemask_epi8(_mm_cmplt_epi16(lanes, broadcast))) / 2;
+        }
+    } else {
+        __m128i bias = _mm_set1_epi32((int) 0x80000000u);
+        __m128i broadcast = _mm_set1_epi32((int) (target ^ 0x80000000u));
+        for (; i + 4 <= count; i += 4) {
+            __m128i lanes = _mm_xor_si128(_mm_loadu_si128((__m128i*) &packed[4 * i]), bias);
+            less += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(lanes, broadcast))));
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        less += load_offset(packed, width, i) < target;
+    }
+    return less;
+}
+
+
+/**
+ * Returns number of count keys from start in compressed leaf
+ * node that are < val, comparing val as an offset.
+ **/
+static inline int leaf_count_less(BPTreeNode* node, int start, int count, int val) {
+    BPTreeLeafNode* leaf = &node->type.leaf_node;
+    int64_t target = (int64_t) val - leaf->key_base;
+    if (target <= 0) {
+        return 0;
+    }
+    if (target > width_max(leaf->key_width)) {
+        return count;
+    }
+    return count_less_packed(&leaf->packed[start * leaf->key_width], leaf->key_width, count, (uint32_t) target);
+}
+
+
+/**
+ * Returns 1 if val and row_id fit leaf node's bases and widths.
+ **/
+static inline int leaf_offsets_fit(BPTreeNode* node, int val, int row_id) {
+    BPTreeLeafNode* leaf = &node->type.leaf_node;
+    int64_t key_offset = (int64_t) val - leaf->key_base;
+    int64_t row_id_offset = (int64_t) row_id - leaf->row_id_base;
+    return node->num_vals > 0
+        && key_offset >= 0 && key_offset <= width_max(leaf->key_width)
+        && row_id_offset >= 0 && row_id_offset <= width_max(leaf->row_id_width);
+}
+#endif
+
+
+/**
+ * Returns key at index of leaf.
+ **/
+static inline int leaf_val(BPTreeNode* node, int index) {
+#if BPLUS_COMPRESSED_LEAVES
+    BPTreeLeafNode* leaf = &node->type.leaf_node;
+    return (int) ((uint32_t) leaf->key_base + load_offset(leaf->packed, leaf->key_width, index));
+#else
+    return node->type.leaf_node.vals[index];
+#endif
+}
+
+
+/**
+ * Returns row id at index of leaf.
+ **/
+static inline int leaf_row_id(BPTreeNode* node, int index) {
+#if BPLUS_COMPRESSED_LEAVES
+    BPTreeLeafNode* leaf = &node->type.leaf_node;
+    return (int) ((uint32_t) leaf->row_id_base + load_offset(packed_row_ids(leaf, index + 1), leaf->row_id_width, 0));
+#else
+    return node->type.leaf_node.positions[index];
+#endif
+}
+
+
+/**
+ * Returns key at index of leaf, for callers outside the tree.
+ **/
+int bplus_leaf_val(BPTreeNode* leaf, int index) {
+    return leaf_val(leaf, index);
+}
+
+
+/**
+ * Returns row id at index of leaf, for callers outside the tree.
+ **/
+int bplus_leaf_row_id(BPTreeNode* leaf, int index) {
+    return leaf_row_id(leaf, index);
+}
+
 
 /**
- * Clear pointers in node, used in loading from file.
+ * Copies leaf's keys and row ids from index start up to end into
+ * vals and row_ids, either of which may be NULL to skip it.
  **/
-void clear_node_ptrs(BPTreeNode* node) {
-    node->type.leaf_node.next = NULL;
-    node->type.leaf_node.prev = NULL;
-    node->parent = NULL;
+void bplus_leaf_entries(BPTreeNode* node, int start, int end, int* vals, int* row_ids) {
+    if (end <= start) {
+        return;
+    }
+    int count = end - start;
+#if BPLUS_COMPRESSED_LEAVES
+    BPTreeLeafNode* leaf = &node->type.leaf_node;
+    if (vals != NULL) {
+        decode_offsets(&leaf->packed[start * leaf->key_width], leaf->key_width, leaf->key_base, vals, count);
+    }
+    if (row_ids != NULL) {
+        // stored last first, so decode then put back in order
+        decode_offsets(packed_row_ids(leaf, end), leaf->row_id_width, leaf->row_id_base, row_ids, count);
+        for (int i = 0, j = count - 1; i < j; i++, j--) {
+            int row_id = row_ids[i];
+            row_ids[i] = row_ids[j];
+            row_ids[j] = row_id;
+        }
+    }
+#else
+    if (vals != NULL) {
+        memcpy(vals, &node->type.leaf_node.vals[start], sizeof(int) * count);
+    }
+    if (row_ids != NULL) {
+        memcpy(row_ids, &node->type.leaf_node.positions[start], sizeof(int) * count);
+    }
+#endif
+}
+
+
+#if BPLUS_KEY_BLOCK
+/**
+ * Returns number of keys node has room for.
+ **/
+static inline int node_capacity(BPTreeNode* node) {
+    if (!node->is_leaf) {
+        return FANOUT - 1;
+    }
+#if BPLUS_COMPRESSED_LEAVES
+    return packed_capacity(node->type.leaf_node.key_width, node->type.leaf_node.row_id_width);
+#else
+    return LEAF_SIZE;
+#endif
+}
+
+
+/**
+ * Returns number of keys per key block segment of node.
+ **/
+static inline int key_block_stride(BPTreeNode* node) {
+    return (node_capacity(node) + KEY_BLOCK_KEYS - 1) / KEY_BLOCK_KEYS;
+}
+
+
+/**
+ * Returns number of the count keys starting at keys that are < val.
+ **/
+static inline int count_less(int* keys, int count, int val) {
+    int less = 0;
+    int i = 0;
+#ifdef __SSE2__
+    __m128i broadcast = _mm_set1_epi32(val);
+    for (; i + 4 <= count; i += 4) {
+        __m128i lt = _mm_cmpgt_epi32(broadcast, _mm_loadu_si128((__m128i*) &keys[i]));
+        less += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(lt)));
+    }
+#endif
+    for (; i < count; i++) {
+        less += keys[i] < val;
+    }
+    return less;
+}
+#endif
+
+
+/**
+ * Rebuilds node's key block after its keys change.
+ **/
+void refresh_key_block(BPTreeNode* node) {
+#if BPLUS_KEY_BLOCK
+    int stride = key_block_stride(node);
+    for (int i = 0; i < KEY_BLOCK_KEYS; i++) {
+        int end = (i + 1) * stride < node->num_vals ? (i + 1) * stride : node->num_vals;
+        if (i * stride >= node->num_vals) {
+            node->key_block[i] = INT_MAX;
+        } else {
+            node->key_block[i] = node->is_leaf ? leaf_val(node, end - 1) : node->type.internal_node.vals[end - 1];
+        }
+    }
+#else
+    (void) node;
+#endif
+}
+
+
+/**
+ * Returns index of first key in node >= val, leaf or internal.
+ *
+ * With key blocks, the block's keys below val give the segment val
+ * falls in, then only that segment is scanned. Both steps compare
+ * 4 keys at once, touching about 3 cache lines instead of the ~9
+ * a binary search over the page does. Compressed leaves compare
+ * 16 / width keys at once, as offsets.
+ **/
+int bplus_node_search(BPTreeNode* node, int val) {
+#if BPLUS_KEY_BLOCK
+    int segment = count_less(node->key_block, KEY_BLOCK_KEYS, val);
+    int stride = key_block_stride(node);
+    int start = segment * stride;
+    if (start >= node->num_vals) {
+        return node->num_vals;
+    }
+    int count = start + stride < node->num_vals ? stride : node->num_vals - start;
+#if BPLUS_COMPRESSED_LEAVES
+    if (node->is_leaf) {
+        return start + leaf_count_less(node, start, count, val);
+    }
+    return start + count_less(&node->type.internal_node.vals[start], count, val);
+#else
+    int* keys = node->is_leaf ? node->type.leaf_node.vals : node->type.internal_node.vals;
+    return start + count_less(&keys[start], count, val);
+#endif
+#else
+    if (node->is_leaf) {
+#if BPLUS_COMPRESSED_LEAVES
+        return leaf_count_less(node, 0, node->num_vals, val);
+#else
+        return binary_search(node->type.leaf_node.vals, node->num_vals, val);
+#endif
+    }
+    return binary_search(node->type.internal_node.vals, node->num_vals, val);
+#endif
+}
+
+
+/**
+ * Sets leaf's entries to the count vals and row_ids, vals sorted,
+ * rewriting the whole leaf. Compressed leaves get bases and widths
+ * fit to the entries, caller checks they fit with leaf_has_room.
+ **/
+static void leaf_store(BPTreeNode* node, int* vals, int* row_ids, int count) {
+#if BPLUS_COMPRESSED_LEAVES
+    BPTreeLeafNode* leaf = &node->type.leaf_node;
+    int min_row_id = count ? row_ids[0] : 0;
+    int max_row_id = min_row_id;
+    for (int i = 1; i < count; i++) {
+        min_row_id = row_ids[i] < min_row_id ? row_ids[i] : min_row_id;
+        max_row_id = row_ids[i] > max_row_id ? row_ids[i] : max_row_id;
+    }
+
+    leaf->key_base = count ? vals[0] : 0;
+    leaf->row_id_base = min_row_id;
+    leaf->key_width = offset_width(count ? (int64_t) vals[count - 1] - vals[0] : 0);
+    leaf->row_id_width = offset_width((int64_t) max_row_id - min_row_id);
+
+    uint8_t* packed = packed_row_ids(leaf, count);
+    for (int i = 0; i < count; i++) {
+        store_offset(leaf->packed, leaf->key_width, i, (uint32_t) vals[i] - (uint32_t) leaf->key_base);
+        store_offset(packed, leaf->row_id_width, count - 1 - i, (uint32_t) row_ids[i] - (uint32_t) min_row_id);
+    }
+#else
+    memcpy(node->type.leaf_node.vals, vals, sizeof(int) * count);
+    memcpy(node->type.leaf_node.positions, row_ids, sizeof(int) * count);
+#endif
+    node->num_vals = count;
+    refresh_key_block(node);
+}
+
+
+/**
+ * Returns 1 if val and row_id can be added to leaf without splitting
+ * it. A compressed leaf has room if it holds one more entry at the
+ * widths its keys and row ids need with the new ones.
+ **/
+static int leaf_has_room(BPTreeNode* node, int val, int row_id) {
+    if (node->num_vals >= LEAF_MAX_ENTRIES) {
+        return 0;
+    }
+#if BPLUS_COMPRESSED_LEAVES
+    BPTreeLeafNode* leaf = &node->type.leaf_node;
+    if (leaf_offsets_fit(node, val, row_id)) {
+        return node->num_vals < packed_capacity(leaf->key_width, leaf->row_id_width);
+    }
+
+    int64_t min_key = val;
+    int64_t max_key = val;
+    int64_t min_row_id = row_id;
+    int64_t max_row_id = row_id;
+    if (node->num_vals) {
+        min_key = leaf_val(node, 0) < min_key ? leaf_val(node, 0) : min_key;
+        max_key = leaf_val(node, node->num_vals - 1) > max_key ? leaf_val(node, node->num_vals - 1) : max_key;
+        for (int i = 0; i < node->num_vals; i++) {
+            int other = leaf_row_id(node, i);
+            min_row_id = other < min_row_id ? other : min_row_id;
+            max_row_id = other > max_row_id ? other : max_row_id;
+        }
+    }
+    return node->num_vals < packed_capacity(offset_width(max_key - min_key), offset_width(max_row_id - min_row_id));
+#else
+    (void) val;
+    (void) row_id;
+    return 1;
+#endif
+}
+
+
+/**
+ * Removes entry at index from leaf.
+ **/
+static void remove_from_leaf(BPTreeNode* node, int index) {
+    int num_vals = node->num_vals;
+#if BPLUS_COMPRESSED_LEAVES
+    BPTreeLeafNode* leaf = &node->type.leaf_node;
+    int key_width = leaf->key_width;
+    int row_id_width = leaf->row_id_width;
+    node->num_vals--;
+    memmove(&leaf->packed[index * key_width], &leaf->packed[(index + 1) * key_width], (num_vals - index - 1) * key_width);
+    memmove(packed_row_ids(leaf, num_vals - 1), packed_row_ids(leaf, num_vals), (num_vals - index - 1) * row_id_width);
+#else
+    for (int i = index; i < num_vals - 1; i++) {
+        node->type.leaf_node.positions[i] = node->type.leaf_node.positions[i + 1];
+        node->type.leaf_node.vals[i] = node->type.leaf_node.vals[i + 1];
+    }
+    node->num_vals--;
+#endif
+    refresh_key_block(node);
+}
+
+
+/**
+ * Returns first node of the slab node's tree lives in, finding the
+ * slab by masking node's address as slab_of does.
+ **/
+static inline BPTreeNode* tree_nodes(BPTreeNode* node) {
+    return (BPTreeNode*) (((size_t) node & ~(SLAB_REGION_BYTES - 1)) + SLAB_HEADER_BYTES);
+}
+
+
+/**
+ * Returns node of node's tree that id links to, NULL for 0.
+ **/
+static inline BPTreeNode* node_at(BPTreeNode* node, NodeId id) {
+    return id ? tree_nodes(node) + (id - 1) : NULL;
+}
+
+
+/**
+ * Returns id the rest of node's tree links to node by, 0 for NULL.
+ **/
+static inline NodeId node_id(BPTreeNode* node) {
+    return node ? (NodeId) (node - tree_nodes(node)) + 1 : 0;
+}
+
+
+/**
+ * Returns child of internal node at index.
+ **/
+BPTreeNode* bplus_child(BPTreeNode* node, int index) {
+    return node_at(node, node->type.internal_node.children[index]);
+}
+
+
+/**
+ * Returns leaf after leaf, NULL if it's last.
+ **/
+BPTreeNode* bplus_next_leaf(BPTreeNode* leaf) {
+    return node_at(leaf, leaf->type.leaf_node.next);
+}
+
+
+/**
+ * Returns leaf before leaf, NULL if it's first.
+ **/
+BPTreeNode* bplus_prev_leaf(BPTreeNode* leaf) {
+    return node_at(leaf, leaf->type.leaf_node.prev);
+}
+
+
+/**
+ * Returns parent of node, NULL for root.
+ **/
+static inline BPTreeNode* node_parent(BPTreeNode* node) {
+    return node_at(node, node->parent);
+}
+
+
+/**
+ * Concurrency: readers take no locks. They read a node's version,
+ * read the node, then check its version is unchanged, restarting
+ * from the root if a writer got in between. Writers lock only the
+ * nodes they change, by making version odd, and unlock by making
+ * it even again, so each write leaves the node a new version.
+ *
+ * Inserts that fit in their leaf lock just that leaf. Splits are
+ * serialized by the mutex in the tree's slab header and keep every
+ * node they change locked until the split is done, so no reader
+ * sees a split node before its parent knows of the new sibling.
+ * Nodes are only freed with the whole tree, so a reader following
+ * a stale pointer still reads a valid node.
+ **/
+
+
+/**
+ * Briefly backs off while spinning on a locked node.
+ **/
+static inline void spin_pause(void) {
+#ifdef __SSE2__
+    _mm_pause();
+#endif
+}
+
+
+/**
+ * Waits until node isn't write locked, returns its version.
+ **/
+static inline uint64_t node_read_lock(BPTreeNode* node) {
+    uint64_t version;
+    while ((version = __atomic_load_n(&node->version, __ATOMIC_ACQUIRE)) & 1) {
+        spin_pause();
+    }
+    return version;
+}
+
+
+/**
+ * Returns 1 if node still has version, so what
+ * was read from it since is consistent.
+ **/
+static inline int node_validate(BPTreeNode* node, uint64_t version) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&node->version, __ATOMIC_RELAXED) == version;
+}
+
+
+/**
+ * Write locks node if it still has version.
+ * Returns 0 if it changed, then caller restarts.
+ **/
+static inline int node_upgrade_lock(BPTreeNode* node, uint64_t version) {
+    return __atomic_compare_exchange_n(&node->version, &version, version + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Write locks node, waiting for other writers.
+ **/
+static inline void node_write_lock(BPTreeNode* node) {
+    while (!node_upgrade_lock(node, node_read_lock(node))) {
+        spin_pause();
+    }
+}
+
+
+/**
+ * Unlocks node, publishing its writes under a new version.
+ **/
+static inline void node_write_unlock(BPTreeNode* node) {
+    __atomic_fetch_add(&node->version, 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Returns current root of tree given an old root, which
+ * may have gained parents since from splits.
+ **/
+static BPTreeNode* bplus_root(BPTreeNode* root) {
+    NodeId parent;
+    while ((parent = __atomic_load_n(&root->parent, __ATOMIC_ACQUIRE)) != 0) {
+        root = node_at(root, parent);
+    }
+    return root;
+}
+
+
+/**
+ * Descends from root to the leaf val belongs in without locking.
+ * A child's version is read before its parent is checked unchanged,
+ * so a descent through a node being split restarts from the root.
+ * Sets version to leaf's, for caller to validate what it reads.
+ **/
+static BPTreeNode* find_leaf_optimistic(BPTreeNode* root, int val, uint64_t* version) {
+    for (;;) {
+        BPTreeNode* node = bplus_root(root);
+        uint64_t node_version = node_read_lock(node);
+
+        // tree grew a new root since
+        if (node->parent != 0) {
+            continue;
+        }
+
+        while (!node->is_leaf) {
+            BPTreeNode* child = bplus_child(node, bplus_node_search(node, val));
+            if (!node_validate(node, node_version)) {
+                break;
+            }
+
+            uint64_t child_version = node_read_lock(child);
+            if (!node_validate(node, node_version)) {
+                break;
+            }
+            node = child;
+            node_version = child_version;
+        }
+
+        if (node->is_leaf) {
+            *version = node_version;
+            return node;
+        }
+    }
+}
+
+
+/**
+ * Descends from root to its first leaf, or last if last, without
+ * locking, coupling versions as find_leaf_optimistic does. Sets
+ * version to leaf's.
+ **/
+static BPTreeNode* find_edge_leaf_optimistic(BPTreeNode* root, int last, uint64_t* version) {
+    for (;;) {
+        BPTreeNode* node = bplus_root(root);
+        uint64_t node_version = node_read_lock(node);
+
+        // tree grew a new root since
+        if (node->parent != 0) {
+            continue;
+        }
+
+        while (!node->is_leaf) {
+            BPTreeNode* child = bplus_child(node, last ? node->num_vals : 0);
+            uint64_t child_version = node_read_lock(child);
+            if (!node_validate(node, node_version)) {
+                break;
+            }
+            node = child;
+            node_version = child_version;
+        }
+
+        if (node->is_leaf) {
+            *version = node_version;
+            return node;
+        }
+    }
+}
+
+
+/**
+ * Header of a b+ tree's image on disk. The image itself is the
+ * tree's slab of nodes, page aligned in the file after the header
+ * and padded to a whole page, so it can be mapped back in as is.
+ **/
+typedef struct BPTreeImage {
+    uint64_t num_nodes;
+    uint32_t node_size;         // sizeof(BPTreeNode) image was written with
+    uint32_t compressed_leaves; // BPLUS_COMPRESSED_LEAVES image was written with
+    NodeId root;                // 0 for an empty tree
+} BPTreeImage;
+
+
+/**
+ * Writes zeros to fd up to the next page boundary.
+ **/
+static void pad_to_page(FILE* fd) {
+    static const char zeros[4096];
+    long page_size = sysconf(_SC_PAGESIZE);
+    long padding = (page_size - ftell(fd) % page_size) % page_size;
+    while (padding > 0) {
+        long count = padding < (long) sizeof(zeros) ? padding : (long) sizeof(zeros);
+        fwrite(zeros, 1, count, fd);
+        padding -= count;
+    }
+}
+
+
+/**
+ * Dumps tree given by root to fd as an image of its slab, then frees
+ * it. Links are node ids so nodes are written as is. Leaves keep row
+ * ids, the table's position map is dumped along with it.
+ **/
+void dump_bptree(FILE* fd, BPTreeNode* root) {
+    BPTreeImage image = { 0, sizeof(BPTreeNode), BPLUS_COMPRESSED_LEAVES, 0 };
+    Slab* slab = NULL;
+    if (root != NULL) {
+        slab = slab_of(root);
+        image.num_nodes = slab->num_objects;
+        image.root = node_id(bplus_root(root));
+    }
+    fwrite(&image, sizeof(BPTreeImage), 1, fd);
+    pad_to_page(fd);
+
+    BPTreeNode node;
+    for (size_t i = 0; i < image.num_nodes; i++) {
+        memcpy(&node, slab_object(slab, i), sizeof(BPTreeNode));
+        node.version = 0;
+        fwrite(&node, sizeof(BPTreeNode), 1, fd);
+    }
+    pad_to_page(fd);
+
+    // free btree
+    free_node(root);
+}
+
+
+/**
+ * Loads tree dumped at fd's position by mapping its image in place
+ * of a new slab, leaving fd past it. Nothing is read or linked up
+ * front, pages come in as the tree is used and are only copied when
+ * first written, so loading takes the same time for any size tree.
+ * fd must stay unchanged on disk while tree lives, dumps replace
+ * the file rather than write over it. Returns root, NULL if empty
+ * or the image couldn't be mapped.
+ **/
+BPTreeNode* load_bptree(FILE* fd) {
+    BPTreeImage image;
+    if (fread(&image, sizeof(BPTreeImage), 1, fd) != 1) {
+        return NULL;
+    }
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    long offset = (ftell(fd) + page_size - 1) / page_size * page_size;
+    long image_bytes = (image.num_nodes * image.node_size + page_size - 1) / page_size * page_size;
+    fseek(fd, offset + image_bytes, SEEK_SET);
+
+    if (image.root == 0 || image.node_size != sizeof(BPTreeNode) || image.compressed_leaves != BPLUS_COMPRESSED_LEAVES) {
+        return NULL;
+    }
+
+    Slab* slab = map_slab(fileno(fd), offset, image.num_nodes, sizeof(BPTreeNode));
+    if (slab == NULL) {
+        return NULL;
+    }
+    return slab_object(slab, image.root - 1);
+}
+
+
+/**
+ * Frees whole tree given node belongs to, all
+ * of a tree's nodes are released with its slab.
+ **/
+void free_node(BPTreeNode* node) {
+    if (node != NULL) {
+        free_slab(slab_of(node));
+    }
 }
 
 
-/**
- * Recursively dump a bp tree node to the given fd.
+/** 
+ * Find index where first instance of val should be, starting at
+ * *leaf read at *version. Steps back to previous leaves while val's
+ * run continues into them, moving leaf and version along. Returns
+ * -1 if a leaf changed while read, then caller restarts.
  **/
-void dump_bptree_node(FILE* fd, BPTreeNode* node, int* base_data) {
-    // if leaf need to dump pos ptrs
-    if (node->is_leaf) {
-        // dump node's vals
-        fwrite(&node->type.leaf_node.vals, sizeof(int), node->num_vals, fd);
+static int find_leaf_val_index(BPTreeNode** leaf, uint64_t* version, int val) {
+    BPTreeNode* node = *leaf;
 
-        // dump all children
-        for (int num_child = 0; num_child < node->num_vals; num_child++) {
-            int pos = node->type.leaf_node.positions[num_child];
-            fwrite(&pos, sizeof(int), 1, fd);
-        }
-    } else {
-        // dump node's vals
-        fwrite(&node->type.internal_node.vals, sizeof(int), node->num_vals, fd);
+    // simply search for val
+    int index = bplus_node_search(node, val);
 
-        // dump all children
-        for (int num_child = 0; num_child <= node->num_vals; num_child++) {
-            // write child
-            BPTreeNode* child = (BPTreeNode*) node->type.internal_node.pointers[num_child];
-            fwrite(child, sizeof(BPTreeNode), 1, fd);
-            
-            // recursively dump
-            dump_bptree_node(fd, child, base_data);
+    // if index is 0 need to check previous leafs
+    while (index == 0) {
+        BPTreeNode* prev_node = bplus_prev_leaf(node);
+        if (!node_validate(node, *version)) {
+            return -1;
+        }
+        if (prev_node == NULL) {
+            break;
         }
-    }
-}
-
 
-void dump_bptree(FILE* fd, BPTreeNode* root, int* base_data) {    
-    // dump root metadata
-    fwrite(root, sizeof(BPTreeNode), 1, fd);
+        // get index of val in previous leaf node, which must
+        // still link to node, else it split since node was read
+        uint64_t prev_version = node_read_lock(prev_node);
+        int prev_index = bplus_node_search(prev_node, val);
+        int prev_num_vals = prev_node->num_vals;
+        BPTreeNode* prev_next = bplus_next_leaf(prev_node);
+        if (!node_validate(prev_node, prev_version) || prev_next != node) {
+            return -1;
+        }
 
-    // recursively dump nodes
-    dump_bptree_node(fd, root, base_data);    
+        // if index is very last, val isn't in previous leaf
+        if (prev_index == prev_num_vals) {
+            break;
+        }
+        node = prev_node;
+        *version = prev_version;
+        index = prev_index;
+    }
 
-    // free btree
-    free_node(root);
+    *leaf = node;
+    return index;
 }
 
-typedef struct ConnectNodes {
-    BPTreeNode** connect_children;
-    int num_children;
-} ConnectNodes;
-
 
 /**
- * Recursively load a bp tree node to the given fd.
+ * Given leaf val belongs in, read at version, sets span to the
+ * entries with key val. Returns 0 if a leaf changed while val's run
+ * was counted, then caller descends again.
  **/
-void load_bptree_node(FILE* fd, BPTreeNode* node, ConnectNodes* t, int* base_data) {
-    // recursively load children
-    BPTreeNode* prev_child = NULL;
-    for (int num_child = 0; num_child <= node->num_vals; num_child++) {
-        // read child metadata
-        BPTreeNode* child = create_node();
-        fread(child, sizeof(BPTreeNode), 1, fd);
-        clear_node_ptrs(child);
-
-        // set child's parent
-        child->parent = node;
-
-        // if child leaf just load pos ptrs
-        if (child->is_leaf) {
-            // read vals
-            fread(child->type.leaf_node.vals, sizeof(int), child->num_vals, fd);
-
-            // read pos ptrs
-            for (int num_pos = 0; num_pos < child->num_vals; num_pos++) {
-                int* pos_ptr = malloc(sizeof(int));
-                fread(pos_ptr, sizeof(int), 1, fd);
-                // TODO: get address via ptr arithmetic: need address of base data
-                child->type.leaf_node.positions[num_pos] = *pos_ptr;
-            }
+static int leaf_span(BPTreeNode* leaf, uint64_t version, int val, BPTreeSpan* span) {
+    int index = find_leaf_val_index(&leaf, &version, val);
+    if (index < 0) {
+        return 0;
+    }
 
-            // set prev/next
-            if (prev_child != NULL) {
-                prev_child->type.leaf_node.next = child;
-                child->type.leaf_node.prev = prev_child;
-            // if on first child, add to connect children
-            } else {
-                t->connect_children = realloc(t->connect_children, ++t->num_children * sizeof(BPTreeNode*));
-                t->connect_children[t->num_children - 1] = child;
+    // count val's run, into next leaves while it reaches their end
+    BPTreeSpan found = { NULL, 0, 0, 0 };
+    BPTreeNode* node = leaf;
+    uint64_t node_version = version;
+    for (;;) {
+        int num_vals = node->num_vals;
+        for (; index < num_vals && leaf_val(node, index) == val; index++) {
+            if (!found.count) {
+                found.leaf = node;
+                found.index = index;
+                found.version = node_version;
             }
-
-            prev_child = child;
-        // else recursively load children
-        } else {
-            // read vals
-            fread(child->type.internal_node.vals, sizeof(int), child->num_vals, fd);
-
-            load_bptree_node(fd, child, t, base_data);
+            found.count++;
         }
+        BPTreeNode* next = index == num_vals ? bplus_next_leaf(node) : NULL;
 
-        node->type.internal_node.pointers[num_child] = child;
+        if (!node_validate(node, node_version)) {
+            return 0;
+        }
+        if (next == NULL) {
+            break;
+        }
+        node = next;
+        node_version = node_read_lock(node);
+        index = 0;
     }
 
-    if (prev_child != NULL) {
-        t->connect_children = realloc(t->connect_children, ++t->num_children * sizeof(BPTreeNode*));
-        t->connect_children[t->num_children - 1] = prev_child;
+    if (!node_validate(leaf, version)) {
+        return 0;
     }
+    *span = found;
+    return 1;
 }
 
 
-void* load_bptree(FILE* fd, int* base_data) {
-    // load root
-    BPTreeNode* root = create_node();
-    fread(root, sizeof(BPTreeNode), 1, fd);
-    if (root->is_leaf) {
-        fread(root->type.leaf_node.vals, sizeof(int), root->num_vals, fd);
-    } else {
-        fread(root->type.internal_node.vals, sizeof(int), root->num_vals, fd);
+/**
+ * Point lookup: sets span to the entries with key val, without
+ * allocating or copying any, and returns their count, 0 if val
+ * isn't in tree. Leaves are read optimistically, restarting if
+ * any changes while val's run is counted.
+ **/
+int find_span(BPTreeNode* root, int val, BPTreeSpan* span) {
+    span->leaf = NULL;
+    span->index = 0;
+    span->count = 0;
+    span->version = 0;
+    if (root == NULL) {
+        return 0;
     }
-    clear_node_ptrs(root);
 
-    ConnectNodes* t = malloc(sizeof(ConnectNodes));
-    t->connect_children = NULL;
-    t->num_children = 0;
+    for (;;) {
+        uint64_t version;
+        BPTreeNode* leaf = find_leaf_optimistic(root, val, &version);
+        if (leaf_span(leaf, version, val, span)) {
+            return span->count;
+        }
+    }
+}
 
-    // recursively load children
-    load_bptree_node(fd, root, t, base_data);
 
-    // connect leaves
-    BPTreeNode* last = NULL;
-    BPTreeNode* first = NULL;
-    for (int i = 1; i < t->num_children - 1; i += 2) {
-        last = t->connect_children[i];
-        first = t->connect_children[i + 1];
+/**
+ * Point lookups for a batch of vals, setting spans[i] as find_span
+ * does for vals[i]. All descents move down one level at a time,
+ * prefetching each child before any of them are searched. A child's
+ * version is read before its parent is checked unchanged, as in
+ * find_leaf_optimistic, and a val whose descent or leaf changed is
+ * looked up again on its own.
+ **/
+void find_spans(BPTreeNode* root, int* vals, int num_vals, BPTreeSpan* spans) {
+    if (root == NULL) {
+        for (int b = 0; b < num_vals; b++) {
+            find_span(root, vals[b], &spans[b]);
+        }
+        return;
+    }
 
-        last->type.leaf_node.next = first;
-        first->type.leaf_node.prev = last;
+    BPTreeNode* nodes[num_vals];
+    BPTreeNode* children[num_vals];
+    uint64_t versions[num_vals];
+
+    // tree grew a new root since, descend one at a time
+    BPTreeNode* node = bplus_root(root);
+    uint64_t version = node_read_lock(node);
+    int consistent = node->parent == 0;
+    for (int b = 0; b < num_vals; b++) {
+        nodes[b] = consistent ? node : NULL;
+        versions[b] = version;
     }
 
-    free(t);
+    // tree is balanced so every descent reaches leaves together
+    while (consistent && !node->is_leaf) {
+        for (int b = 0; b < num_vals; b++) {
+            if (nodes[b] != NULL) {
+                children[b] = bplus_child(nodes[b], bplus_node_search(nodes[b], vals[b]));
+                // key block and middle of keys
+                __builtin_prefetch(children[b]);
+                __builtin_prefetch(&children[b]->type.internal_node.vals[FANOUT / 2]);
+            }
+        }
+
+        // level's first valid child says whether descents are done
+        consistent = 0;
+        for (int b = 0; b < num_vals; b++) {
+            if (nodes[b] == NULL) {
+                continue;
+            }
+            uint64_t child_version = node_read_lock(children[b]);
+            if (!node_validate(nodes[b], versions[b]) || (consistent && children[b]->is_leaf != node->is_leaf)) {
+                nodes[b] = NULL;
+                continue;
+            }
+            nodes[b] = children[b];
+            versions[b] = child_version;
+            if (!consistent) {
+                node = children[b];
+                consistent = 1;
+            }
+        }
+    }
 
-    return (void*) root;
+    for (int b = 0; b < num_vals; b++) {
+        if (nodes[b] == NULL || !leaf_span(nodes[b], versions[b], vals[b], &spans[b])) {
+            find_span(root, vals[b], &spans[b]);
+        }
+    }
 }
 
 
 /**
- * Recursively free BPTreeNode memory
+ * Copies row ids of span, found by find_span, into row_ids. Returns
+ * 0 if span's first leaf changed since, or a later one while copied,
+ * then caller finds span again.
  **/
-void free_node(BPTreeNode* node) {
-    // if leaf just need to free
-    if (node->is_leaf) {
-        free(node);
-    // else call free_node for all children
-    } else {
-        for (int i = 0; i <= node->num_vals; i++) {
-            BPTreeNode* child = node->type.internal_node.pointers[i];
-            free_node(child);
+int span_row_ids(BPTreeSpan* span, int* row_ids) {
+    BPTreeNode* node = span->leaf;
+    uint64_t version = span->version;
+    int index = span->index;
+    int copied = 0;
+    while (copied < span->count) {
+        if (node == NULL) {
+            return 0;
+        }
+
+        int end = node->num_vals;
+        if (end - index > span->count - copied) {
+            end = index + span->count - copied;
         }
-        
-        // free node
-        free(node);
+        if (end > index) {
+            bplus_leaf_entries(node, index, end, NULL, &row_ids[copied]);
+            copied += end - index;
+        }
+        BPTreeNode* next = bplus_next_leaf(node);
+
+        if (!node_validate(node, version)) {
+            return 0;
+        }
+        node = next;
+        version = node != NULL ? node_read_lock(node) : 0;
+        index = 0;
     }
+    return 1;
 }
 
 
-/** 
- * Find index where first instance of val should be.
+/**
+ * Sets ret_indices to row ids of vals in [min_val, max_val), and
+ * num_results to their count. Leaves are read optimistically, if
+ * any changes before the scan finishes the scan starts over.
+ *
+ * ret_indices holds capacity row ids. A leaf is only copied once
+ * it fits, a torn leaf restarts the scan and a valid one that
+ * doesn't fit grows ret_indices, so a scan racing writers never
+ * writes past the buffer.
  **/
-LeafIndexRes* find_leaf_val_index(BPTreeNode* node, int val) {
-    // simply binary search for val
-    int index = binary_search(node->type.leaf_node.vals, node->num_vals, val);
+void find_pos_range(BPTreeNode* root, int* num_results, int** ret_indices, int capacity, int* min_val, int* max_val) {
+    int num_indices = 0;
+    int* return_indices = *ret_indices;
 
-    // if index is 0 need to check previous leafs
-    if (index == 0) {
-        BPTreeNode* prev_node = node->type.leaf_node.prev;
-        int prev_index;
-        while (prev_node != NULL) {
-            // get index of val in previous leaf node
-            prev_index = binary_search(prev_node->type.leaf_node.vals, prev_node->num_vals, val);
-
-            // if index isn't very last, then val is in leaf node
-            if (prev_index < prev_node->num_vals) {
-                // set leaf node to prev_node
-                node = prev_node;
-
-                // keep moving left till found position where node val != val
-                while (prev_index > 0 && prev_node->type.leaf_node.vals[prev_index - 1] == val) {
-                    prev_index--;
-                }
-                index = prev_index;
+    while (root != NULL && min_val != NULL && max_val != NULL) {
+        num_indices = 0;
+
+        // find first leaf and index in range
+        uint64_t version;
+        BPTreeNode* leaf_node = find_leaf_optimistic(root, *min_val, &version);
+        int start_index = find_leaf_val_index(&leaf_node, &version, *min_val);
+
+        // find last leaf and index past range
+        uint64_t max_version;
+        BPTreeNode* max_leaf_node = find_leaf_optimistic(root, *max_val, &max_version);
+        int max_index = find_leaf_val_index(&max_leaf_node, &max_version, *max_val);
+        if (start_index < 0 || max_index < 0) {
+            continue;
+        }
 
-                // if at prev_index 0, need to continue to previous leaf node
-                if (prev_index == 0) {
-                    prev_node = prev_node->type.leaf_node.prev;
-                } else {
+        int consistent = 1;
+        for (;;) {
+            // max_index only holds for last leaf as it was found
+            if (leaf_node == max_leaf_node && version != max_version) {
+                consistent = 0;
+                break;
+            }
+
+            int end_index = leaf_node == max_leaf_node ? max_index : leaf_node->num_vals;
+            if (end_index > start_index && num_indices + end_index - start_index > capacity) {
+                if (!node_validate(leaf_node, version)) {
+                    consistent = 0;
                     break;
                 }
-            } else {
+                while (num_indices + end_index - start_index > capacity) {
+                    capacity = capacity ? capacity * 2 : LEAF_MAX_ENTRIES;
+                }
+                return_indices = realloc(return_indices, sizeof(int) * capacity);
+                *ret_indices = return_indices;
+            }
+            if (end_index > start_index) {
+                bplus_leaf_entries(leaf_node, start_index, end_index, NULL, &return_indices[num_indices]);
+                num_indices += end_index - start_index;
+            }
+            BPTreeNode* next = bplus_next_leaf(leaf_node);
+
+            if (!node_validate(leaf_node, version)) {
+                consistent = 0;
+                break;
+            }
+            if (leaf_node == max_leaf_node || next == NULL) {
                 break;
             }
+
+            leaf_node = next;
+            version = node_read_lock(leaf_node);
+            start_index = 0;
+        }
+
+        if (consistent) {
+            break;
         }
     }
+    *num_results = num_indices;
+}
 
-    LeafIndexRes* res = malloc(sizeof(LeafIndexRes));
-    res->leaf_node = node;
-    res->index = index;
 
-    return res;
-}
+/**
+ * One range of a batch swept together, [low, high),
+ * and the index of the query it came from.
+ **/
+typedef struct SweepRange {
+    long low;
+    long high;
+    int query;
+} SweepRange;
 
 
-void find_pos_range(BPTreeNode* root, int* num_results, int** ret_indices, int* min_val, int* max_val) {
-    int num_indices = 0;
-    int* return_indices = *ret_indices;
+/**
+ * Orders sweep ranges by low.
+ **/
+static int compare_sweep_ranges(const void* a, const void* b) {
+    long low_a = ((SweepRange*) a)->low;
+    long low_b = ((SweepRange*) b)->low;
+    return (low_a > low_b) - (low_a < low_b);
+}
+
 
-    // find leaf node
-    if (min_val != NULL && max_val != NULL) {
-        BPTreeNode* leaf_node = find_leaf_node(root, *min_val);
+/**
+ * Finds row ids for a batch of ranges, [lows[i], highs[i]), in one
+ * left to right sweep of the leaves. Ranges are taken in order of low
+ * and each leaf entry is added to every range active at its val. The
+ * tree is only descended when no range is active and the next starts
+ * past the current leaf, so overlapping and nearby ranges share one
+ * pass. Sets ret_indices[i] and num_results[i] to range i's row ids
+ * and their count. If a leaf changes mid sweep the sweep starts over.
+ * Each ret_indices[i] holds capacity row ids, grown as find_pos_range
+ * does once its leaf is validated.
+ **/
+void find_pos_ranges(BPTreeNode* root, long* lows, long* highs, size_t num_ranges, int** ret_indices, int* num_results, int capacity) {
+    SweepRange* ranges = malloc(sizeof(SweepRange) * num_ranges);
+    for (size_t i = 0; i < num_ranges; i++) {
+        ranges[i].low = lows[i];
+        ranges[i].high = highs[i];
+        ranges[i].query = i;
+    }
+    qsort(ranges, num_ranges, sizeof(SweepRange), compare_sweep_ranges);
+
+    // ranges, by index into sorted ranges, that val is in
+    size_t* active = malloc(sizeof(size_t) * num_ranges);
+    memset(num_results, 0, sizeof(int) * num_ranges);
+    int* capacities = malloc(sizeof(int) * num_ranges);
+    for (size_t i = 0; i < num_ranges; i++) {
+        capacities[i] = capacity;
+    }
 
-        LeafIndexRes* min_leaf_res = find_leaf_val_index(leaf_node, *min_val);
-        leaf_node = min_leaf_res->leaf_node;
+    int consistent = root == NULL;
+    while (!consistent) {
+        memset(num_results, 0, sizeof(int) * num_ranges);
+        consistent = 1;
+
+        size_t next_range = 0;
+        size_t num_active = 0;
+        BPTreeNode* leaf = NULL;
+        uint64_t version = 0;
+        int index = 0;
+        for (;;) {
+            // descend to first leaf of next range that can match
+            if (leaf == NULL) {
+                while (next_range < num_ranges && (ranges[next_range].low >= ranges[next_range].high || ranges[next_range].low > INT_MAX)) {
+                    next_range++;
+                }
+                if (next_range == num_ranges) {
+                    break;
+                }
 
-        if (max_val == NULL) {
-            int start_index = min_leaf_res->index;
-            while (leaf_node != NULL) {
-                for (int index = start_index; index < leaf_node->num_vals; index++) {
-                    return_indices[num_indices++] = leaf_node->type.leaf_node.positions[index];
+                int low = (int) ranges[next_range].low;
+                leaf = find_leaf_optimistic(root, low, &version);
+                index = find_leaf_val_index(&leaf, &version, low);
+                if (index < 0) {
+                    consistent = 0;
+                    break;
                 }
-                start_index = 0;
-                leaf_node = leaf_node->type.leaf_node.next;
             }
-        } else {
 
-            // find max_leaf_node 
-            BPTreeNode* max_leaf_node = find_leaf_node(root, *max_val);
-            LeafIndexRes* max_leaf_res = find_leaf_val_index(max_leaf_node, *max_val);
-            max_leaf_node = max_leaf_res->leaf_node;
-
-            int start_index = min_leaf_res->index;
-            int end_index;
-            do {
-                if (leaf_node == max_leaf_node) {
-                    end_index = max_leaf_res->index;
-                } else {
-                    end_index = leaf_node->num_vals;
+            int descend = 0;
+            int torn = 0;
+            int num_vals = leaf->num_vals;
+            for (; index < num_vals && !torn; index++) {
+                int val = leaf_val(leaf, index);
+
+                // start ranges reaching val, drop ranges val is past
+                while (next_range < num_ranges && ranges[next_range].low <= val) {
+                    active[num_active++] = next_range++;
+                }
+                size_t num_kept = 0;
+                for (size_t a = 0; a < num_active; a++) {
+                    if (ranges[active[a]].high > val) {
+                        active[num_kept++] = active[a];
+                    }
+                }
+                num_active = num_kept;
+
+                // between ranges, skip to next in leaf or descend to it
+                if (!num_active) {
+                    if (next_range == num_ranges || ranges[next_range].low > leaf_val(leaf, num_vals - 1)) {
+                        descend = 1;
+                        break;
+                    }
+                    index = bplus_node_search(leaf, (int) ranges[next_range].low) - 1;
+                    continue;
                 }
 
-                for (int index = start_index; index < end_index; index++) {
-                    return_indices[num_indices++] = leaf_node->type.leaf_node.positions[index];
+                int row_id = leaf_row_id(leaf, index);
+                for (size_t a = 0; a < num_active; a++) {
+                    int query = ranges[active[a]].query;
+                    if (num_results[query] == capacities[query]) {
+                        // full buffer, only grow it for a valid leaf
+                        if (!node_validate(leaf, version)) {
+                            torn = 1;
+                            break;
+                        }
+                        capacities[query] = capacities[query] ? capacities[query] * 2 : LEAF_MAX_ENTRIES;
+                        ret_indices[query] = realloc(ret_indices[query], sizeof(int) * capacities[query]);
+                    }
+                    ret_indices[query][num_results[query]++] = row_id;
                 }
-                start_index = 0;
-                leaf_node = leaf_node->type.leaf_node.next;
-            } while (leaf_node != NULL && leaf_node->type.leaf_node.prev != max_leaf_node);
+            }
+
+            BPTreeNode* next = bplus_next_leaf(leaf);
+            if (!node_validate(leaf, version)) {
+                consistent = 0;
+                break;
+            }
+
+            if (descend && next_range < num_ranges) {
+                leaf = NULL;
+                continue;
+            }
+            if (descend || next == NULL) {
+                break;
+            }
+            leaf = next;
+            version = node_read_lock(leaf);
+            index = 0;
         }
     }
-    *num_results = num_indices;
+
+    free(capacities);
+    free(active);
+    free(ranges);
 }
 
 
 /**
- * Given a val and tree, returns pos for given val.
+ * Reads up to limit entries in key order into vals and row_ids,
+ * largest first if descending, for sorts and top-k. Each leaf is
+ * copied only up to limit and validated before the walk moves on,
+ * restarting from the first leaf if one changed. Returns number
+ * of entries read.
  **/
-int find_pos(BPTreeNode* root, int val, int min) {
-    // find leaf node
-    BPTreeNode* leaf_node = find_leaf_node(root, val);
+size_t bplus_read_sorted(BPTreeNode* root, int descending, size_t limit, int* vals, int* row_ids) {
+    size_t num_read = 0;
+    int consistent = root == NULL;
+    while (!consistent) {
+        consistent = 1;
+        num_read = 0;
+
+        uint64_t version;
+        BPTreeNode* leaf = find_edge_leaf_optimistic(root, descending, &version);
+        while (num_read < limit) {
+            int num_vals = leaf->num_vals;
+            int count = (size_t) num_vals < limit - num_read ? num_vals : (int) (limit - num_read);
+
+            // walk leaves backwards from last leaf for top-k
+            if (descending) {
+                for (int i = 0; i < count; i++) {
+                    vals[num_read + i] = leaf_val(leaf, num_vals - 1 - i);
+                    row_ids[num_read + i] = leaf_row_id(leaf, num_vals - 1 - i);
+                }
+            // else walk forwards from first leaf
+            } else if (count > 0) {
+                bplus_leaf_entries(leaf, 0, count, &vals[num_read], &row_ids[num_read]);
+            }
+            BPTreeNode* next = descending ? bplus_prev_leaf(leaf) : bplus_next_leaf(leaf);
 
-    if (leaf_node == NULL) {
-        return 0;
-    }
+            if (!node_validate(leaf, version)) {
+                consistent = 0;
+                break;
+            }
+            num_read += count;
+            if (next == NULL) {
+                break;
+            }
 
-    // get index of val
-    LeafIndexRes* res = find_leaf_val_index(leaf_node, val);
+            // a previous leaf that split since links elsewhere, restart
+            version = node_read_lock(next);
+            if (descending && bplus_next_leaf(next) != leaf) {
+                consistent = 0;
+                break;
+            }
+            leaf = next;
+        }
+    }
+    return num_read;
+}
 
-    leaf_node = res->leaf_node;
-    int index = res->index;
 
-    int adjust = 0;
-    // if getting max and node val is greater than val, go to previous index and add one
-    if (leaf_node->type.leaf_node.vals[index] > val && !min) {
-        adjust = 1;
-        index -= 1;
+/**
+ * Given a val and tree, returns pos for given val,
+ * mapping leaf's row id through position_map.
+ **/
+int find_pos(BPTreeNode* root, int val, int min, PositionMap* position_map) {
+    if (root == NULL) {
+        return 0;
     }
 
-    if (index < leaf_node->num_vals) {
-        // get pos from index
-        return leaf_node->type.leaf_node.positions[index] + adjust;
-    } else {
-        if (leaf_node->type.leaf_node.next) {
-            return leaf_node->type.leaf_node.next->type.leaf_node.positions[0] + adjust;
+    for (;;) {
+        // find leaf node and index of val
+        uint64_t version;
+        BPTreeNode* leaf_node = find_leaf_optimistic(root, val, &version);
+        int index = find_leaf_val_index(&leaf_node, &version, val);
+        if (index < 0) {
+            continue;
+        }
+
+        int adjust = 0;
+        // if getting max and node val is greater than val, go to previous index and add one
+        if (leaf_val(leaf_node, index) > val && !min) {
+            adjust = 1;
+            index -= 1;
+        }
+
+        // get row id from index
+        int row_id;
+        if (index < leaf_node->num_vals) {
+            row_id = leaf_row_id(leaf_node, index);
+        } else if (leaf_node->type.leaf_node.next) {
+            BPTreeNode* next = bplus_next_leaf(leaf_node);
+            uint64_t next_version = node_read_lock(next);
+            row_id = leaf_row_id(next, 0);
+            if (!node_validate(next, next_version)) {
+                continue;
+            }
         } else {
-            return leaf_node->type.leaf_node.positions[index - 1] + adjust;
+            row_id = leaf_row_id(leaf_node, index - 1);
+        }
+
+        if (node_validate(leaf_node, version)) {
+            return position_of(position_map, row_id) + adjust;
         }
     }
 }
@@ -323,27 +1354,46 @@ BPTreeNode* find_leaf_node(BPTreeNode* root, int val) {
         return NULL;
     }
 
-    // iterate through tree till at leaf
-    BPTreeNode* curr = root;
-    while (curr != NULL && !curr->is_leaf) {
-        // binary search for val
-        int index = binary_search(curr->type.internal_node.vals, curr->num_vals, val);
+    uint64_t version;
+    return find_leaf_optimistic(root, val, &version);
+}
+
 
-        // get next node from pointer
-        curr = curr->type.internal_node.pointers[index];
+/**
+ * Given a root node, returns leftmost leaf node.
+ **/
+BPTreeNode* find_first_leaf(BPTreeNode* root) {
+    BPTreeNode* curr = root != NULL ? bplus_root(root) : NULL;
+    while (curr != NULL && !curr->is_leaf) {
+        curr = bplus_child(curr, 0);
     }
+    return curr;
+}
+
 
-    // return leaf node
+/**
+ * Given a root node, returns rightmost leaf node.
+ **/
+BPTreeNode* find_last_leaf(BPTreeNode* root) {
+    BPTreeNode* curr = root != NULL ? bplus_root(root) : NULL;
+    while (curr != NULL && !curr->is_leaf) {
+        curr = bplus_child(curr, curr->num_vals);
+    }
     return curr;
 }
 
 
 /**
- * Creates a new empty BPlusNode.
+ * Creates a new empty BPlusNode in the same slab as
+ * neighbor, a node of the same tree, so a tree's nodes
+ * stay packed together. Starts a new slab for a new
+ * tree if neighbor is NULL.
  **/
-BPTreeNode* create_node() {
-    // allocate space for new node
-    BPTreeNode* new_node = calloc(1, sizeof(BPTreeNode));
+BPTreeNode* create_node(BPTreeNode* neighbor) {
+    Slab* slab = neighbor != NULL ? slab_of(neighbor) : create_slab(sizeof(BPTreeNode), BPLUS_HUGE_PAGES);
+
+    // allocate space for new node, already zeroed
+    BPTreeNode* new_node = slab_alloc(slab);
 
     // allocate space for pointers and vals
     // new_node->pointers = calloc(FANOUT, sizeof(BPTreeNode*));
@@ -363,131 +1413,284 @@ BPTreeNode* create_node() {
 /**
  * Creates a new leaf BPlusNode.
  **/
-BPTreeNode* create_leaf_node() {
-    BPTreeNode* leaf = create_node();
+BPTreeNode* create_leaf_node(BPTreeNode* neighbor) {
+    BPTreeNode* leaf = create_node(neighbor);
     leaf->is_leaf = 1;
+#if BPLUS_COMPRESSED_LEAVES
+    leaf->type.leaf_node.key_width = 1;
+    leaf->type.leaf_node.row_id_width = 1;
+#endif
     return leaf;
 }
 
 
 /**
- * Initializes new root with val and pos.
+ * Returns number of entries to pack into a node
+ * holding at most max_entries for given fill factor.
  **/
-BPTreeNode* init_tree(int val, int pos) {
-    // create leaf node as root
-    BPTreeNode* root = create_leaf_node();
-    
-    // insert val and pos ptr
-    root->type.leaf_node.vals[0] = val;
-    root->type.leaf_node.positions[0] = pos;
-    root->num_vals = 1;
-
-    return root;
+static size_t bulk_node_entries(size_t max_entries, double fill_factor) {
+    size_t entries = (size_t) (max_entries * fill_factor);
+    if (entries < 2) {
+        entries = 2;
+    }
+    return entries > max_entries ? max_entries : entries;
 }
 
 
-void update_leaf_positions(BPTreeNode* leaf_node, int pos, int subtract) {
-    if (subtract) {
-        for (int i = 0; i < leaf_node->num_vals; i++) {
-            if (leaf_node->type.leaf_node.positions[i] >= pos) {
-                leaf_node->type.leaf_node.positions[i] -= 1;
-            }
-        }
-    } else {
-        for (int i = 0; i < leaf_node->num_vals; i++) {
-            if (leaf_node->type.leaf_node.positions[i] >= pos) {
-                leaf_node->type.leaf_node.positions[i] += 1;
-            }
+#if BPLUS_COMPRESSED_LEAVES
+/**
+ * Returns how many of the num_vals sorted vals and their row ids
+ * to pack into the next leaf: as many as keep it within fill_factor
+ * of what it holds at the widths they need. Closer keys and row ids
+ * pack denser, so leaves don't get even shares like other nodes.
+ **/
+static size_t bulk_leaf_entries(int* vals, int* row_ids, size_t num_vals, double fill_factor) {
+    int min_row_id = row_ids[0];
+    int max_row_id = row_ids[0];
+    size_t count = 1;
+    while (count < num_vals) {
+        int next_min = row_ids[count] < min_row_id ? row_ids[count] : min_row_id;
+        int next_max = row_ids[count] > max_row_id ? row_ids[count] : max_row_id;
+        int capacity = packed_capacity(offset_width((int64_t) vals[count] - vals[0]), offset_width((int64_t) next_max - next_min));
+        if (count + 1 > bulk_node_entries(capacity, fill_factor)) {
+            break;
         }
+        min_row_id = next_min;
+        max_row_id = next_max;
+        count++;
     }
+    return count;
 }
+#endif
+
 
+/**
+ * Builds a b+ tree over data bottom up instead of inserting row by
+ * row. (val, pos) pairs are sorted once, packed into linked leaves
+ * filled to fill_factor, then each internal level is built over the
+ * one below in a single pass, until one root remains. Nodes of a
+ * level get an even share of entries so none is left underfull,
+ * except compressed leaves, which are filled in turn.
+ * Rows get their ids from position_map, or their positions if NULL.
+ * Returns root, or NULL if there is no data.
+ **/
+BPTreeNode* bplus_bulk_load(int* data, size_t num_vals, double fill_factor, PositionMap* position_map) {
+    if (!num_vals) {
+        return NULL;
+    }
 
-void update_all_positions(BPTreeNode* leaf_node, int pos, int subtract) {
-    // update leaf node's positions
-    update_leaf_positions(leaf_node, pos, subtract);
+    // sort a copy of vals with their row ids, stable so
+    // equal vals keep position order like repeated inserts
+    int* vals = malloc(sizeof(int) * num_vals);
+    int* positions = malloc(sizeof(int) * num_vals);
+    memcpy(vals, data, sizeof(int) * num_vals);
+    if (position_map != NULL) {
+        position_map_row_ids(position_map, positions);
+    } else {
+        for (size_t i = 0; i < num_vals; i++) {
+            positions[i] = i;
+        }
+    }
+    radix_sort_pairs(vals, positions, num_vals);
+
+    // pack leaves, tracking smallest val under each node,
+    // compressed leaves hold at least as many as at widest
+#if BPLUS_COMPRESSED_LEAVES
+    size_t leaf_entries = bulk_node_entries(packed_capacity(4, 4), fill_factor);
+#else
+    size_t leaf_entries = bulk_node_entries(LEAF_MAX_ENTRIES, fill_factor);
+#endif
+    size_t num_nodes = (num_vals + leaf_entries - 1) / leaf_entries;
+    BPTreeNode** level = malloc(sizeof(BPTreeNode*) * num_nodes);
+    int* level_mins = malloc(sizeof(int) * num_nodes);
+
+    size_t start = 0;
+    size_t i;
+    BPTreeNode* prev = NULL;
+    for (i = 0; start < num_vals; i++) {
+#if BPLUS_COMPRESSED_LEAVES
+        size_t count = bulk_leaf_entries(&vals[start], &positions[start], num_vals - start, fill_factor);
+#else
+        size_t count = num_vals / num_nodes + (i < num_vals % num_nodes);
+#endif
+        BPTreeNode* leaf = create_leaf_node(prev);
+        leaf_store(leaf, &vals[start], &positions[start], count);
+
+        leaf->type.leaf_node.prev = node_id(prev);
+        if (prev != NULL) {
+            prev->type.leaf_node.next = node_id(leaf);
+        }
+        prev = leaf;
 
-    // update all leafs to the right
-    BPTreeNode* curr = leaf_node->type.leaf_node.next;
-    while (curr) {
-        update_leaf_positions(curr, pos, subtract);
-        curr = curr->type.leaf_node.next;
+        level[i] = leaf;
+        level_mins[i] = vals[start];
+        start += count;
     }
+    num_nodes = i;
+
+    free(vals);
+    free(positions);
+
+    // build internal levels in place over level below, each
+    // child's smallest val separates it from its left sibling
+    size_t fanout = bulk_node_entries(FANOUT, fill_factor);
+    while (num_nodes > 1) {
+        size_t num_parents = (num_nodes + fanout - 1) / fanout;
+        start = 0;
+        for (size_t p = 0; p < num_parents; p++) {
+            size_t count = num_nodes / num_parents + (p < num_nodes % num_parents);
+            BPTreeNode* parent = create_node(level[start]);
+            for (size_t c = 0; c < count; c++) {
+                parent->type.internal_node.children[c] = node_id(level[start + c]);
+                level[start + c]->parent = node_id(parent);
+                if (c) {
+                    parent->type.internal_node.vals[c - 1] = level_mins[start + c];
+                }
+            }
+            parent->num_vals = count - 1;
+            refresh_key_block(parent);
 
-    // update all leafs to the left
-    curr = leaf_node->type.leaf_node.prev;
-    while (curr) {
-        update_leaf_positions(curr, pos, subtract);
-        curr = curr->type.leaf_node.prev;
+            level[p] = parent;
+            level_mins[p] = level_mins[start];
+            start += count;
+        }
+        num_nodes = num_parents;
     }
+
+    BPTreeNode* root = level[0];
+    free(level);
+    free(level_mins);
+    return root;
 }
 
+
 /**
- * Remove position from bplus tree and 
- * updates all other positions.
+ * Initializes new root with val and pos.
  **/
-void bplus_remove(BPTreeNode* root, int val, int pos) {
-    // get leaf from val
-    BPTreeNode* leaf_node = find_leaf_node(root, val);
+BPTreeNode* init_tree(int val, int pos) {
+    // create leaf node as root
+    BPTreeNode* root = create_leaf_node(NULL);
+    
+    // insert val and pos ptr
+    leaf_store(root, &val, &pos, 1);
 
-    // get index of val
-    LeafIndexRes* res = find_leaf_val_index(leaf_node, val);
-    leaf_node = res->leaf_node;
-    int index = res->index;
+    return root;
+}
 
-    BPTreeNode* curr = leaf_node;
-    while (curr != NULL) {
-        // if at position, remove and shift over
-        if (curr->type.leaf_node.positions[index] == pos) {
-            for (int i = index; i < curr->num_vals - 1; i++) {
-                curr->type.leaf_node.positions[i] = curr->type.leaf_node.positions[i + 1];
-                curr->type.leaf_node.vals[i] = curr->type.leaf_node.vals[i + 1];    
+
+/**
+ * Remove row id from bplus tree. Other rows keep
+ * their ids, the table's position map tracks the shift.
+ * Locks one leaf at a time, moving right through val's run.
+ **/
+void bplus_remove(BPTreeNode* root, int val, int pos) {
+    // get leaf from val, locked
+    uint64_t version;
+    BPTreeNode* curr = find_leaf_optimistic(root, val, &version);
+    while (!node_upgrade_lock(curr, version)) {
+        curr = find_leaf_optimistic(root, val, &version);
+    }
+
+    int index = bplus_node_search(curr, val);
+    for (;;) {
+        // at end of leaf, run may continue in next
+        if (index >= curr->num_vals) {
+            BPTreeNode* next = bplus_next_leaf(curr);
+            if (next == NULL) {
+                break;
             }
-            curr->num_vals -= 1;
+            node_write_lock(next);
+            node_write_unlock(curr);
+            curr = next;
+            index = 0;
+            continue;
+        }
+
+        // past val's run, row id isn't in tree
+        if (leaf_val(curr, index) != val) {
             break;
         }
 
-        // add one to index, check if at end of leaf
-        index += 1;
-        if (index >= curr->num_vals) {
-            curr = curr->type.leaf_node.next;
-            index = 0;
+        // if at position, remove and shift over
+        if (leaf_row_id(curr, index) == pos) {
+            remove_from_leaf(curr, index);
+            break;
         }
+        index++;
     }
-
-    // now update all positions greater than position
-    update_all_positions(leaf_node, pos, 1);
+    node_write_unlock(curr);
 }
 
+
 /**
  * Inserts a given val and posue into 
- * a B+ Tree, given as root.
+ * a B+ Tree, given as root. Returns tree's root.
  **/
-BPTreeNode* bplus_insert(BPTreeNode* root, int val, int pos, int update_vals) {
-    // if root is null start new tree and return
+BPTreeNode* bplus_insert(BPTreeNode* root, int val, int pos) {
+    // if root is null start new tree and return,
+    // callers serialize creating a column's tree
     if (root == NULL) {
         return init_tree(val, pos);
     }
 
-    // find leaf node
-    BPTreeNode* leaf_node = find_leaf_node(root, val);
+    // if leaf has room lock just it and insert
+    uint64_t version;
+    BPTreeNode* leaf_node;
+    for (;;) {
+        leaf_node = find_leaf_optimistic(root, val, &version);
+        if (!leaf_has_room(leaf_node, val, pos)) {
+            break;
+        }
+        if (node_upgrade_lock(leaf_node, version)) {
+            insert_into_leaf(leaf_node, val, pos, find_insertion_index(leaf_node, val));
+            node_write_unlock(leaf_node);
+            return bplus_root(root);
+        }
+    }
+
+    // else need to split leaf, one split at a time per tree
+    pthread_mutex_t* smo_lock = &slab_of(root)->lock;
+    pthread_mutex_lock(smo_lock);
+
+    leaf_node = find_leaf_optimistic(root, val, &version);
+    while (!node_upgrade_lock(leaf_node, version)) {
+        leaf_node = find_leaf_optimistic(root, val, &version);
+    }
+
+    // leaf may have been split or had vals removed meanwhile
+    if (leaf_has_room(leaf_node, val, pos)) {
+        insert_into_leaf(leaf_node, val, pos, find_insertion_index(leaf_node, val));
+        node_write_unlock(leaf_node);
+        pthread_mutex_unlock(smo_lock);
+        return bplus_root(root);
+    }
 
-    // check if leaf_node has room or if val already in leaf
-    int insertion_index = find_insertion_index(leaf_node, val);
-    if (leaf_node->num_vals < (LEAF_SIZE - 1)) {
-        // if clustered and middle insert update all positions greater or equal to pos
-        if (update_vals) {
-            update_all_positions(leaf_node, pos, 0);
+    // lock every node the split changes: leaf, its next leaf,
+    // and each ancestor up to the first with room for a key
+    BPTreeNode* locked[BPLUS_MAX_HEIGHT + 2];
+    int num_locked = 0;
+    locked[num_locked++] = leaf_node;
+    BPTreeNode* next_leaf = bplus_next_leaf(leaf_node);
+    if (next_leaf != NULL) {
+        node_write_lock(next_leaf);
+        locked[num_locked++] = next_leaf;
+    }
+    for (BPTreeNode* node = node_parent(leaf_node); node != NULL; node = node_parent(node)) {
+        node_write_lock(node);
+        locked[num_locked++] = node;
+        if (node->num_vals < (FANOUT - 1)) {
+            break;
         }
+    }
 
-        // simply insert into leaf
-        insert_into_leaf(leaf_node, val, pos, insertion_index);
+    root = split_leaf_and_insert(bplus_root(root), leaf_node, val, pos);
 
-        return root;
-    // else need to split leaf then insert
-    } else {
-        return split_leaf_and_insert(root, leaf_node, val, pos);
+    for (int i = 0; i < num_locked; i++) {
+        node_write_unlock(locked[i]);
     }
+    pthread_mutex_unlock(smo_lock);
+
+    return root;
 }
 
 
@@ -496,19 +1699,21 @@ BPTreeNode* bplus_insert(BPTreeNode* root, int val, int pos, int update_vals) {
  * and inserts pointers and val.
  **/
 BPTreeNode* insert_into_new_root(BPTreeNode* left_node, BPTreeNode* right_node, int val) {
-    BPTreeNode* root = create_node();
+    BPTreeNode* root = create_node(left_node);
     
     // set val
     root->type.internal_node.vals[0] = val;
     root->num_vals = 1;
+    refresh_key_block(root);
 
     // set pointers
-    root->type.internal_node.pointers[0] = left_node;
-    root->type.internal_node.pointers[1] = right_node;
+    root->type.internal_node.children[0] = node_id(left_node);
+    root->type.internal_node.children[1] = node_id(right_node);
 
-    // set children parent
-    left_node->parent = root;
-    right_node->parent = root;
+    // set children parent, publishing new root to
+    // readers climbing from old one once it's complete
+    __atomic_store_n(&left_node->parent, node_id(root), __ATOMIC_RELEASE);
+    __atomic_store_n(&right_node->parent, node_id(root), __ATOMIC_RELEASE);
 
     return root;
 }
@@ -521,15 +1726,15 @@ int find_insertion_index(BPTreeNode* node, int val) {
     int index;
     if (node->is_leaf) {
         // simply binary search for val
-        index = binary_search(node->type.leaf_node.vals, node->num_vals, val);
+        index = bplus_node_search(node, val);
 
         // go to last index where val is located
-        while (index < node->num_vals && node->type.leaf_node.vals[index] == val) {
+        while (index < node->num_vals && leaf_val(node, index) == val) {
             index++;
         }
     } else {
         // simply binary search for val
-        index = binary_search(node->type.internal_node.vals, node->num_vals, val);
+        index = bplus_node_search(node, val);
 
         // go to last index where val is located
         while (index < node->num_vals && node->type.internal_node.vals[index] == val) {
@@ -546,10 +1751,36 @@ int find_insertion_index(BPTreeNode* node, int val) {
  * Given a leaf node, a val and a posue, this
  * inserts the new val-posue pair into the leaf node,
  * also executing any balancing that needs to be done.
+ * Compressed leaves shift their offsets over in place
+ * if the pair fits their widths, else are rewritten.
  **/
 void insert_into_leaf(BPTreeNode* leaf_node, int val, int pos, int insertion_index) {
+    int num_vals = leaf_node->num_vals;
+#if BPLUS_COMPRESSED_LEAVES
+    if (!leaf_offsets_fit(leaf_node, val, pos)) {
+        int vals[LEAF_MAX_ENTRIES + 1];
+        int row_ids[LEAF_MAX_ENTRIES + 1];
+        bplus_leaf_entries(leaf_node, 0, insertion_index, vals, row_ids);
+        bplus_leaf_entries(leaf_node, insertion_index, num_vals, &vals[insertion_index + 1], &row_ids[insertion_index + 1]);
+        vals[insertion_index] = val;
+        row_ids[insertion_index] = pos;
+        leaf_store(leaf_node, vals, row_ids, num_vals + 1);
+        return;
+    }
+
+    // shift over all past insertion_index, row ids are stored backwards
+    BPTreeLeafNode* leaf = &leaf_node->type.leaf_node;
+    int key_width = leaf->key_width;
+    int row_id_width = leaf->row_id_width;
+    memmove(&leaf->packed[(insertion_index + 1) * key_width], &leaf->packed[insertion_index * key_width], (num_vals - insertion_index) * key_width);
+    memmove(packed_row_ids(leaf, num_vals + 1), packed_row_ids(leaf, num_vals), (num_vals - insertion_index) * row_id_width);
+
+    // insert val and pos offsets
+    store_offset(leaf->packed, key_width, insertion_index, (uint32_t) val - (uint32_t) leaf->key_base);
+    store_offset(packed_row_ids(leaf, insertion_index + 1), row_id_width, 0, (uint32_t) pos - (uint32_t) leaf->row_id_base);
+#else
     // shift over all past insertion_index
-    for (int i = leaf_node->num_vals; i > insertion_index; i--) {
+    for (int i = num_vals; i > insertion_index; i--) {
         leaf_node->type.leaf_node.vals[i] = leaf_node->type.leaf_node.vals[i - 1];
         leaf_node->type.leaf_node.positions[i] = leaf_node->type.leaf_node.positions[i - 1];
     }
@@ -557,78 +1788,60 @@ void insert_into_leaf(BPTreeNode* leaf_node, int val, int pos, int insertion_ind
     // insert val and pos ptr
     leaf_node->type.leaf_node.vals[insertion_index] = val;
     leaf_node->type.leaf_node.positions[insertion_index] = pos;
+#endif
     leaf_node->num_vals++;
+    refresh_key_block(leaf_node);
 }
 
 /**
  * Given a full leaf_node and a val-posue pair, this
  * splits the leaf node into two, balances the two nodes,
  * and passes the new necessary vals to the parent.
+ * Each half of a full leaf fits a leaf at any widths.
  **/
 BPTreeNode* split_leaf_and_insert(BPTreeNode* root, BPTreeNode* leaf_node, int val, int pos) {
+    int num_vals = leaf_node->num_vals;
+
     // create temporary arrays to hold all vals and posues
-    int* all_vals = calloc(LEAF_SIZE, sizeof(int));
-    int* all_positions = calloc(LEAF_SIZE, sizeof(int));
+    int* all_vals = malloc(sizeof(int) * (num_vals + 1));
+    int* all_positions = malloc(sizeof(int) * (num_vals + 1));
 
     // find index to insert new val-pos
     int index = find_insertion_index(leaf_node, val);
 
-    // insert into all vals and pointers
+    // fill in leaf's vals and pointers around new val-pos
+    bplus_leaf_entries(leaf_node, 0, index, all_vals, all_positions);
+    bplus_leaf_entries(leaf_node, index, num_vals, &all_vals[index + 1], &all_positions[index + 1]);
     all_vals[index] = val;
     all_positions[index] = pos;
 
-    // fill in rest of vals and pointers
-    int all_idx, leaf_idx;
-    for (all_idx = 0, leaf_idx = 0; leaf_idx < LEAF_SIZE - 1; all_idx++, leaf_idx++) {
-        // if at index of new val-pos, add one
-        if (all_idx == index) {
-            all_idx++;
-        }
-
-        // insert leaf val-pos to all vals pointers
-        all_vals[all_idx] = leaf_node->type.leaf_node.vals[leaf_idx];
-        all_positions[all_idx] = leaf_node->type.leaf_node.positions[leaf_idx];
-    }
-
     // create new leaf
-    BPTreeNode* right_leaf = create_leaf_node();
+    BPTreeNode* right_leaf = create_leaf_node(leaf_node);
     BPTreeNode* left_leaf = leaf_node;
 
-    // clear left_leaf
-    left_leaf->num_vals = 0;
-
     // now split all vals/pointers between left/right leaves
     // get middle index to split at
-    int split_index = LEAF_SIZE / 2;
-
-    // set left leaf's vals/pointers
-    for (int i = 0; i < split_index; i++) {
-        left_leaf->type.leaf_node.vals[i] = all_vals[i];
-        left_leaf->type.leaf_node.positions[i] = all_positions[i];
-        left_leaf->num_vals++;    
-    }
-
-    // set right leaf's vals/pointers
-    for (all_idx = split_index, leaf_idx = 0; all_idx < LEAF_SIZE; all_idx++, leaf_idx++) {
-        right_leaf->type.leaf_node.vals[leaf_idx] = all_vals[all_idx];
-        right_leaf->type.leaf_node.positions[leaf_idx] = all_positions[all_idx];
-        right_leaf->num_vals++;    
-    }
+    int split_index = (num_vals + 1) / 2;
+    leaf_store(left_leaf, all_vals, all_positions, split_index);
+    leaf_store(right_leaf, &all_vals[split_index], &all_positions[split_index], num_vals + 1 - split_index);
 
     // set right leaf's parent
     right_leaf->parent = left_leaf->parent;
 
     right_leaf->type.leaf_node.next = left_leaf->type.leaf_node.next;
-    right_leaf->type.leaf_node.prev = left_leaf;
-    left_leaf->type.leaf_node.next = right_leaf;
+    right_leaf->type.leaf_node.prev = node_id(left_leaf);
+    if (right_leaf->type.leaf_node.next != 0) {
+        bplus_next_leaf(right_leaf)->type.leaf_node.prev = node_id(right_leaf);
+    }
+    left_leaf->type.leaf_node.next = node_id(right_leaf);
 
     // free all vals/pointers
     free(all_vals);
     free(all_positions);
 
     // now need to insert new val into parent
-    int new_val = right_leaf->type.leaf_node.vals[0];
-    return insert_into_parent(root, right_leaf->parent, left_leaf, right_leaf, new_val);
+    int new_val = leaf_val(right_leaf, 0);
+    return insert_into_parent(root, node_parent(right_leaf), left_leaf, right_leaf, new_val);
 }
 
 
@@ -645,32 +1858,48 @@ BPTreeNode* insert_into_parent(BPTreeNode* root, BPTreeNode* parent, BPTreeNode*
 
     // if parent has room just insert into node
     if (parent->num_vals < (FANOUT - 1)) {
-        insert_into_node(parent, right_node, val);
+        insert_into_node(parent, left_node, right_node, val);
         return root;
     // else need to split node and insert
     } else {
-        return split_node_and_insert(root, parent, right_node, val);
+        return split_node_and_insert(root, parent, left_node, right_node, val);
     }
 }
 
 
 /**
- * Given a node with more space, simply inserts
- * a new val and pointer (either left node or right node) into the node.
+ * Returns index of key in node just after child left_node, where a
+ * new sibling split off it goes. Found by child rather than by key,
+ * as equal keys may separate several children.
  **/
-BPTreeNode* insert_into_node(BPTreeNode* node, BPTreeNode* right_node, int val) {
-    int index = find_insertion_index(node, val);
+static int sibling_insertion_index(BPTreeNode* node, BPTreeNode* left_node) {
+    NodeId left = node_id(left_node);
+    int index = 0;
+    while (index < node->num_vals && node->type.internal_node.children[index] != left) {
+        index++;
+    }
+    return index;
+}
+
+
+/**
+ * Given a node with more space, simply inserts a new val
+ * and pointer to right node, split from left node, into the node.
+ **/
+BPTreeNode* insert_into_node(BPTreeNode* node, BPTreeNode* left_node, BPTreeNode* right_node, int val) {
+    int index = sibling_insertion_index(node, left_node);
 
     // shift over all past index
     for (int i = node->num_vals; i > index; i--) {
         node->type.internal_node.vals[i] = node->type.internal_node.vals[i - 1];
-        node->type.internal_node.pointers[i + 1] = node->type.internal_node.pointers[i];
+        node->type.internal_node.children[i + 1] = node->type.internal_node.children[i];
     }
 
     // insert val and right node
     node->type.internal_node.vals[index] = val;
-    node->type.internal_node.pointers[index + 1] = right_node;
+    node->type.internal_node.children[index + 1] = node_id(right_node);
     node->num_vals++;
+    refresh_key_block(node);
 
     return node;
 }
@@ -681,17 +1910,17 @@ BPTreeNode* insert_into_node(BPTreeNode* node, BPTreeNode* right_node, int val)
  * balances the two nodes, then passes the necessary
  * pointers and val to the parent for rebalancing.
  **/
-BPTreeNode* split_node_and_insert(BPTreeNode* root, BPTreeNode* node, BPTreeNode* right_node, int val) {
+BPTreeNode* split_node_and_insert(BPTreeNode* root, BPTreeNode* node, BPTreeNode* left_node, BPTreeNode* right_node, int val) {
     // create temporary arrays to hold all vals and posues
     int* all_vals = calloc(FANOUT, sizeof(int));
-    void** all_pointers = calloc(FANOUT + 1, sizeof(void*));
+    NodeId* all_pointers = calloc(FANOUT + 1, sizeof(NodeId));
 
     // find index to insert new val-pos
-    int index = find_insertion_index(node, val);
+    int index = sibling_insertion_index(node, left_node);
 
     // insert into all vals and pointers
     all_vals[index] = val;
-    all_pointers[index + 1] = right_node;
+    all_pointers[index + 1] = node_id(right_node);
 
     // fill in rest of vals and pointers
     int node_idx;
@@ -710,11 +1939,11 @@ BPTreeNode* split_node_and_insert(BPTreeNode* root, BPTreeNode* node, BPTreeNode
             all_ptr_idx++;
         }
 
-        all_pointers[all_ptr_idx] = node->type.internal_node.pointers[node_idx];
+        all_pointers[all_ptr_idx] = node->type.internal_node.children[node_idx];
     }
 
     // create new node
-    BPTreeNode* parent_right_node = create_node();
+    BPTreeNode* parent_right_node = create_node(node);
     BPTreeNode* parent_left_node = node;
 
     // clear parent left node
@@ -730,28 +1959,31 @@ BPTreeNode* split_node_and_insert(BPTreeNode* root, BPTreeNode* node, BPTreeNode
     // set left node's vals/pointers
     for (node_idx = 0; node_idx < split_index; node_idx++) {
         parent_left_node->type.internal_node.vals[node_idx] = all_vals[node_idx];
-        parent_left_node->type.internal_node.pointers[node_idx] = all_pointers[node_idx];
+        parent_left_node->type.internal_node.children[node_idx] = all_pointers[node_idx];
         parent_left_node->num_vals++;    
     }
     // set last pointer
-    parent_left_node->type.internal_node.pointers[node_idx] = all_pointers[node_idx];
+    parent_left_node->type.internal_node.children[node_idx] = all_pointers[node_idx];
 
     // set right node's vals/pointers
     int all_idx;
     BPTreeNode* temp = NULL;
     for (all_idx = split_index + 1, node_idx = 0; all_idx < FANOUT; all_idx++, node_idx++) {
         parent_right_node->type.internal_node.vals[node_idx] = all_vals[all_idx];
-        parent_right_node->type.internal_node.pointers[node_idx] = all_pointers[all_idx];
+        parent_right_node->type.internal_node.children[node_idx] = all_pointers[all_idx];
         parent_right_node->num_vals++;
 
         // set new parent
-        temp = (BPTreeNode*) parent_right_node->type.internal_node.pointers[node_idx];
-        temp->parent = parent_right_node;
+        temp = bplus_child(parent_right_node, node_idx);
+        temp->parent = node_id(parent_right_node);
     }
     // need to copy last pointer
-    parent_right_node->type.internal_node.pointers[node_idx] = all_pointers[all_idx];
-    temp = (BPTreeNode*) parent_right_node->type.internal_node.pointers[node_idx];
-    temp->parent = parent_right_node;
+    parent_right_node->type.internal_node.children[node_idx] = all_pointers[all_idx];
+    temp = bplus_child(parent_right_node, node_idx);
+    temp->parent = node_id(parent_right_node);
+
+    refresh_key_block(parent_left_node);
+    refresh_key_block(parent_right_node);
 
     // set right node's parent
     parent_right_node->parent = parent_left_node->parent;
@@ -764,14 +1996,14 @@ BPTreeNode* split_node_and_insert(BPTreeNode* root, BPTreeNode* node, BPTreeNode
     free(all_vals);
     free(all_pointers);
 
-    return insert_into_parent(root, parent_right_node->parent, parent_left_node, parent_right_node, new_val);
+    return insert_into_parent(root, node_parent(parent_right_node), parent_left_node, parent_right_node, new_val);
 }
 
 
 void print_leaf(BPTreeNode* curr) {
     if (curr != NULL) {
         for (int i = 0; i < curr->num_vals; i++) {
-            printf("%d: %d\n", curr->type.leaf_node.vals[i], curr->type.leaf_node.positions[i]);
+            printf("%d: %d\n", leaf_val(curr, i), leaf_row_id(curr, i));
         }
     }
 }
@@ -789,12 +2021,12 @@ void print_tree(BPTreeNode* root) {
         if (!curr->num_vals) 
             return;
 
-        curr = (BPTreeNode*) curr->type.internal_node.pointers[0];
+        curr = bplus_child(curr, 0);
     }
 
     while (curr != NULL) {
         for (int i = 0; i < 10; i++) {
-            printf("%d: %d\n", curr->type.leaf_node.vals[i], curr->type.leaf_node.positions[i]);
+            printf("%d: %d\n", leaf_val(curr, i), leaf_row_id(curr, i));
         }
         curr = NULL;
         // curr = curr->type.leaf_node.next;
@@ -9,6 +9,10 @@
 #include "cs165_api.h"
 #include "utils.h"
 #include "index.h"
+#include "summary.h"
+#include "synopsis.h"
+#include "bloom.h"
+#include "position_map.h"
 
 // In this class, there will always be only one active database at a time
 Db* current_db;
@@ -108,6 +112,7 @@ Table* create_table(const char* name, const char* db_name, unsigned int col_capa
     new_table->table_length = 0;
     new_table->col_capacity = col_capacity;
     new_table->table_length_capacity = INITIAL_TABLE_LENGTH_CAPACITY;
+    new_table->position_map = NULL;
 
     // allocate space for columns
     new_table->columns = calloc(col_capacity, sizeof(Column));
@@ -162,6 +167,12 @@ Column* create_column(const char* name, const char* table_name, Status* status)
     // allocate memory for data 
     new_column->data = malloc(sizeof(int) * INITIAL_TABLE_LENGTH_CAPACITY);
 
+    // init empty synopsis
+    new_column->synopsis = build_synopsis(NULL, 0);
+
+    // share table's row id map
+    new_column->position_map = table->position_map;
+
     // increase table col_count
     table->col_count++;
 
@@ -215,6 +226,11 @@ void create_idx(const char* col_name, IndexType index_type, Status* status) {
         index->positions = malloc(sizeof(int) * table->table_length_capacity);
         
         column->index = (void*) index;
+    } else if (index_type == BTREE_CLUSTERED || index_type == BTREE_UNCLUSTERED) {
+        // index any data already in column
+        column->index = bplus_bulk_load(column->data, column->col_size, BPLUS_FILL_FACTOR, column->position_map);
+    } else if (index_type == ART) {
+        column->index = art_bulk_load(column->data, column->col_size, column->position_map);
     } else {
         column->index = NULL;
     }
@@ -240,6 +256,26 @@ void create_idx(const char* col_name, IndexType index_type, Status* status) {
 }
 
 
+/**
+ * Creates an aggregate summary on given column.
+ **/
+void create_summary(const char* col_name, Status* status) {
+    // get column
+    CHandle* column_handle = (CHandle*) lookup_object(db_catalog, col_name, COLUMN);
+
+    // err if doesn't exist
+    if (column_handle == NULL) {
+        status->code = OBJECT_DOES_NOT_EXIST;
+        return;
+    }
+    Column* column = column_handle->pointer.column;
+
+    // build from any existing data
+    free_summary(column->summary);
+    column->summary = build_summary(column->data, column->col_size);
+}
+
+
 typedef struct temp {
     int val;
     int pos;
@@ -328,7 +364,7 @@ void handle_db_load(int client_socket, char* tbl_name, int num_cols) {
         // qsort_arrays(data, 0, num_rows - 1, *primary_index_col, num_cols);
         int* positions = malloc(sizeof(int) * num_rows);
         for (int i = 0; i < num_rows; i++) {
-            data[*primary_index_col][temps[i].pos] = temps[i].val;
+            data[*primary_index_col][i] = temps[i].val;
             positions[i] = temps[i].pos;
         }
 
@@ -346,6 +382,13 @@ void handle_db_load(int client_socket, char* tbl_name, int num_cols) {
         free(temps);
     }
 
+    // loaded rows replace table's, so row ids are positions again
+    free_position_map(table->position_map);
+    table->position_map = NULL;
+    for (int i = 0; i < num_cols; i++) {
+        columns[i].position_map = NULL;
+    }
+
     // set columns data
     for (int i = 0; i < num_cols; i++) {
         if (primary_index_col == NULL) {
@@ -356,9 +399,14 @@ void handle_db_load(int client_socket, char* tbl_name, int num_cols) {
 
         // check index
         if (columns[i].index_type == BTREE_CLUSTERED || columns[i].index_type == BTREE_UNCLUSTERED) {
-            for (int j = 0; j < num_rows; j++) {
-                index_value(&columns[i], columns[i].data[j], j, 1);
+            // build tree bottom up over loaded data
+            if (columns[i].index != NULL) {
+                free_node((BPTreeNode*) columns[i].index);
             }
+            columns[i].index = bplus_bulk_load(columns[i].data, num_rows, BPLUS_FILL_FACTOR, NULL);
+        } else if (columns[i].index_type == ART) {
+            free_art((ArtTree*) columns[i].index);
+            columns[i].index = art_bulk_load(columns[i].data, num_rows, NULL);
         } else if (columns[i].index_type == SORTED_UNCLUSTERED) {
             temp* temps = malloc(sizeof(temp) * num_rows);
 
@@ -378,6 +426,15 @@ void handle_db_load(int client_socket, char* tbl_name, int num_cols) {
 
             free(temps);
         }
+
+        // rebuild summary over loaded data
+        if (columns[i].summary != NULL) {
+            summary_refresh(columns[i].summary, columns[i].data, columns[i].col_size, 0);
+        }
+
+        // rebuild synopsis over loaded data
+        free_synopsis(columns[i].synopsis);
+        columns[i].synopsis = build_synopsis(columns[i].data, columns[i].col_size);
         free(data[i]);
     }
 
@@ -422,6 +479,7 @@ Status load_server_data() {
         // read table
         Table* table = &current_db->tables[num_table];
         fread(table, sizeof(Table), 1, fd);
+        table->position_map = load_position_map(fd);
 
         // add table to db_catalog
         char table_lookup_name[strlen(current_db->name) + strlen(table->name) + 2];
@@ -439,6 +497,7 @@ Status load_server_data() {
             // read column
             Column* col = &table->columns[num_col];
             fread(col, sizeof(Column), 1, fd);
+            col->position_map = table->position_map;
 
             // read columns' data
             col->data = calloc(table->table_length_capacity, sizeof(int));
@@ -455,8 +514,24 @@ Status load_server_data() {
                 col->index = (void*) index;
             // else if btree need to read all nodes
             } else if (col->index_type == BTREE_CLUSTERED || col->index_type == BTREE_UNCLUSTERED) {
-                col->index = load_bptree(fd, col->data);
+                col->index = load_bptree(fd);
+
+                // image from a build with another node layout or that
+                // couldn't be mapped, rebuild from column's data
+                if (col->index == NULL && col->col_size > 0) {
+                    log_info("Rebuilding b+ tree index on %s, stored image unusable.\n", col->name);
+                    col->index = bplus_bulk_load(col->data, col->col_size, BPLUS_FILL_FACTOR, col->position_map);
+                }
+            // else if ART rebuild from its keys
+            } else if (col->index_type == ART) {
+                col->index = load_art(fd);
+            }
+
+            // summary and synopsis aren't stored, just rebuild from data
+            if (col->summary != NULL) {
+                col->summary = build_summary(col->data, col->col_size);
             }
+            col->synopsis = build_synopsis(col->data, col->col_size);
 
             // get column lookup name
             char col_lookup_name[strlen(table_lookup_name) + strlen(col->name) + 2];
@@ -489,10 +564,12 @@ Status load_server_data() {
  * its content to file and free memory:
  *     - all tables
  *     - all columns and their data and indexes
+ * Written to a new file that then replaces the old one,
+ * as loaded b+ trees are still mapped from the old one.
  **/
 void dump_server_data(Db* db, Status* status) {
     // open file for writing
-    FILE* fd = fopen("dbdump.bin", "wb");
+    FILE* fd = fopen("dbdump.bin.tmp", "wb");
 
     // dump db metadata
     fwrite(db, sizeof(Db), 1, fd);
@@ -501,8 +578,9 @@ void dump_server_data(Db* db, Status* status) {
     for (size_t num_table = 0; num_table < db->tables_size; num_table++) {
         Table* table = &db->tables[num_table];
         
-        // dump table metadata
+        // dump table metadata and row id map
         fwrite(table, sizeof(Table), 1, fd);
+        dump_position_map(fd, table->position_map);
 
         // dump table's columns
         for (size_t num_col = 0; num_col < table->col_count; num_col++) {
@@ -530,24 +608,35 @@ void dump_server_data(Db* db, Status* status) {
             } else if (col->index_type == BTREE_CLUSTERED || col->index_type == BTREE_UNCLUSTERED) {
                 // dump bplus tree node by node
                 BPTreeNode* root = (BPTreeNode*) col->index;
-                dump_bptree(fd, root, col->data);
+                dump_bptree(fd, root);
+
+            // else if ART dump keys and row ids
+            } else if (col->index_type == ART) {
+                dump_art(fd, (ArtTree*) col->index);
+                free_art((ArtTree*) col->index);
             }
 
+            // free col's summary and synopsis
+            free_summary(col->summary);
+            free_synopsis(col->synopsis);
+
             // free col's data
             free(col->data);
         }
 
-        // free table's columns
+        // free table's columns and row id map
         free(table->columns);
+        free_position_map(table->position_map);
     }    
 
     // free db's memory
     free(db->tables);
     free(db);
 
-    // flush and close file
+    // flush and close file, then swap it in
     fflush(fd);
     fclose(fd);
+    rename("dbdump.bin.tmp", "dbdump.bin");
 
     (void) status;
 }
@@ -588,7 +677,11 @@ void shutdown_lookup_table(LookupTable* lookup_table) {
 
                     if (to_free->type == RESULT) {
                         Result* result = chandle->pointer.result;
-                        free(result->payload);
+                        if (result->data_type == BLOOM) {
+                            free_bloom((BloomFilter*) result->payload);
+                        } else {
+                            free(result->payload);
+                        }
                         free(result);
                     }
 
@@ -5,6 +5,13 @@
 #include <string.h>
 #include "db_operator.h"
 #include "index.h"
+#include "position_map.h"
+#include "summary.h"
+#include "sort.h"
+#include "synopsis.h"
+#include "join.h"
+#include "bloom.h"
+#include <math.h>
 #include <limits.h>
 #include <time.h>
 #include <sys/types.h>
@@ -18,6 +25,9 @@ DbOperator** batched_queries = NULL;
 int*** all_results = NULL;
 int** all_results_counts = NULL;
 
+// last join's chosen algorithm, sent to client if join was explained
+static char join_explain[128];
+
 /**
  * Frees all memory allocated for DbOperator
  **/
@@ -36,6 +46,34 @@ void db_operator_free(DbOperator* query) {
 }
 
 
+/**
+ * Returns column of an aggregate's vals handle if positions are a
+ * run of consecutive positions in it and it has a summary, so its
+ * block partials can answer the aggregate. Sets start and end to
+ * the run's [start, end), else returns NULL.
+ **/
+static Column* summary_position_run(CHandle* vals_handle, int* positions, int num_positions, size_t* start, size_t* end) {
+    if (vals_handle == NULL || vals_handle->type != COLUMN || vals_handle->pointer.column->summary == NULL
+            || num_positions <= 0 || positions[0] < 0) {
+        return NULL;
+    }
+
+    Column* column = vals_handle->pointer.column;
+    if ((size_t) positions[0] + num_positions > column->col_size) {
+        return NULL;
+    }
+    for (int i = 1; i < num_positions; i++) {
+        if (positions[i] != positions[0] + i) {
+            return NULL;
+        }
+    }
+
+    *start = positions[0];
+    *end = positions[0] + num_positions;
+    return column;
+}
+
+
 /**
  * Executes min and max operators given
  * a DbOperator* query.
@@ -61,7 +99,11 @@ void execute_min_max_operator(DbOperator* query, Status* status) {
         data = (int*) operator.chandle_1->pointer.result->payload;
     }
 
-    // check for indices array
+    // check for indices array, a run of positions in a
+    // column with a summary is answered from its partials
+    Column* run_column = NULL;
+    size_t run_start = 0;
+    size_t run_end = 0;
     if (operator.chandle_2 != NULL) {
         if (query->num_handles != 2) {
             status->code = INCORRECT_FORMAT;
@@ -69,8 +111,9 @@ void execute_min_max_operator(DbOperator* query, Status* status) {
         }
 
         indices = data;
+        run_column = summary_position_run(operator.chandle_2, indices, num_rows, &run_start, &run_end);
         if (operator.chandle_2->type == COLUMN) {
-            if (num_rows != (int) operator.chandle_2->pointer.column->col_size) {
+            if (run_column == NULL && num_rows != (int) operator.chandle_2->pointer.column->col_size) {
                 status->code = QUERY_UNSUPPORTED;
                 return;
             }
@@ -93,7 +136,24 @@ void execute_min_max_operator(DbOperator* query, Status* status) {
     // if vector of indices pass store in result
     Result* result_indices = NULL;
 
-    if (num_rows) {
+    // full column with summary can be answered without scanning
+    if (num_rows && indices == NULL && operator.chandle_1->type == COLUMN && operator.chandle_1->pointer.column->summary != NULL) {
+        ColumnSummary* summary = operator.chandle_1->pointer.column->summary;
+        *payload = operator.type == MIN ? summary->min : summary->max;
+    } else if (run_column != NULL) {
+        long sum;
+        int min;
+        int max;
+        summary_range(run_column->summary, data, run_start, run_end, &sum, &min, &max);
+        *payload = operator.type == MIN ? min : max;
+
+        // positions of min or max, only in blocks that can hold it
+        int* index_payload = malloc(sizeof(int) * num_rows);
+        result_indices = malloc(sizeof(Result));
+        result_indices->data_type = INT;
+        result_indices->num_tuples = summary_range_positions(run_column->summary, data, run_start, run_end, *payload, index_payload);
+        result_indices->payload = realloc(index_payload, sizeof(int) * result_indices->num_tuples);
+    } else if (num_rows) {
         if (operator.type == MIN) {
             int min = data[0];
 
@@ -165,7 +225,7 @@ void execute_min_max_operator(DbOperator* query, Status* status) {
                     // else if less than max
                     // set num_max_indices = 1
                     // and set return indices[0] to curr index
-                    } else if (data[indices[i]] < max) {
+                    } else if (data[indices[i]] > max) {
                         num_max_indices = 1;
                         index_payload[0] = indices[i];
                         max = data[indices[i]];
@@ -202,7 +262,8 @@ void execute_min_max_operator(DbOperator* query, Status* status) {
 
 /*
  * Executes sum and avg operators given
- * a DbOperator* query
+ * a DbOperator* query, over vals or over
+ * positions then the vals they index.
  */
 void execute_sum_avg_operator(DbOperator* query, Status* status) {
     AggregateOperator operator = query->operator_fields.aggregate_operator;
@@ -214,6 +275,7 @@ void execute_sum_avg_operator(DbOperator* query, Status* status) {
 
     int num_rows;
     int* data = NULL;
+    int* indices = NULL;
 
     // get data array
     if (operator.chandle_1->type == COLUMN) {
@@ -224,15 +286,43 @@ void execute_sum_avg_operator(DbOperator* query, Status* status) {
         data = (int*) operator.chandle_1->pointer.result->payload;
     }
 
+    // check for indices array, then sum vals at those positions
+    Column* run_column = NULL;
+    size_t run_start = 0;
+    size_t run_end = 0;
+    if (operator.chandle_2 != NULL) {
+        indices = data;
+        run_column = summary_position_run(operator.chandle_2, indices, num_rows, &run_start, &run_end);
+        if (operator.chandle_2->type == COLUMN) {
+            data = operator.chandle_2->pointer.column->data;
+        } else {
+            data = (int*) operator.chandle_2->pointer.result->payload;
+        }
+    }
+
     // init new Result
     Result* result = malloc(sizeof(Result));
 
     // if data
     if (num_rows) {
-        // sum all vals
         long sum = 0;
-        for (int i=0; i < num_rows; i++) {
-            sum += data[i];
+
+        // if full column with summary use summary sum, if a run of
+        // positions in one use its block partials, else sum all vals
+        if (indices == NULL && operator.chandle_1->type == COLUMN && operator.chandle_1->pointer.column->summary != NULL) {
+            sum = operator.chandle_1->pointer.column->summary->sum;
+        } else if (run_column != NULL) {
+            int min;
+            int max;
+            summary_range(run_column->summary, data, run_start, run_end, &sum, &min, &max);
+        } else if (indices != NULL) {
+            for (int i=0; i < num_rows; i++) {
+                sum += data[indices[i]];
+            }
+        } else {
+            for (int i=0; i < num_rows; i++) {
+                sum += data[i];
+            }
         }
 
         // set result fields
@@ -325,6 +415,146 @@ void execute_add_sub_operator(DbOperator* query, Status* status) {
     status->code = OK_DONE;
 }
 
+/*
+ * Executes approximate aggregates:
+ *     approx_sum and approx_avg from a reservoir sample
+ *     approx_distinct from a HyperLogLog sketch
+ * Full columns use their synopsis, results are sampled / sketched on the fly.
+ * Stores estimate in first handle, and 95% error bound in second if given.
+ */
+void execute_approx_operator(DbOperator* query, Status* status) {
+    AggregateOperator operator = query->operator_fields.aggregate_operator;
+
+    if (!query->num_handles) {
+        status->code = INCORRECT_FORMAT;
+        return;
+    }
+
+    size_t num_rows;
+    double estimate = 0;
+    double error_bound = 0;
+
+    if (operator.chandle_1->type == COLUMN) {
+        Column* column = operator.chandle_1->pointer.column;
+        ColumnSynopsis* synopsis = column->synopsis;
+        num_rows = column->col_size;
+        synopsis_refresh(synopsis, column->data, column->col_size);
+
+        if (operator.type == APPROX_DISTINCT) {
+            estimate = hll_estimate(synopsis->registers, &error_bound);
+        } else {
+            estimate = sample_estimate(synopsis->sample, synopsis->sample_size, num_rows, operator.type, &error_bound);
+        }
+    } else {
+        Result* result = operator.chandle_1->pointer.result;
+        if (result->data_type != INT) {
+            status->code = QUERY_UNSUPPORTED;
+            return;
+        }
+
+        int* data = (int*) result->payload;
+        num_rows = result->num_tuples;
+
+        if (operator.type == APPROX_DISTINCT) {
+            unsigned char* registers = calloc(1 << HLL_BITS, sizeof(unsigned char));
+            for (size_t i = 0; i < num_rows; i++) {
+                hll_add(registers, data[i]);
+            }
+            estimate = hll_estimate(registers, &error_bound);
+            free(registers);
+        } else if (num_rows <= SAMPLE_SIZE) {
+            estimate = sample_estimate(data, num_rows, num_rows, operator.type, &error_bound);
+        } else {
+            // draw random sample of result without replacement, which
+            // sample_estimate's finite population correction assumes
+            int* sample = malloc(sizeof(int) * SAMPLE_SIZE);
+            unsigned long rng_state = 0x9E3779B97F4A7C15UL;
+            sample_rows(data, num_rows, sample, SAMPLE_SIZE, &rng_state);
+            estimate = sample_estimate(sample, SAMPLE_SIZE, num_rows, operator.type, &error_bound);
+            free(sample);
+        }
+    }
+
+    // init new Result for estimate
+    Result* result = malloc(sizeof(Result));
+    if (!num_rows) {
+        result->num_tuples = 0;
+        result->payload = NULL;
+        result->data_type = INT;
+    } else if (operator.type == APPROX_AVG) {
+        result->num_tuples = 1;
+        result->data_type = FLOAT;
+        double* payload = malloc(sizeof(double));
+        *payload = estimate;
+        result->payload = (void*) payload;
+    } else {
+        result->num_tuples = 1;
+        result->data_type = LONG;
+        long* payload = malloc(sizeof(long));
+        *payload = lround(estimate);
+        result->payload = (void*) payload;
+    }
+
+    CHandle* res_chandle = lookup_object(query->client_lookup_table, query->handle_names[0], RESULT);
+    res_chandle->pointer.result = result;
+
+    // if second handle store error bound
+    if (query->num_handles == 2) {
+        Result* error_result = malloc(sizeof(Result));
+        error_result->num_tuples = result->num_tuples;
+        error_result->data_type = FLOAT;
+        error_result->payload = NULL;
+        if (num_rows) {
+            double* payload = malloc(sizeof(double));
+            *payload = error_bound;
+            error_result->payload = (void*) payload;
+        }
+
+        CHandle* error_chandle = lookup_object(query->client_lookup_table, query->handle_names[1], RESULT);
+        error_chandle->pointer.result = error_result;
+    }
+
+    status->code = OK_DONE;
+}
+
+/*
+ * Builds a bloom filter over a column or result's vals, stored
+ * in first handle to be passed to selects on the other join side.
+ */
+void execute_bloom_operator(DbOperator* query, Status* status) {
+    AggregateOperator operator = query->operator_fields.aggregate_operator;
+
+    if (!query->num_handles) {
+        status->code = INCORRECT_FORMAT;
+        return;
+    }
+
+    int* vals;
+    size_t num_vals;
+    if (operator.chandle_1->type == COLUMN) {
+        vals = operator.chandle_1->pointer.column->data;
+        num_vals = operator.chandle_1->pointer.column->col_size;
+    } else {
+        if (operator.chandle_1->pointer.result->data_type != INT) {
+            status->code = QUERY_UNSUPPORTED;
+            return;
+        }
+        vals = (int*) operator.chandle_1->pointer.result->payload;
+        num_vals = operator.chandle_1->pointer.result->num_tuples;
+    }
+
+    Result* result = malloc(sizeof(Result));
+    result->data_type = BLOOM;
+    result->num_tuples = num_vals;
+    result->payload = (void*) build_bloom(vals, num_vals);
+
+    CHandle* res_chandle = lookup_object(query->client_lookup_table, query->handle_names[0], RESULT);
+    res_chandle->pointer.result = result;
+
+    status->code = OK_DONE;
+}
+
+
 /*
  * Executes an aggregation operation:
  *     min, max, sum, avg, add, sub
@@ -349,6 +579,14 @@ void execute_aggregate_operator(DbOperator *query, Status* status) {
         case SUB:
             execute_add_sub_operator(query, status);
             break;
+        case APPROX_SUM:
+        case APPROX_AVG:
+        case APPROX_DISTINCT:
+            execute_approx_operator(query, status);
+            break;
+        case BUILD_BLOOM:
+            execute_bloom_operator(query, status);
+            break;
         default:
             status->code = QUERY_UNSUPPORTED;
     }
@@ -383,6 +621,13 @@ void execute_print_operator(DbOperator *query, Status* status) {
 
             results[i] = chandle->pointer.result;
 
+            // bloom filters have no vals to print
+            if (results[i]->data_type == BLOOM) {
+                free(results);
+                status->code = QUERY_UNSUPPORTED;
+                return;
+            }
+
             if (num_results_set && num_results != (int) results[i]->num_tuples) {
                 free(results);
                 status->code = QUERY_UNSUPPORTED;
@@ -556,7 +801,65 @@ void execute_fetch_operator(DbOperator* query, Status* status) {
 }
 
 
-int* execute_scan(Comparator* comparator, int* data, int* indices, Result* pos_result, void* index, IndexType index_type) {
+/**
+ * Returns 1 if val is in comparator's range and passes its filter.
+ **/
+static inline int comparator_matches(Comparator* comparator, int val) {
+    return (comparator->type1 == NO_COMPARISON || comparator->p_low <= val)
+        && (comparator->type2 == NO_COMPARISON || comparator->p_high > val)
+        && (comparator->filter == NULL || bloom_contains(comparator->filter, val));
+}
+
+
+/**
+ * Equality select on a b+ tree or ART index, p_low == p_high - 1.
+ * Copies row ids of the key's b+ tree span or ART entry straight from
+ * the index, allocating just the result rather than room for the
+ * whole column.
+ **/
+static int* execute_index_point_lookup(Comparator* comparator, int* data, Result* pos_result, void* index, IndexType index_type, PositionMap* position_map) {
+    int* ret_indices = NULL;
+    int num_results = 0;
+    if (index_type == ART) {
+        int packed_row_id;
+        int* row_ids = NULL;
+        num_results = art_search((ArtTree*) index, (int) comparator->p_low, &packed_row_id, &row_ids);
+        ret_indices = malloc(sizeof(int) * num_results);
+        if (num_results) {
+            memcpy(ret_indices, row_ids, sizeof(int) * num_results);
+        }
+    } else {
+        BPTreeSpan span;
+        do {
+            find_span((BPTreeNode*) index, (int) comparator->p_low, &span);
+            ret_indices = realloc(ret_indices, sizeof(int) * span.count);
+        } while (!span_row_ids(&span, ret_indices));
+        num_results = span.count;
+    }
+    positions_of(position_map, ret_indices, num_results);
+
+    // drop positions whose vals fail filter
+    if (comparator->filter != NULL) {
+        int num_kept = 0;
+        for (int i = 0; i < num_results; i++) {
+            ret_indices[num_kept] = ret_indices[i];
+            num_kept += bloom_contains(comparator->filter, data[ret_indices[i]]);
+        }
+        num_results = num_kept;
+    }
+
+    pos_result->num_tuples = num_results;
+    return ret_indices;
+}
+
+
+int* execute_scan(Comparator* comparator, int* data, int* indices, Result* pos_result, void* index, IndexType index_type, PositionMap* position_map) {
+    // equality on b+ tree or ART index, look up key's entries directly
+    if (indices == NULL && (index_type == BTREE_UNCLUSTERED || index_type == ART) && comparator->type1 && comparator->type2
+        && comparator->p_low == comparator->p_high - 1 && comparator->p_low >= INT_MIN && comparator->p_low <= INT_MAX) {
+        return execute_index_point_lookup(comparator, data, pos_result, index, index_type, position_map);
+    }
+
     int size = (int) pos_result->num_tuples;
 
     int* ret_indices = calloc(size, sizeof(int));
@@ -620,12 +923,12 @@ int* execute_scan(Comparator* comparator, int* data, int* indices, Result* pos_r
 
                     // if lower bound binary search for that pos
                     if (comparator->type1) {
-                        pos_min = find_pos((BPTreeNode*) index, comparator->p_low, 1);
+                        pos_min = find_pos((BPTreeNode*) index, comparator->p_low, 1, position_map);
                     }
 
                     // if upper bound binary search for that pos
                     if (comparator->type2) {
-                        pos_max = find_pos((BPTreeNode*) index, comparator->p_high, 0);
+                        pos_max = find_pos((BPTreeNode*) index, comparator->p_high, 0, position_map);
                     }
 
                     // get number of items in range
@@ -649,20 +952,39 @@ int* execute_scan(Comparator* comparator, int* data, int* indices, Result* pos_r
                         max_val = (int*) &comparator->p_high;
                     }
 
-                    // get resulting positions
-                    find_pos_range((BPTreeNode*) index, &num_results, &ret_indices, min_val, max_val);
+                    // get resulting row ids, then their positions
+                    find_pos_range((BPTreeNode*) index, &num_results, &ret_indices, size, min_val, max_val);
+                    positions_of(position_map, ret_indices, num_results);
+                    break;
+                } case ART: {
+                    // walk leaves in range in key order, then get positions
+                    long low = comparator->type1 ? comparator->p_low : LONG_MIN;
+                    long high = comparator->type2 ? comparator->p_high : LONG_MAX;
+                    num_results = art_scan((ArtTree*) index, low, high, 0, size, NULL, ret_indices);
+                    positions_of(position_map, ret_indices, num_results);
+                    break;
                 } default: ;
             }
+
+            // drop positions whose vals fail filter
+            if (comparator->filter != NULL) {
+                int num_kept = 0;
+                for (int i = 0; i < num_results; i++) {
+                    ret_indices[num_kept] = ret_indices[i];
+                    num_kept += bloom_contains(comparator->filter, data[ret_indices[i]]);
+                }
+                num_results = num_kept;
+            }
         } else {
             for (int i=0; i < size; i++) {
                 ret_indices[num_results] = i;
-                num_results += (comparator->type1 == NO_COMPARISON || comparator->p_low <= data[i]) && (comparator->type2 == NO_COMPARISON || comparator->p_high > data[i]);
+                num_results += comparator_matches(comparator, data[i]);
             }
         }
     } else {
         for (int i=0; i < size; i++) {
             ret_indices[num_results] = indices[i];
-            num_results += (comparator->type1 == NO_COMPARISON || comparator->p_low <= data[i]) && (comparator->type2 == NO_COMPARISON || comparator->p_high > data[i]);
+            num_results += comparator_matches(comparator, data[i]);
         }
     }
     ret_indices = realloc(ret_indices, sizeof(int) * num_results);
@@ -693,6 +1015,7 @@ void execute_select_operator(DbOperator* query, Status* status) {
     // to check for index
     IndexType index_type = NONE;
     void* index = NULL;
+    PositionMap* position_map = NULL;
 
     if (chandle_1->type == COLUMN) {
         // get col data
@@ -702,6 +1025,7 @@ void execute_select_operator(DbOperator* query, Status* status) {
         // get index info
         index = chandle_1->pointer.column->index;
         index_type = chandle_1->pointer.column->index_type;
+        position_map = chandle_1->pointer.column->position_map;
     } else {
         // set data and indices
         indices = (int*) chandle_1->pointer.result->payload;
@@ -714,8 +1038,8 @@ void execute_select_operator(DbOperator* query, Status* status) {
     pos_result->num_tuples = num_tuples;
 
     // check to make sure comparisons are being made
-    if (select_comperator.type1 || select_comperator.type2) {
-        pos_result->payload = (void*) execute_scan(&select_comperator, data, indices, pos_result, index, index_type);
+    if (select_comperator.type1 || select_comperator.type2 || select_comperator.filter != NULL) {
+        pos_result->payload = (void*) execute_scan(&select_comperator, data, indices, pos_result, index, index_type, position_map);
     } else {
         // no comparison being made so just
         // create array of all indices
@@ -746,27 +1070,38 @@ void* execute_select_operator_wrapper(void* context) {
 }
 
 
+/**
+ * Sets min and max to smallest lower and largest upper bound over
+ * all comparators, unbounded if any comparator is.
+ **/
+void comparators_bounds(Comparator* comparators, size_t num_comparators, long* min, long* max) {
+    *min = INT_MAX;
+    *max = INT_MIN;
+    for (size_t i = 0; i < num_comparators; i++) {
+        if (comparators[i].type1 == NO_COMPARISON) {
+            *min = INT_MIN;
+        } else if (comparators[i].p_low < *min) {
+            *min = comparators[i].p_low;
+        }
+
+        if (comparators[i].type2 == NO_COMPARISON) {
+            *max = INT_MAX;
+        } else if (comparators[i].p_high > *max) {
+            *max = comparators[i].p_high;
+        }
+    }
+}
+
+
 int** execute_shared_scan(Comparator* comparators, int* data, int* indices, Result** pos_results, size_t num_queries) {
     // get initial size from first query
     int size = (int) pos_results[0]->num_tuples;
 
     // get min and max
-    long* min = NULL;
-    long* max = NULL;
-    for (size_t i = 0; i < num_queries; i++) {
-        if (comparators[i].type1 != NO_COMPARISON && (min == NULL || *min > comparators[i].p_low))
-            min = &comparators[i].p_low;
-        if (comparators[i].type2 != NO_COMPARISON && (max == NULL || *max < comparators[i].p_high))
-            max = &comparators[i].p_high;
-    }
-
-    if (min == NULL) {
-        *min = INT_MIN;
-    }
-
-    if (max == NULL) {
-        *max = INT_MAX;
-    }
+    long min_val, max_val;
+    comparators_bounds(comparators, num_queries, &min_val, &max_val);
+    long* min = &min_val;
+    long* max = &max_val;
 
     // init num_results_array and ret_indices_array
     int* num_results_array = calloc(num_queries, sizeof(int));
@@ -787,7 +1122,7 @@ int** execute_shared_scan(Comparator* comparators, int* data, int* indices, Resu
 
             for (num_query=0; num_query < num_queries; num_query++) {
                 ret_indices_array[num_query][num_results_array[num_query]] = i;
-                num_results_array[num_query] += (comparators[num_query].type1 == NO_COMPARISON || comparators[num_query].p_low <= val) && (comparators[num_query].type2 == NO_COMPARISON || comparators[num_query].p_high > val);
+                num_results_array[num_query] += comparator_matches(&comparators[num_query], val);
             }
         }
     } else {
@@ -802,7 +1137,7 @@ int** execute_shared_scan(Comparator* comparators, int* data, int* indices, Resu
 
             for (num_query=0; num_query < num_queries; num_query++) {
                 ret_indices_array[num_query][num_results_array[num_query]] = indices[i];
-                num_results_array[num_query] += (comparators[num_query].type1 == NO_COMPARISON || comparators[num_query].p_low <= val) && (comparators[num_query].type2 == NO_COMPARISON || comparators[num_query].p_high > val);
+                num_results_array[num_query] += comparator_matches(&comparators[num_query], val);
             }
         }
     }
@@ -818,12 +1153,66 @@ int** execute_shared_scan(Comparator* comparators, int* data, int* indices, Resu
 }
 
 
+/**
+ * Shared scan for a batch of selects on a b+ tree indexed column.
+ * Gets every query's positions from one sweep over the index's leaves
+ * instead of scanning the column, then drops positions whose vals
+ * fail a query's filter.
+ **/
+int** execute_shared_index_scan(Comparator* comparators, Column* column, Result** pos_results, size_t num_queries) {
+    // each comparator as a half open range
+    long* lows = malloc(sizeof(long) * num_queries);
+    long* highs = malloc(sizeof(long) * num_queries);
+    for (size_t i = 0; i < num_queries; i++) {
+        lows[i] = comparators[i].type1 == NO_COMPARISON ? INT_MIN : comparators[i].p_low;
+        highs[i] = comparators[i].type2 == NO_COMPARISON ? (long) INT_MAX + 1 : comparators[i].p_high;
+    }
+
+    // init num_results_array and ret_indices_array
+    int* num_results_array = calloc(num_queries, sizeof(int));
+    int** ret_indices_array = calloc(num_queries, sizeof(int*));
+    for (size_t i=0; i < num_queries; i++) {
+        ret_indices_array[i] = malloc(sizeof(int) * column->col_size);
+    }
+
+    find_pos_ranges((BPTreeNode*) column->index, lows, highs, num_queries, ret_indices_array, num_results_array, column->col_size);
+
+    for (size_t num_result=0; num_result < num_queries; num_result++) {
+        int* ret_indices = ret_indices_array[num_result];
+        int num_results = num_results_array[num_result];
+        positions_of(column->position_map, ret_indices, num_results);
+
+        // drop positions whose vals fail filter
+        if (comparators[num_result].filter != NULL) {
+            int num_kept = 0;
+            for (int i = 0; i < num_results; i++) {
+                ret_indices[num_kept] = ret_indices[i];
+                num_kept += bloom_contains(comparators[num_result].filter, column->data[ret_indices[i]]);
+            }
+            num_results = num_kept;
+        }
+
+        ret_indices_array[num_result] = realloc(ret_indices, sizeof(int) * num_results);
+        pos_results[num_result]->num_tuples = num_results;
+    }
+
+    free(num_results_array);
+    free(lows);
+    free(highs);
+
+    return ret_indices_array;
+}
+
+
 void execute_shared_select_operator(DbOperator** queries, size_t num_queries, Status* status) {
     // to hold data to scan
     int* data = NULL;
     int* indices = NULL;
     int num_tuples;
 
+    // set if data is a b+ tree indexed column
+    Column* index_column = NULL;
+
     // to hold each selects comparator
     Comparator* comparators = malloc(sizeof(Comparator) * num_queries);
 
@@ -850,6 +1239,11 @@ void execute_shared_select_operator(DbOperator** queries, size_t num_queries, St
                 // get col data
                 num_tuples =  chandle_1->pointer.column->col_size;
                 data = chandle_1->pointer.column->data;
+
+                IndexType index_type = chandle_1->pointer.column->index_type;
+                if (index_type == BTREE_CLUSTERED || index_type == BTREE_UNCLUSTERED) {
+                    index_column = chandle_1->pointer.column;
+                }
             } else {
                 // set data and indices
                 data = (int*) chandle_1->pointer.result->payload;
@@ -868,8 +1262,13 @@ void execute_shared_select_operator(DbOperator** queries, size_t num_queries, St
         chandles[num_query] = res_chandle;
     }
 
-    // execute shared scan
-    int** all_results = execute_shared_scan(comparators, data, indices, results, num_queries);
+    // execute shared scan, over index's leaves if it has one
+    int** all_results;
+    if (index_column != NULL) {
+        all_results = execute_shared_index_scan(comparators, index_column, results, num_queries);
+    } else {
+        all_results = execute_shared_scan(comparators, data, indices, results, num_queries);
+    }
 
     // set results and chandles
     for (size_t num_result=0; num_result < num_queries; num_result++) {
@@ -926,16 +1325,16 @@ void* shared_select_chunk_wrapper(void* context) {
 
         for (int num_query=0; num_query < num_batched_queries; num_query++) {
             ret_indices_array[num_query][num_results_array[num_query]] = i;
-            num_results_array[num_query] += (comparators[num_query].type1 == NO_COMPARISON || comparators[num_query].p_low <= val) && (comparators[num_query].type2 == NO_COMPARISON || comparators[num_query].p_high > val);
+            num_results_array[num_query] += comparator_matches(&comparators[num_query], val);
             ret_indices_array[num_query][num_results_array[num_query]] = i + 1;
-            num_results_array[num_query] += (comparators[num_query].type1 == NO_COMPARISON || comparators[num_query].p_low <= val2) && (comparators[num_query].type2 == NO_COMPARISON || comparators[num_query].p_high > val2);
+            num_results_array[num_query] += comparator_matches(&comparators[num_query], val2);
         }
     }
 
     if (i < size) {
         for (int num_query=0; num_query < num_batched_queries; num_query++) {
             ret_indices_array[num_query][num_results_array[num_query]] = i;
-            num_results_array[num_query] += (comparators[num_query].type1 == NO_COMPARISON || comparators[num_query].p_low <= val) && (comparators[num_query].type2 == NO_COMPARISON || comparators[num_query].p_high > val);
+            num_results_array[num_query] += comparator_matches(&comparators[num_query], val);
         }
     }
 
@@ -971,35 +1370,56 @@ void execute_insert(Table* table, int* values, Status* status) {
         }
     }
 
-    int* insert_pos = NULL;
     // check if first column has clustered index
-    if (columns[0].index_type == SORTED_CLUSTERED || columns[0].index_type == BTREE_CLUSTERED) {
+    int pos = (int) table->table_length;
+    int clustered_insert = columns[0].index_type == SORTED_CLUSTERED || columns[0].index_type == BTREE_CLUSTERED;
+    if (clustered_insert) {
         // get insert position
-        int res = binary_search(columns[0].data, columns[0].col_size, values[0]);
-        insert_pos = &res;
+        pos = binary_search(columns[0].data, columns[0].col_size, values[0]);
+    }
+
+    // b+ trees store row ids, once a middle insert moves rows
+    // new row's id comes from table's position map
+    int row_id = pos;
+    PositionMap* position_map = table->position_map;
+    if (position_map == NULL && (size_t) pos != table->table_length) {
+        position_map = table_position_map(table);
+    }
+    if (position_map != NULL) {
+        row_id = position_map_insert(position_map, pos);
     }
 
     // add data to columns
     for (size_t idx=0; idx < table->col_count; idx++) {
         // if no clustered index just add to data
-        if (insert_pos == NULL) {
+        if (!clustered_insert) {
             columns[idx].data[table->table_length] = values[idx];
         // else add at position
         } else {
-            insert_at_pos(columns[idx].data, columns[idx].col_size, *insert_pos, values[idx]);
+            insert_at_pos(columns[idx].data, columns[idx].col_size, pos, values[idx]);
         }
 
         // check for unclustered index if applicable
         if (columns[idx].index_type) {
-            if (insert_pos == NULL) {
-                index_value(&columns[idx], values[idx], table->table_length, 0);
-            } else {
-                index_value(&columns[idx], values[idx], *insert_pos, 0);
-            }
+            index_value(&columns[idx], values[idx], pos, row_id, 0);
         }
 
         // increase col size
         columns[idx].col_size++;
+
+        // add to synopsis
+        if (columns[idx].synopsis != NULL) {
+            synopsis_add(columns[idx].synopsis, values[idx]);
+        }
+
+        // update summary if applicable
+        if (columns[idx].summary != NULL) {
+            if (!clustered_insert) {
+                summary_append(columns[idx].summary, values[idx]);
+            } else {
+                summary_refresh(columns[idx].summary, columns[idx].data, columns[idx].col_size, pos);
+            }
+        }
     }
     table->table_length++;
 
@@ -1016,6 +1436,150 @@ void execute_insert_operator(DbOperator* query, Status* status) {
 }
 
 
+/**
+ * Given an indexed column, k, and arrays to hold vals and positions,
+ * reads column's vals in sorted order straight out of its index.
+ * If k, reads k largest vals in descending order, else all vals ascending.
+ *
+ * Returns number of items read.
+ **/
+size_t read_sorted_from_index(Column* column, size_t k, int* vals, int* positions) {
+    size_t num_rows = column->col_size;
+    size_t num_results = k && k < num_rows ? k : num_rows;
+
+    switch (column->index_type) {
+        case SORTED_CLUSTERED:
+        case SORTED_UNCLUSTERED: {
+            int* sorted_vals = column->data;
+            int* sorted_positions = NULL;
+            if (column->index_type == SORTED_UNCLUSTERED) {
+                sorted_vals = ((UnclusteredIndex*) column->index)->values;
+                sorted_positions = ((UnclusteredIndex*) column->index)->positions;
+            }
+
+            for (size_t i = 0; i < num_results; i++) {
+                size_t idx = k ? num_rows - 1 - i : i;
+                vals[i] = sorted_vals[idx];
+                positions[i] = sorted_positions != NULL ? sorted_positions[idx] : (int) idx;
+            }
+            break;
+        } case BTREE_CLUSTERED:
+          case BTREE_UNCLUSTERED: {
+            // walk leaves in key order, largest first for top-k
+            num_results = bplus_read_sorted((BPTreeNode*) column->index, k != 0, num_results, vals, positions);
+            positions_of(column->position_map, positions, num_results);
+            break;
+        } case ART: {
+            // walk leaves in key order, largest first for top-k
+            num_results = art_scan((ArtTree*) column->index, LONG_MIN, LONG_MAX, k != 0, num_results, vals, positions);
+            positions_of(column->position_map, positions, num_results);
+            break;
+        } default:
+            num_results = 0;
+    }
+
+    return num_results;
+}
+
+
+/**
+ * Executes sort and top-k operators. Stores sorted vals
+ * in first handle and their positions in second.
+ *
+ * Positions are row positions for a column, the passed positions
+ * if a position vector is given, else indices into the result.
+ **/
+void execute_sort_operator(DbOperator* query, Status* status) {
+    SortOperator operator = query->operator_fields.sort_operator;
+
+    // need handles for vals and positions
+    if (query->num_handles != 2) {
+        status->code = INCORRECT_FORMAT;
+        return;
+    }
+
+    size_t num_rows;
+    int* data = NULL;
+    int* indices = NULL;
+    Column* column = NULL;
+
+    // get data array, and indices if passed
+    CHandle* data_chandle = operator.chandle_2 != NULL ? operator.chandle_2 : operator.chandle_1;
+    if (data_chandle->type == COLUMN) {
+        column = data_chandle->pointer.column;
+        num_rows = column->col_size;
+        data = column->data;
+    } else {
+        if (data_chandle->pointer.result->data_type != INT) {
+            status->code = QUERY_UNSUPPORTED;
+            return;
+        }
+        num_rows = data_chandle->pointer.result->num_tuples;
+        data = (int*) data_chandle->pointer.result->payload;
+    }
+
+    if (operator.chandle_2 != NULL) {
+        if (operator.chandle_1->type != RESULT || operator.chandle_1->pointer.result->num_tuples != num_rows) {
+            status->code = QUERY_UNSUPPORTED;
+            return;
+        }
+        indices = (int*) operator.chandle_1->pointer.result->payload;
+    }
+
+    size_t num_results = operator.k && operator.k < num_rows ? operator.k : num_rows;
+    int* sorted_vals = malloc(sizeof(int) * (num_results ? num_results : 1));
+    int* sorted_positions = malloc(sizeof(int) * (num_results ? num_results : 1));
+
+    // if bare full column with an index, index already has sorted order,
+    // passed positions must be carried along so those are sorted instead
+    if (column != NULL && indices == NULL && column->index_type != NONE) {
+        num_results = read_sorted_from_index(column, operator.k, sorted_vals, sorted_positions);
+    } else {
+        // copy vals and positions to sort
+        int* keys = malloc(sizeof(int) * (num_rows ? num_rows : 1));
+        int* positions = malloc(sizeof(int) * (num_rows ? num_rows : 1));
+        memcpy(keys, data, sizeof(int) * num_rows);
+        if (indices != NULL) {
+            memcpy(positions, indices, sizeof(int) * num_rows);
+        } else {
+            for (size_t i = 0; i < num_rows; i++) {
+                positions[i] = i;
+            }
+        }
+
+        if (operator.k) {
+            num_results = top_k_pairs(keys, positions, num_rows, operator.k, sorted_vals, sorted_positions);
+            free(keys);
+            free(positions);
+        } else {
+            radix_sort_pairs(keys, positions, num_rows);
+            free(sorted_vals);
+            free(sorted_positions);
+            sorted_vals = keys;
+            sorted_positions = positions;
+        }
+    }
+
+    // create new Result objects and store in chandles
+    Result* val_result = malloc(sizeof(Result));
+    val_result->data_type = INT;
+    val_result->num_tuples = num_results;
+    val_result->payload = (void*) sorted_vals;
+
+    Result* pos_result = malloc(sizeof(Result));
+    pos_result->data_type = INT;
+    pos_result->num_tuples = num_results;
+    pos_result->payload = (void*) sorted_positions;
+
+    CHandle* val_chandle = lookup_object(query->client_lookup_table, query->handle_names[0], RESULT);
+    CHandle* pos_chandle = lookup_object(query->client_lookup_table, query->handle_names[1], RESULT);
+    val_chandle->pointer.result = val_result;
+    pos_chandle->pointer.result = pos_result;
+
+    status->code = OK_DONE;
+}
+
+
 /**
  * Executes a CREATE db operator.
  **/
@@ -1036,6 +1600,9 @@ void execute_create_operator(DbOperator* query, Status* status) {
         case CREATE_IDX:
             create_idx(operator.col_name, operator.index_type, status);
             break;
+        case CREATE_SUMMARY:
+            create_summary(operator.col_name, status);
+            break;
         default:
             status->code = ERROR;
     }
@@ -1043,102 +1610,6 @@ void execute_create_operator(DbOperator* query, Status* status) {
 }
 
 
-/**
- * Given smaller vals, positions and count and
- * bigger vals, positions and count and two
- * result array pointers and num results pointer,
- * execute nested loop join.
- **/
-void nested_loop_join(
-        int* smaller_vals, int* smaller_positions, int smaller_num_vals,
-        int* bigger_vals, int* bigger_positions, int bigger_num_vals,
-        int* smaller_result, int* bigger_result, int* num_results
-    ) {
-
-    // optimized nested loop join
-    // get number of ints that will fit on a page
-    int chunk_size = 4096 / sizeof(int);
-
-    for (int bigger_chunk_pos = 0; 
-            bigger_chunk_pos < bigger_num_vals; 
-            bigger_chunk_pos += chunk_size
-        ) {
-
-        for (int smaller_chunk_pos = 0; 
-                smaller_chunk_pos < smaller_num_vals;
-                smaller_chunk_pos += chunk_size
-            ) {
-            
-            for (int bigger_pos = bigger_chunk_pos; 
-                    bigger_pos < bigger_chunk_pos + chunk_size && bigger_pos < bigger_num_vals; 
-                    bigger_pos++
-                ) {
-                
-                for (int smaller_pos = smaller_chunk_pos; 
-                        smaller_pos < smaller_chunk_pos + chunk_size && smaller_pos < smaller_num_vals;
-                        smaller_pos++
-                    ) {
-                    
-                    if (bigger_vals[bigger_pos] == smaller_vals[smaller_pos]) {
-                        bigger_result[*num_results] = bigger_positions[bigger_pos];
-                        smaller_result[*num_results] = smaller_positions[smaller_pos];
-                        (*num_results)++;
-                    }
-                }
-            }
-        }
-    }
-}
-
-
-/**
- * Given smaller vals, positions and count and
- * bigger vals, positions and count and two
- * result array pointers and num results pointer,
- * execute one pass hash join.
- **/
-void hash_join(
-        int* smaller_vals, int* smaller_positions, int smaller_num_vals,
-        int* bigger_vals, int* bigger_positions, int bigger_num_vals,
-        int* smaller_result, int* bigger_result, int* num_results
-    ) {
-
-    // build hash table on smaller
-    HashTable* hash_table = init_hashtable();
-
-    // buildhash table on smaller vals
-    for (int i = 0; i < smaller_num_vals; i++) {
-        hash_insert(hash_table, smaller_vals[i], smaller_positions[i]);
-    }
-
-    // probe table on bigger vals
-    int num_left_results = *num_results;
-    int* num_probe_results = calloc(1, sizeof(int));
-    for (int i = 0; i < bigger_num_vals; i++) {
-        // probe hash table
-        int* results = hash_probe(hash_table, bigger_vals[i], num_probe_results);
-
-        // if results found
-        if (*num_probe_results > 0) {
-            // add bigger pos
-
-            // add smaller positions
-            for (int num_r = 0; num_r < *num_probe_results; num_r++) {
-                smaller_result[num_left_results + num_r] = results[num_r];
-                bigger_result[*num_results] = bigger_positions[i];
-                (*num_results)++;
-            }
-
-            // free results
-            free(results);
-
-            num_left_results += *num_probe_results;
-            *num_probe_results = 0;
-        }
-    }
-}
-
-
 // A utility function to swap two elements
 void swap(int* a, int* b)
 {
@@ -1177,112 +1648,118 @@ void quick_sort_double(int* array_1, int* array_2, int low, int high)
 
 
 /**
- * Given val and num partitions,
- * uses hash_function to partition val into
- * one of num_partitions and returns partition.
+ * Returns 1 if column is a base column with a
+ * sorted, b+ tree or ART index a join can probe.
  **/
-unsigned int hash_partition(int val, int num_partitions) {
-    return (unsigned int) val % num_partitions;
+int has_probe_index(Column* column) {
+    if (column == NULL) {
+        return 0;
+    }
+    switch (column->index_type) {
+        case SORTED_CLUSTERED:
+            return 1;
+        case SORTED_UNCLUSTERED:
+        case BTREE_CLUSTERED:
+        case BTREE_UNCLUSTERED:
+        case ART:
+            return column->index != NULL;
+        default:
+            return 0;
+    }
 }
 
 
 /**
- * Given smaller vals, positions and count and
- * bigger vals, positions and count and two
- * result array pointers and num results pointer,
- * execute one pass hash join.
+ * Returns new array of positions 0 to num_rows - 1.
  **/
-void grace_hash_join(
-        int* left_vals, int* left_positions, int left_num_vals,
-        int* right_vals, int* right_positions, int right_num_vals,
-        int* left_result, int* right_result, int* num_results
-    ) {
-    // TODO: Multiple cores
-
-    // partition all vals and positions
-    int num_partitions = 256;
-
-    // create arrays to hold partitions
-    int** left_val_partitions = malloc(num_partitions * sizeof(int*));
-    int** left_pos_partitions = malloc(num_partitions * sizeof(int*));
-    int** right_val_partitions = malloc(num_partitions * sizeof(int*));
-    int** right_pos_partitions = malloc(num_partitions * sizeof(int*));
-    int* left_partition_sizes = malloc(num_partitions * sizeof(int));
-    int* right_partition_sizes = malloc(num_partitions * sizeof(int));
-    for (int i = 0; i < num_partitions; i++) {
-        left_partition_sizes[i] = 0;
-        right_partition_sizes[i] = 0;
-
-        left_val_partitions[i] = calloc(left_num_vals, sizeof(int));
-        left_pos_partitions[i] = calloc(left_num_vals, sizeof(int));
-
-        right_val_partitions[i] = calloc(right_num_vals, sizeof(int));
-        right_pos_partitions[i] = calloc(right_num_vals, sizeof(int));
-    }
-
-    // partition values
-    int num_partition = 0;
-    for (int i = 0; i < left_num_vals; i++) {
-        num_partition = hash_partition(left_vals[i], num_partitions);
-        left_val_partitions[num_partition][left_partition_sizes[num_partition]] = left_vals[i];
-        left_pos_partitions[num_partition][left_partition_sizes[num_partition]] = left_positions[i];
-        left_partition_sizes[num_partition]++;
-    }
-
-    for (int i = 0; i < right_num_vals; i++) {
-        num_partition = hash_partition(right_vals[i], num_partitions);
-        right_val_partitions[num_partition][right_partition_sizes[num_partition]] = right_vals[i];
-        right_pos_partitions[num_partition][right_partition_sizes[num_partition]] = right_positions[i];
-        right_partition_sizes[num_partition]++;
-    }
-
-    // int* left_position_indices = calloc(left_num_vals, sizeof(int));
-    // int* right_position_indices = calloc(right_num_vals, sizeof(int));
-
-    // execute hash_join on each partition
-    for (num_partition = 0; num_partition < num_partitions; num_partition++) {
-        // create hashtable on smaller partition
-        if (left_partition_sizes[num_partition] < right_partition_sizes[num_partition]) {
-            hash_join(
-                left_val_partitions[num_partition], left_pos_partitions[num_partition], left_partition_sizes[num_partition],
-                right_val_partitions[num_partition], right_pos_partitions[num_partition], right_partition_sizes[num_partition],
-                left_result, right_result, num_results
-            );
-        } else {
-            hash_join(
-                right_val_partitions[num_partition], right_pos_partitions[num_partition], right_partition_sizes[num_partition],
-                left_val_partitions[num_partition], left_pos_partitions[num_partition], left_partition_sizes[num_partition],
-                right_result, left_result, num_results
-            );
+int* all_positions(int num_rows) {
+    int* positions = malloc(sizeof(int) * (num_rows + 1));
+    for (int i = 0; i < num_rows; i++) {
+        positions[i] = i;
+    }
+    return positions;
+}
+
+
+/**
+ * Fills in cost model stats for one join side, either a base
+ * column or a result of vals. Base columns use their synopsis
+ * for distinct counts and sorted indexes for order, else both
+ * are estimated from a sample rather than scanning all vals.
+ **/
+void join_side_stats(Column* column, Result* vals, size_t* num_vals, size_t* distinct, int* sorted) {
+    if (column != NULL) {
+        double error_bound;
+        *num_vals = column->col_size;
+        *distinct = column->col_size;
+        if (column->synopsis != NULL) {
+            synopsis_refresh(column->synopsis, column->data, column->col_size);
+            *distinct = (size_t) hll_estimate(column->synopsis->registers, &error_bound);
         }
+        *sorted = column->index_type == SORTED_CLUSTERED || estimate_sorted(column->data, column->col_size);
+    } else {
+        *num_vals = vals->num_tuples;
+        *distinct = estimate_distinct((int*) vals->payload, vals->num_tuples);
+        *sorted = estimate_sorted((int*) vals->payload, vals->num_tuples);
+    }
 
-        // free memory
-        free(left_val_partitions[num_partition]);
-        free(left_pos_partitions[num_partition]);
-        free(right_val_partitions[num_partition]);
-        free(right_pos_partitions[num_partition]);
+    if (*distinct > *num_vals) {
+        *distinct = *num_vals;
     }
+    if (!*distinct && *num_vals) {
+        *distinct = 1;
+    }
+}
 
-    /* // now need to get actual positions from position indices */
-    /* // sort position indices */
-    /* quick_sort_double(left_position_indices, right_position_indices, 0, *num_results - 1); */
 
-    /* // add all actual positions to results */
-    /* for (int i = 0; i < *num_results; i++) { */
-    /*     // printf("%d,%d\n", left_positions[left_position_indices[i]], right_positions[right_position_indices[i]]); */
-    /*     left_result[i] = left_positions[left_position_indices[i]]; */
-    /*     right_result[i] = right_positions[right_position_indices[i]]; */
-    /* } */
+/**
+ * Executes a semi or anti JOIN db operator, storing left
+ * positions with (or without) a match in the one handle.
+ */
+void execute_semi_join_operator(DbOperator* query, Status* status) {
+    if (query->num_handles != 1) {
+        status->code = INCORRECT_FORMAT;
+        return;
+    }
 
-    // free memory
-    free(left_val_partitions);
-    free(left_pos_partitions);
-    free(left_partition_sizes);
-    // free(left_position_indices);
-    free(right_val_partitions);
-    free(right_pos_partitions);
-    free(right_partition_sizes);
-    // free(right_position_indices);
+    JoinOperator operator = query->operator_fields.join_operator;
+
+    // base column outer side uses all positions, inner only needs vals
+    int* outer_vals;
+    int* outer_positions;
+    int* outer_all_positions = NULL;
+    int outer_num_vals;
+    if (operator.col_1 != NULL) {
+        outer_vals = operator.col_1->data;
+        outer_num_vals = operator.col_1->col_size;
+        outer_all_positions = all_positions(outer_num_vals);
+        outer_positions = outer_all_positions;
+    } else {
+        outer_vals = (int*) operator.val_1->payload;
+        outer_positions = (int*) operator.pos_1->payload;
+        outer_num_vals = operator.val_1->num_tuples;
+    }
+
+    int* inner_vals = operator.col_2 != NULL ? operator.col_2->data : (int*) operator.val_2->payload;
+    int inner_num_vals = operator.col_2 != NULL ? (int) operator.col_2->col_size : (int) operator.val_2->num_tuples;
+
+    int* result_positions = NULL;
+    size_t num_results = semi_join(
+        outer_vals, outer_positions, outer_num_vals,
+        inner_vals, inner_num_vals,
+        operator.mode == ANTI_JOIN, &result_positions
+    );
+    free(outer_all_positions);
+
+    Result* result = malloc(sizeof(Result));
+    result->data_type = INT;
+    result->num_tuples = num_results;
+    result->payload = (void*) result_positions;
+
+    CHandle* chandle = lookup_object(query->client_lookup_table, query->handle_names[0], RESULT);
+    chandle->pointer.result = result;
+
+    status->code = OK_DONE;
 }
 
 
@@ -1290,6 +1767,11 @@ void grace_hash_join(
  * Executes a JOIN db operator.
  */
 void exeucte_join_operator(DbOperator* query, Status* status) {
+    if (query->operator_fields.join_operator.mode != INNER_JOIN) {
+        execute_semi_join_operator(query, status);
+        return;
+    }
+
     // make sure two handles to store results in
     if (query->num_handles != 2) {
         status->code = INCORRECT_FORMAT;
@@ -1298,94 +1780,134 @@ void exeucte_join_operator(DbOperator* query, Status* status) {
 
     JoinOperator operator = query->operator_fields.join_operator;
 
-    // get all result objects
-    Result* pos_1 = operator.pos_1;
-    Result* val_1 = operator.val_1;
-    Result* pos_2 = operator.pos_2;
-    Result* val_2 = operator.val_2;
-
-    // get indice and data arrs
-    int* left_vals = (int*) val_1->payload;
-    int left_num_vals = val_1->num_tuples;
-    int* left_positions = (int*) pos_1->payload;
-
-    // same for right
-    int* right_vals = (int*) val_2->payload;
-    int right_num_vals = val_2->num_tuples;
-    int* right_positions = (int*) pos_2->payload;
+    // get sizes of each side, base columns join on all their rows
+    int left_num_vals = operator.col_1 != NULL ? (int) operator.col_1->col_size : (int) operator.val_1->num_tuples;
+    int right_num_vals = operator.col_2 != NULL ? (int) operator.col_2->col_size : (int) operator.val_2->num_tuples;
+
+    // indexed base column side can be probed instead of scanned
+    Column* index_column = NULL;
+    int index_right = 0;
+    if (has_probe_index(operator.col_2) && (!has_probe_index(operator.col_1) || right_num_vals >= left_num_vals)) {
+        index_column = operator.col_2;
+        index_right = 1;
+    } else if (has_probe_index(operator.col_1)) {
+        index_column = operator.col_1;
+    }
 
-    // init results arr
-    int* left_result_pos = NULL;
-    int* right_result_pos = NULL;
-    int* num_results = calloc(1, sizeof(int));
+    // gather stats and let cost model pick algorithm
+    JoinStats stats;
+    join_side_stats(operator.col_1, operator.val_1, &stats.left_num_vals, &stats.left_distinct, &stats.left_sorted);
+    join_side_stats(operator.col_2, operator.val_2, &stats.right_num_vals, &stats.right_distinct, &stats.right_sorted);
+    stats.index_num_vals = index_column != NULL ? index_column->col_size : 0;
+    stats.outer_num_vals = index_right ? stats.left_num_vals : stats.right_num_vals;
+
+    JoinType hint = operator.type;
+    operator.type = choose_join_type(&stats, hint);
+    snprintf(join_explain, sizeof(join_explain), "join algorithm: %s (hint: %s, estimated cost: %.0f)",
+        join_type_name(operator.type), join_type_name(hint), estimate_join_cost(&stats, operator.type));
+    printf("%s\n", join_explain);
+
+    // get vals and positions of each side, base columns not being
+    // probed use their data and all positions
+    int* left_vals = NULL;
+    int* left_positions = NULL;
+    int* left_all_positions = NULL;
+    if (operator.col_1 == NULL) {
+        left_vals = (int*) operator.val_1->payload;
+        left_positions = (int*) operator.pos_1->payload;
+    } else if (operator.type != INDEX_NESTED_LOOP || index_right) {
+        left_vals = operator.col_1->data;
+        left_all_positions = all_positions(left_num_vals);
+        left_positions = left_all_positions;
+    }
 
-    int right_smaller = 0;
-    if (left_num_vals > right_num_vals) {
-        left_result_pos = calloc(right_num_vals, sizeof(int));
-        right_result_pos = calloc(right_num_vals, sizeof(int));
-        right_smaller = 1;
-    } else {
-        left_result_pos = calloc(left_num_vals, sizeof(int));
-        right_result_pos = calloc(left_num_vals, sizeof(int));
+    int* right_vals = NULL;
+    int* right_positions = NULL;
+    int* right_all_positions = NULL;
+    if (operator.col_2 == NULL) {
+        right_vals = (int*) operator.val_2->payload;
+        right_positions = (int*) operator.pos_2->payload;
+    } else if (operator.type != INDEX_NESTED_LOOP || !index_right) {
+        right_vals = operator.col_2->data;
+        right_all_positions = all_positions(right_num_vals);
+        right_positions = right_all_positions;
     }
 
+    // matches go to chunked output, sized only by number of matches
+    JoinOutput output;
+    init_join_output(&output);
+    int right_smaller = left_num_vals > right_num_vals;
+
     // check which type of join
-    if (operator.type == NESTED_LOOP) {
+    if (operator.type == INDEX_NESTED_LOOP) {
+        if (index_right) {
+            index_nested_loop_join(left_vals, left_positions, left_num_vals, index_column, 1, &output);
+        } else {
+            index_nested_loop_join(right_vals, right_positions, right_num_vals, index_column, 0, &output);
+        }
+    } else if (operator.type == SORT_MERGE) {
+        sort_merge_join(
+            left_vals, left_positions, left_num_vals,
+            right_vals, right_positions, right_num_vals,
+            &output
+        );
+    } else if (operator.type == NESTED_LOOP) {
         // if left is smaller use left as outer else use right as outer
         if (right_smaller) {
             nested_loop_join(
                 right_vals, right_positions, right_num_vals,
                 left_vals, left_positions, left_num_vals,
-                right_result_pos, left_result_pos, num_results
+                0, &output
             );
         } else {
             nested_loop_join(
                 left_vals, left_positions, left_num_vals,
                 right_vals, right_positions, right_num_vals,
-                left_result_pos, right_result_pos, num_results
+                1, &output
             );
         }
-    } else {
-        // one pass hash join
-        if (0) {
-            // if left is smaller use left as outer else use right as outer
-            if (right_smaller) {
-                hash_join(
-                    right_vals, right_positions, right_num_vals,
-                    left_vals, left_positions, left_num_vals,
-                    right_result_pos, left_result_pos, num_results
-                );
-            } else {
-                hash_join(
-                    left_vals, left_positions, left_num_vals,
-                    right_vals, right_positions, right_num_vals,
-                    left_result_pos, right_result_pos, num_results
-                );
-            }
-        // grace hash join
+    } else if (operator.type == ONE_PASS_HASH) {
+        // build on smaller side
+        if (right_smaller) {
+            hash_join(
+                right_vals, right_positions, right_num_vals,
+                left_vals, left_positions, left_num_vals,
+                0, &output
+            );
         } else {
-            grace_hash_join(
+            hash_join(
                 left_vals, left_positions, left_num_vals,
                 right_vals, right_positions, right_num_vals,
-                left_result_pos, right_result_pos, num_results
+                1, &output
             );
         }
+    } else {
+        // radix partitioned hash join
+        radix_join(
+            left_vals, left_positions, left_num_vals,
+            right_vals, right_positions, right_num_vals,
+            &output
+        );
     }
 
-    // realloc results
-    left_result_pos = realloc(left_result_pos, sizeof(int) * *num_results);
-    right_result_pos = realloc(right_result_pos, sizeof(int) * *num_results);
+    free(left_all_positions);
+    free(right_all_positions);
+
+    // stitch output chunks into result arrays
+    int* left_result_pos = NULL;
+    int* right_result_pos = NULL;
+    size_t num_results = join_output_materialize(&output, &left_result_pos, &right_result_pos);
 
     // create new Result objects and store in chandles for results
     Result* left_result = malloc(sizeof(Result));
     Result* right_result = malloc(sizeof(Result));
 
     left_result->data_type = INT;
-    left_result->num_tuples = *num_results;
+    left_result->num_tuples = num_results;
     left_result->payload = (void*) left_result_pos;
 
     right_result->data_type = INT;
-    right_result->num_tuples = *num_results;
+    right_result->num_tuples = num_results;
     right_result->payload = (void*) right_result_pos;
 
     // store in chandles
@@ -1395,6 +1917,10 @@ void exeucte_join_operator(DbOperator* query, Status* status) {
     left_chandle->pointer.result = left_result;
     right_chandle->pointer.result = right_result;
 
+    // explained joins send chosen algorithm back to client
+    if (operator.explain) {
+        status->result = join_explain;
+    }
     status->code = OK_DONE;
 }
 
@@ -1403,15 +1929,29 @@ void exeucte_join_operator(DbOperator* query, Status* status) {
  * remove rows from table.
  **/
 void execute_delete(Table* table, int* positions, int num_positions) {
+    // take rows out of position map once for all b+ trees,
+    // leaving other rows' ids in leaves as they are
+    int* row_ids = NULL;
+    PositionMap* position_map = table_position_map(table);
+    if (position_map != NULL) {
+        row_ids = malloc(sizeof(int) * num_positions);
+        for (int pos_i = 0; pos_i < num_positions; pos_i++) {
+            row_ids[pos_i] = position_map_remove(position_map, positions[pos_i]);
+        }
+    }
+
     // loop through cols in table, deleting vals and updating indexes
     for (size_t col_num = 0; col_num < table->col_count; col_num++) {
         Column* col = &table->columns[col_num];
 
         UnclusteredIndex* unclustered_index = NULL;
         BPTreeNode* btree_index = NULL;
+        ArtTree* art_index = NULL;
 
         if (col->index_type == SORTED_UNCLUSTERED) {
             unclustered_index = (UnclusteredIndex*) col->index;
+        } else if (col->index_type == ART) {
+            art_index = (ArtTree*) col->index;
         } else if (col->index_type != SORTED_CLUSTERED) {
             btree_index = (BPTreeNode*) col->index;
         }
@@ -1435,15 +1975,34 @@ void execute_delete(Table* table, int* positions, int num_positions) {
                     }
                 }
             } else if (btree_index != NULL) {
-                // need to remove value from btree and update positions
-                bplus_remove(btree_index, val, pos);
+                // remove row's id from btree
+                bplus_remove(btree_index, val, row_ids[pos_i]);
+            } else if (art_index != NULL) {
+                art_remove(art_index, val, row_ids[pos_i]);
             }
 
             // subtract one from size
             col->col_size -= 1;
         }
+
+        // refresh summary from first removed position on
+        if (col->summary != NULL && num_positions) {
+            int min_pos = positions[0];
+            for (int pos_i = 1; pos_i < num_positions; pos_i++) {
+                min_pos = positions[pos_i] < min_pos ? positions[pos_i] : min_pos;
+            }
+            summary_refresh(col->summary, col->data, col->col_size, min_pos);
+        }
+
+        // removed vals can't be taken out of sample/sketch,
+        // rebuilt on next approximate aggregate or join costing
+        if (col->synopsis != NULL && num_positions) {
+            col->synopsis->stale = 1;
+        }
     }
 
+    free(row_ids);
+
     // subtract from table length
     table->table_length -= num_positions;
 }
@@ -1541,6 +2100,9 @@ void handle_db_operator(DbOperator* query, Status* status) {
         case DELETE:
             exeucte_delete_operator(query, status);
             break;
+        case SORT:
+            execute_sort_operator(query, status);
+            break;
         case SHUTDOWN:
             shutdown_server(status);
             break;
@@ -1637,26 +2199,14 @@ void execute_batched_queries(Status* status) {
             // get all comparators and min and max
             Comparator* comparators = malloc(sizeof(Comparator) * num_batched_queries);
 
-            long* min = NULL;
-            long* max = NULL;
-
             for (int num_q = 0; num_q < num_batched_queries; num_q++) {
                 comparators[num_q] = batched_queries[num_q]->operator_fields.select_operator.comparator;
-
-                if (comparators[num_q].type1 != NO_COMPARISON && (min == NULL || *min > comparators[num_q].p_low))
-                    min = &comparators[num_q].p_low;
-
-                if (comparators[num_q].type2 != NO_COMPARISON && (max == NULL || *max < comparators[num_q].p_high))
-                    max = &comparators[num_q].p_high;
             }
 
-            // check for null min/max
-            if (min == NULL) {
-                *min = INT_MIN;
-            }
-            if (max == NULL) {
-                *max = INT_MAX;
-            }
+            long min_val, max_val;
+            comparators_bounds(comparators, num_batched_queries, &min_val, &max_val);
+            long* min = &min_val;
+            long* max = &max_val;
 
             // initialize list to hold results
             all_results = calloc(num_threads, sizeof(int*));
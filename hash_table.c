@@ -1,7 +1,11 @@
 /**
- * Implements an extendible hash table that is used in 
- * hash joins.
+ * Implements an extendible hash table, and the
+ * open addressing table used in hash joins.
  **/
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "hash_table.h"
 
 #define INITIAL_NUM_BITS 2
@@ -210,3 +214,148 @@ int* hash_probe(HashTable* hash_table, int key, int* num_results) {
     return return_vals;
 }
 
+
+/**
+ * Multiplicative hash of key for join hash table.
+ **/
+static inline unsigned long long join_table_hash(int key) {
+    return (unsigned long long) (unsigned int) key * 0x9E3779B97F4A7C15ULL;
+}
+
+
+/**
+ * Returns tag of hash, taken from the bits just
+ * below the slot bits, with high bit set so never 0.
+ **/
+static inline unsigned char join_table_tag(unsigned long long hash, int slot_bits) {
+    return 0x80 | ((hash >> (57 - slot_bits)) & 0x7F);
+}
+
+
+/**
+ * Sizes join hash table's slots for num_tuples build tuples.
+ **/
+static void size_join_hashtable(JoinHashTable* hash_table, size_t num_tuples) {
+    // keep load factor at most 1/2
+    hash_table->slot_bits = 4;
+    while (((size_t) 1 << hash_table->slot_bits) < 2 * num_tuples) {
+        hash_table->slot_bits++;
+    }
+    hash_table->num_slots = (size_t) 1 << hash_table->slot_bits;
+}
+
+
+JoinHashTable* init_join_hashtable(size_t num_tuples) {
+    JoinHashTable* hash_table = malloc(sizeof(JoinHashTable));
+    size_join_hashtable(hash_table, num_tuples);
+
+    hash_table->tags = calloc(hash_table->num_slots + JOIN_TAG_GROUP, sizeof(unsigned char));
+    hash_table->slots = malloc(sizeof(JoinSlot) * hash_table->num_slots);
+
+    hash_table->next = malloc(sizeof(unsigned int) * (num_tuples + 1));
+    hash_table->positions = malloc(sizeof(int) * (num_tuples + 1));
+    hash_table->num_tuples = 0;
+    hash_table->tuple_capacity = num_tuples;
+
+    return hash_table;
+}
+
+
+void reset_join_hashtable(JoinHashTable* hash_table, size_t num_tuples) {
+    size_t old_num_slots = hash_table->num_slots;
+    size_join_hashtable(hash_table, num_tuples);
+
+    if (hash_table->num_slots > old_num_slots) {
+        free(hash_table->tags);
+        free(hash_table->slots);
+        hash_table->tags = calloc(hash_table->num_slots + JOIN_TAG_GROUP, sizeof(unsigned char));
+        hash_table->slots = malloc(sizeof(JoinSlot) * hash_table->num_slots);
+    } else {
+        memset(hash_table->tags, 0, hash_table->num_slots + JOIN_TAG_GROUP);
+    }
+
+    if (num_tuples > hash_table->tuple_capacity) {
+        hash_table->next = realloc(hash_table->next, sizeof(unsigned int) * (num_tuples + 1));
+        hash_table->positions = realloc(hash_table->positions, sizeof(int) * (num_tuples + 1));
+        hash_table->tuple_capacity = num_tuples;
+    }
+    hash_table->num_tuples = 0;
+}
+
+
+/**
+ * Returns slot holding key, or slot key should go in if not present.
+ * Compares JOIN_TAG_GROUP tags at a time, stopping at first empty slot.
+ **/
+static size_t join_table_find_slot(JoinHashTable* hash_table, int key) {
+    unsigned long long hash = join_table_hash(key);
+    unsigned char tag = join_table_tag(hash, hash_table->slot_bits);
+    size_t mask = hash_table->num_slots - 1;
+    size_t slot = hash >> (64 - hash_table->slot_bits);
+
+    while (1) {
+#ifdef __SSE2__
+        __m128i group = _mm_loadu_si128((__m128i*) &hash_table->tags[slot]);
+        unsigned int matches = _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char) tag)));
+        unsigned int empties = _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_setzero_si128()));
+
+        // only matches before first empty slot count
+        unsigned int first_empty = empties ? __builtin_ctz(empties) : JOIN_TAG_GROUP;
+        matches &= (1u << first_empty) - 1;
+        while (matches) {
+            size_t match_slot = (slot + __builtin_ctz(matches)) & mask;
+            if (hash_table->slots[match_slot].key == key) {
+                return match_slot;
+            }
+            matches &= matches - 1;
+        }
+        if (empties) {
+            return (slot + first_empty) & mask;
+        }
+        slot = (slot + JOIN_TAG_GROUP) & mask;
+#else
+        if (!hash_table->tags[slot]
+                || (hash_table->tags[slot] == tag && hash_table->slots[slot].key == key)) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+#endif
+    }
+}
+
+
+void join_hash_insert(JoinHashTable* hash_table, int key, int position) {
+    size_t slot = join_table_find_slot(hash_table, key);
+
+    // new key, claim slot
+    if (!hash_table->tags[slot]) {
+        unsigned char tag = join_table_tag(join_table_hash(key), hash_table->slot_bits);
+        hash_table->tags[slot] = tag;
+        if (slot < JOIN_TAG_GROUP) {
+            hash_table->tags[hash_table->num_slots + slot] = tag;
+        }
+        hash_table->slots[slot].key = key;
+        hash_table->slots[slot].head = 0;
+    }
+
+    // chain tuple onto slot
+    size_t idx = hash_table->num_tuples++;
+    hash_table->positions[idx] = position;
+    hash_table->next[idx] = hash_table->slots[slot].head;
+    hash_table->slots[slot].head = idx + 1;
+}
+
+
+unsigned int join_hash_probe(JoinHashTable* hash_table, int key) {
+    size_t slot = join_table_find_slot(hash_table, key);
+    return hash_table->tags[slot] ? hash_table->slots[slot].head : 0;
+}
+
+
+void free_join_hashtable(JoinHashTable* hash_table) {
+    free(hash_table->tags);
+    free(hash_table->slots);
+    free(hash_table->next);
+    free(hash_table->positions);
+    free(hash_table);
+}
@@ -0,0 +1,11 @@
+/**
+ * Contains function definitions for per query
+ * arena allocation.
+ **/
+
+#include "cs165_api.h"
+
+Arena* create_arena(size_t block_size);
+void* arena_alloc(Arena* arena, size_t num_bytes);
+void arena_absorb(Arena* arena, Arena* other);
+void free_arena(Arena* arena);
@@ -0,0 +1,19 @@
+/**
+ * Contains function definitions for all
+ * adaptive radix tree functionality.
+ **/
+
+#include "cs165_api.h"
+
+ArtTree* create_art();
+ArtTree* art_bulk_load(int* data, size_t num_vals, PositionMap* position_map);
+void art_insert(ArtTree* tree, int key, int row_id);
+void art_remove(ArtTree* tree, int key, int row_id);
+
+int art_search(ArtTree* tree, int key, int* packed_row_id, int** row_ids);
+size_t art_scan(ArtTree* tree, long low, long high, int descending, size_t limit, int* vals, int* row_ids);
+size_t art_size(ArtTree* tree);
+
+void dump_art(FILE* fd, ArtTree* tree);
+ArtTree* load_art(FILE* fd);
+void free_art(ArtTree* tree);
@@ -0,0 +1,12 @@
+/**
+ * Contains function definitions for blocked
+ * bloom filters used to push joins into scans.
+ **/
+
+#include "cs165_api.h"
+
+BloomFilter* build_bloom(int* vals, size_t num_vals);
+void free_bloom(BloomFilter* filter);
+
+void bloom_add(BloomFilter* filter, int val);
+int bloom_contains(BloomFilter* filter, int val);
@@ -8,9 +8,24 @@
 
 /***********************************/
 /* Functions for searching b+ tree */
-int find_pos(BPTreeNode* root, int val, int min);
+int bplus_node_search(BPTreeNode* node, int val);
+void refresh_key_block(BPTreeNode* node);
+int find_pos(BPTreeNode* root, int val, int min, PositionMap* position_map);
 BPTreeNode* find_leaf_node(BPTreeNode* root, int val);
-void find_pos_range(BPTreeNode* root, int* num_results, int** ret_indices, int* min_val, int* max_val);
+BPTreeNode* find_first_leaf(BPTreeNode* root);
+BPTreeNode* find_last_leaf(BPTreeNode* root);
+BPTreeNode* bplus_child(BPTreeNode* node, int index);
+BPTreeNode* bplus_next_leaf(BPTreeNode* leaf);
+BPTreeNode* bplus_prev_leaf(BPTreeNode* leaf);
+int bplus_leaf_val(BPTreeNode* leaf, int index);
+int bplus_leaf_row_id(BPTreeNode* leaf, int index);
+void bplus_leaf_entries(BPTreeNode* leaf, int start, int end, int* vals, int* row_ids);
+void find_pos_range(BPTreeNode* root, int* num_results, int** ret_indices, int capacity, int* min_val, int* max_val);
+int find_span(BPTreeNode* root, int val, BPTreeSpan* span);
+void find_spans(BPTreeNode* root, int* vals, int num_vals, BPTreeSpan* spans);
+int span_row_ids(BPTreeSpan* span, int* row_ids);
+void find_pos_ranges(BPTreeNode* root, long* lows, long* highs, size_t num_ranges, int** ret_indices, int* num_results, int capacity);
+size_t bplus_read_sorted(BPTreeNode* root, int descending, size_t limit, int* vals, int* row_ids);
 /***********************************/
 
 /************************************************/
@@ -21,18 +36,20 @@ void bplus_remove(BPTreeNode* root, int val, int pos);
 /****************************************/
 /* Functions for inserting into b+ tree */
 
-BPTreeNode* create_node();
+BPTreeNode* create_node(BPTreeNode* neighbor);
+BPTreeNode* create_leaf_node(BPTreeNode* neighbor);
 BPTreeNode* create_new_root_node();
 
 int find_insertion_index(BPTreeNode* node, int val);
 
-BPTreeNode* bplus_insert(BPTreeNode* root, int val, int pos, int update_vals);
+BPTreeNode* bplus_insert(BPTreeNode* root, int val, int pos);
+BPTreeNode* bplus_bulk_load(int* data, size_t num_vals, double fill_factor, PositionMap* position_map);
 void insert_into_leaf(BPTreeNode* leaf_node, int val, int pos, int insertion_index);
 BPTreeNode* split_leaf_and_insert(BPTreeNode* root, BPTreeNode* leaf_node, int val, int pos);
 
 BPTreeNode* insert_into_parent(BPTreeNode* root, BPTreeNode* parent, BPTreeNode* left_node, BPTreeNode* right_node, int val);
-BPTreeNode* insert_into_node(BPTreeNode* node, BPTreeNode* right_node, int val);
-BPTreeNode* split_node_and_insert(BPTreeNode* root, BPTreeNode* node, BPTreeNode* right_node, int val);
+BPTreeNode* insert_into_node(BPTreeNode* node, BPTreeNode* left_node, BPTreeNode* right_node, int val);
+BPTreeNode* split_node_and_insert(BPTreeNode* root, BPTreeNode* node, BPTreeNode* left_node, BPTreeNode* right_node, int val);
 BPTreeNode* insert_into_new_root(BPTreeNode* left_node, BPTreeNode* right_node, int val);
 
 void print_tree();
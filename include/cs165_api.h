@@ -28,7 +28,10 @@ SOFTWARE.
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <sys/types.h>
 #include <string.h>
 #include "message.h"
 
@@ -36,13 +39,81 @@ SOFTWARE.
 #define MAX_SIZE_NAME 64
 #define HANDLE_MAX_SIZE 64
 
-// define fanout of btree so that each node fits on one page (4096 bytes)
-#define FANOUT 340
-#define LEAF_SIZE 508
+// define fanout of btree so that each node, with its key block and version, fits on one page (4096 bytes)
+#define FANOUT 501
+#define LEAF_SIZE 500
+// 1 to put a cache line of keys summarizing each b+ tree node at its
+// top, searched with SIMD before the node's keys, 0 for binary search
+#ifndef BPLUS_KEY_BLOCK
+#define BPLUS_KEY_BLOCK 1
+#endif
+// keys in a node's key block, one cache line
+#define KEY_BLOCK_KEYS 16
+// 1 to store each b+ tree leaf's keys and row ids as offsets from the
+// leaf's smallest of each, packed in as few bytes as fit, 0 for ints
+#ifndef BPLUS_COMPRESSED_LEAVES
+#define BPLUS_COMPRESSED_LEAVES 1
+#endif
+// bytes of a compressed leaf holding its packed keys and row ids
+#define LEAF_PACKED_BYTES 3990
+#if BPLUS_COMPRESSED_LEAVES
+// most entries in a leaf, low enough that either half of an overfull
+// leaf fits in a leaf even at the widest offsets, 4 bytes each
+#define LEAF_MAX_ENTRIES (2 * (LEAF_PACKED_BYTES / 8) - 1)
+#else
+#define LEAF_MAX_ENTRIES (LEAF_SIZE - 1)
+#endif
+// share of each node filled by bulk loading, rest left for inserts
+#define BPLUS_FILL_FACTOR 0.9
+// most levels a b+ tree reaches, each internal node has over FANOUT / 2 children
+#define BPLUS_MAX_HEIGHT 16
+// back b+ tree node slabs with huge pages where available
+#define BPLUS_HUGE_PAGES 1
+
+// address space reserved per slab, slabs are aligned to this
+#define SLAB_REGION_BYTES ((size_t) 1 << 34)
+// bytes of a slab's region committed at a time, one huge page
+#define SLAB_COMMIT_BYTES ((size_t) 2 << 20)
+// bytes at start of region for slab header, keeps objects page aligned
+#define SLAB_HEADER_BYTES 4096
+
+// bytes of an ART index's keys, one per level
+#define ART_KEY_BYTES 4
 
 // define bucket size so each fits on one page
 #define BUCKET_SIZE 511
 
+// 1 to compare nested loop join vals with SIMD, 0 for scalar
+// compares, built both ways by bench_join to compare
+#ifndef NESTED_LOOP_SIMD
+#define NESTED_LOOP_SIMD 1
+#endif
+
+// number of join hash table tags compared at once
+#define JOIN_TAG_GROUP 16
+
+// matching position pairs per join output chunk, leaves room
+// for the chunk header so a whole chunk is exactly 32KB
+#define JOIN_CHUNK_SIZE 4094
+// bytes per join arena block, holds 32 output chunks
+#define JOIN_ARENA_BLOCK_SIZE (1 << 20)
+// bytes of working memory a join may use before spilling
+// partitions to temp files, overridden by env JOIN_MEMORY_BUDGET
+#define JOIN_MEMORY_BUDGET ((size_t) 1 << 30)
+
+// bits of bloom filter per key added, about 1% false positives
+#define BLOOM_BITS_PER_KEY 10
+// 64 bit words per bloom filter block, one cache line
+#define BLOOM_BLOCK_WORDS 8
+
+// number of rows covered by each per block partial in a column summary
+#define SUMMARY_BLOCK_SIZE 4096
+
+// number of vals kept in each column's reservoir sample
+#define SAMPLE_SIZE 8192
+// number of HyperLogLog registers per column is 2^HLL_BITS
+#define HLL_BITS 14
+
 
 /************************************************************/
 /* Following structs are for looking up tables/cols/results */
@@ -110,18 +181,36 @@ typedef struct LookupTable {
 
 typedef struct BPTreeNode BPTreeNode;
 
+/**
+ * Link to a b+ tree node: its index in its tree's slab plus one,
+ * 0 for none. Links are ids rather than pointers so a tree's nodes
+ * are valid wherever its slab is mapped, letting a dumped tree be
+ * mapped straight back in from disk.
+ **/
+typedef uint32_t NodeId;
+
 typedef struct BPTreeInternalNode {
-    struct BPTreeNode* pointers[FANOUT];    // array of pointers to other nodes
-    int vals[FANOUT - 1];                   // array of keys 
+    NodeId children[FANOUT];     // array of links to child nodes
+    int vals[FANOUT - 1];        // array of keys 
 } BPTreeInternalNode;
 
 
 typedef struct BPTreeLeafNode {
+#if BPLUS_COMPRESSED_LEAVES
+    int key_base;                // no key is below this
+    int row_id_base;             // no row id is below this
+    uint8_t key_width;           // bytes per key offset, 1, 2 or 4
+    uint8_t row_id_width;        // bytes per row id offset, 1, 2 or 4
+    // each key's offset from key_base, then after room for as many
+    // as fit at both widths, each row id's offset from row_id_base
+    uint8_t packed[LEAF_PACKED_BYTES];
+#else
     int vals[LEAF_SIZE];         // array of values 
     int positions[LEAF_SIZE];    // array of corresponding positions in base data
+#endif
     
-    struct BPTreeNode* next;     // pointer to next leaf
-    struct BPTreeNode* prev;     // pointer to previous leaf
+    NodeId next;                 // link to next leaf
+    NodeId prev;                 // link to previous leaf
 } BPTreeLeafNode;
 
 
@@ -132,14 +221,37 @@ typedef union BPTreeNodeType {
 
 
 struct BPTreeNode {
+#if BPLUS_KEY_BLOCK
+    // last key of each of KEY_BLOCK_KEYS equal segments of keys,
+    // INT_MAX past last key, first cache line of the node's page
+    int key_block[KEY_BLOCK_KEYS];
+#endif
     int is_leaf;                  // bool for leaf
     int num_vals;                 // number of vals stored
+    uint64_t version;             // odd while write locked, bumped by each write
     BPTreeNodeType type;          // leaf or internal
 
-    struct BPTreeNode* parent;    // pointer to parent node
+    NodeId parent;                // link to parent node
+#if !BPLUS_KEY_BLOCK
+    // room key block would take, so node is still one page
+    int padding[KEY_BLOCK_KEYS];
+#endif
 };
 
 
+/**
+ * Entries of a b+ tree with one key, found by a point lookup
+ * without allocating. Starts at index of leaf and runs on
+ * into following leaves if count passes leaf's end.
+ **/
+typedef struct BPTreeSpan {
+    BPTreeNode* leaf;       // leaf of first entry, NULL if none
+    int index;              // first entry's index in leaf
+    int count;              // entries with key
+    uint64_t version;       // leaf's version when span was found
+} BPTreeSpan;
+
+
 typedef struct UnclusteredIndex {
     int* values; 
     int* positions;
@@ -147,12 +259,79 @@ typedef struct UnclusteredIndex {
 
 
 /**
- * Simple helper struct for finding val pos in leaf node.
+ * Adaptive radix tree node types. Inner nodes hold up to 4, 16,
+ * 48 or 256 children, growing and shrinking as keys come and go.
  **/
-typedef struct LeafIndexRes {
-    BPTreeNode* leaf_node;
-    int index;
-} LeafIndexRes;
+typedef enum ArtNodeType {
+    ART_LEAF,
+    ART_NODE4,
+    ART_NODE16,
+    ART_NODE48,
+    ART_NODE256
+} ArtNodeType;
+
+/**
+ * Header of every ART node. An inner node's prefix holds the key
+ * bytes all keys under it share past its parent's byte, so paths
+ * without branches take no nodes. Keys are only ART_KEY_BYTES long,
+ * so whole prefixes are kept and never need checking against a leaf.
+ **/
+typedef struct ArtNode {
+    uint8_t type;                       // ArtNodeType
+    uint8_t prefix_len;                 // bytes of prefix used
+    uint16_t num_children;
+    uint8_t prefix[ART_KEY_BYTES];
+} ArtNode;
+
+// children sorted by key byte
+typedef struct ArtNode4 {
+    ArtNode node;
+    uint8_t keys[4];
+    ArtNode* children[4];
+} ArtNode4;
+
+// children sorted by key byte, searched with SIMD
+typedef struct ArtNode16 {
+    ArtNode node;
+    uint8_t keys[16];
+    ArtNode* children[16];
+} ArtNode16;
+
+// child_index maps a key byte to its child's index + 1, 0 if none
+typedef struct ArtNode48 {
+    ArtNode node;
+    uint8_t child_index[256];
+    ArtNode* children[48];
+} ArtNode48;
+
+// children indexed directly by key byte
+typedef struct ArtNode256 {
+    ArtNode node;
+    ArtNode* children[256];
+} ArtNode256;
+
+/**
+ * ART leaf, one key and row ids of all rows with it. A key with
+ * a single row id is packed into its parent's child slot instead.
+ **/
+typedef struct ArtLeaf {
+    ArtNode node;
+    int key;
+    int num_row_ids;
+    int capacity;                       // row ids leaf has room for
+    int row_ids[];
+} ArtLeaf;
+
+/**
+ * Adaptive radix tree index over a column, keyed on its vals with
+ * the sign bit flipped, most significant byte first, so the tree's
+ * byte order is val order. Like b+ trees stores stable row ids.
+ **/
+typedef struct ArtTree {
+    ArtNode* root;                      // NULL if empty
+    size_t num_keys;                    // distinct keys, one leaf each
+} ArtTree;
+
 
 /************************************************************/
 
@@ -185,6 +364,46 @@ typedef struct HashTable {
 } HashTable;
 
 
+/**
+ * Blocked bloom filter, each key sets one bit in every
+ * word of a single cache line sized block. Stored as payload
+ * of a Result with data_type BLOOM.
+ **/
+typedef struct BloomFilter {
+    size_t num_blocks;           // power of two
+    int block_bits;              // log2 of num_blocks
+    unsigned long long* words;   // BLOOM_BLOCK_WORDS per block
+} BloomFilter;
+
+
+/**
+ * Slot of join hash table, key and its first build tuple.
+ **/
+typedef struct JoinSlot {
+    int key;
+    unsigned int head;
+} JoinSlot;
+
+/**
+ * Open addressing hash table built once for a join at a known size.
+ * Each slot holds one distinct key, and a one byte tag of its hash
+ * so slots can be filtered 16 at a time. Build tuples with equal keys
+ * are chained through next, which like heads stores index + 1.
+ **/
+typedef struct JoinHashTable {
+    size_t num_slots;          // power of two, at least twice num keys
+    int slot_bits;             // log2 of num_slots
+
+    unsigned char* tags;       // 0 if slot empty, first 16 mirrored at end
+    JoinSlot* slots;           // key and first build tuple of each slot
+
+    unsigned int* next;        // next build tuple with same key
+    int* positions;            // position of each build tuple
+    size_t num_tuples;         // number of build tuples inserted
+    size_t tuple_capacity;     // max build tuples before reset grows table
+} JoinHashTable;
+
+
 /**************************************************************/
 
 
@@ -200,7 +419,8 @@ typedef struct HashTable {
 typedef enum DataType {
      INT,
      LONG,
-     FLOAT
+     FLOAT,
+     BLOOM
 } DataType;
 
 
@@ -212,10 +432,70 @@ typedef enum IndexType {
     BTREE_CLUSTERED,
     BTREE_UNCLUSTERED,
     SORTED_CLUSTERED,
-    SORTED_UNCLUSTERED
+    SORTED_UNCLUSTERED,
+    ART
 } IndexType;
 
 
+/**
+ * Aggregate summary of a column, kept up to date on
+ * inserts, deletes and updates so that full column
+ * aggregates don't need to scan the data.
+ * Also holds sum/min/max partials for each block
+ * of SUMMARY_BLOCK_SIZE rows, which answer aggregates
+ * over a run of positions block by block.
+ **/
+typedef struct ColumnSummary {
+    size_t count;
+    long sum;
+    int min;
+    int max;
+
+    size_t num_blocks;         // number of blocks with partials
+    size_t blocks_capacity;    // number of partials allocated
+    long* block_sums;
+    int* block_mins;
+    int* block_maxs;
+} ColumnSummary;
+
+
+/**
+ * Synopsis of a column used to answer approximate
+ * aggregates without scanning the data. Holds a
+ * uniform reservoir sample of the column's vals and
+ * HyperLogLog registers for distinct counts.
+ **/
+typedef struct ColumnSynopsis {
+    int sample[SAMPLE_SIZE];    // reservoir of sampled vals
+    size_t sample_size;         // number of vals in reservoir
+    size_t num_seen;            // number of vals offered to reservoir
+    unsigned long rng_state;    // state of reservoir's random generator
+    int stale;                  // vals removed since built, rebuild before use
+
+    unsigned char registers[1 << HLL_BITS];    // HyperLogLog registers
+} ColumnSynopsis;
+
+
+/**
+ * Maps the stable row ids b+ tree indexes store to rows'
+ * current positions, so inserts and deletes that move rows
+ * don't rewrite every leaf. An implicit treap holding row
+ * ids in position order, node arrays indexed by row id.
+ **/
+typedef struct PositionMap {
+    int root;
+    int* left;
+    int* right;
+    int* parent;
+    int* size;                  // rows in node's subtree
+    unsigned int* priority;
+
+    size_t num_row_ids;         // row ids handed out, next id is this
+    size_t capacity;            // row ids node arrays have room for
+    unsigned int rng_state;     // state of priority generator
+} PositionMap;
+
+
 typedef struct Column {
     char name[MAX_SIZE_NAME]; 
     int* data;
@@ -224,6 +504,10 @@ typedef struct Column {
     IndexType index_type;
     void* index;
     int clustered;
+
+    ColumnSummary* summary;      // NULL if no summary maintained
+    ColumnSynopsis* synopsis;    // sample and sketch for approximate aggregates
+    PositionMap* position_map;   // table's row id map, NULL while row ids are positions
 } Column;
 
 
@@ -252,6 +536,8 @@ typedef struct Table {
 
     size_t table_length;
     size_t table_length_capacity;
+
+    PositionMap* position_map;   // maps btree and ART indexes' row ids to positions, NULL until rows move
 } Table;
 
 /**
@@ -317,7 +603,8 @@ typedef enum OperatorType {
     BATCH_EXECUTE,
     JOIN,
     UPDATE,
-    DELETE
+    DELETE,
+    SORT
 } OperatorType;
 
 
@@ -346,10 +633,98 @@ typedef struct UpdateOperator {
  **/
 typedef enum JoinType {
     HASH,
-    NESTED_LOOP
+    NESTED_LOOP,
+    SORT_MERGE,
+    INDEX_NESTED_LOOP,
+    ONE_PASS_HASH,
+    AUTO_JOIN
 } JoinType;
 
 
+/**
+ * What a join outputs: matching position pairs, or for semi / anti
+ * joins only the left positions with (or without) a match.
+ **/
+typedef enum JoinMode {
+    INNER_JOIN,
+    SEMI_JOIN,
+    ANTI_JOIN
+} JoinMode;
+
+
+/**
+ * Block of memory handed out by an arena.
+ **/
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;                // bytes in data
+    size_t used;                // bytes handed out
+    char data[];
+} ArenaBlock;
+
+/**
+ * Allocator of fixed size objects in one reserved region of address
+ * space, aligned to SLAB_REGION_BYTES. This header sits at the start
+ * of the region, so an object's slab is found by masking its address.
+ * Objects are never freed on their own, only the whole slab.
+ **/
+typedef struct Slab {
+    size_t object_size;
+    size_t num_objects;         // objects handed out
+    size_t committed;           // bytes of region usable so far
+    int huge_pages;
+
+    pthread_mutex_t lock;       // held by owner while restructuring its objects
+} Slab;
+
+/**
+ * Bump allocator for memory that lives as long as one query,
+ * everything allocated from it is freed together.
+ **/
+typedef struct Arena {
+    ArenaBlock* blocks;         // current block first
+    size_t block_size;
+} Arena;
+
+
+/**
+ * Fixed size chunk of join output, chunks are linked so
+ * output grows without ever copying earlier results.
+ **/
+typedef struct JoinChunk {
+    struct JoinChunk* next;
+    size_t num_results;
+    int left_positions[JOIN_CHUNK_SIZE];
+    int right_positions[JOIN_CHUNK_SIZE];
+} JoinChunk;
+
+/**
+ * Join output, a list of chunks allocated from the join's arena.
+ **/
+typedef struct JoinOutput {
+    Arena* arena;
+    JoinChunk* head;
+    JoinChunk* tail;
+    size_t num_results;
+} JoinOutput;
+
+
+/*
+ * What the join cost model knows about its inputs.
+ */
+typedef struct JoinStats {
+    size_t left_num_vals;
+    size_t right_num_vals;
+    size_t left_distinct;       // estimated distinct vals
+    size_t right_distinct;
+    int left_sorted;            // 1 if vals already in order
+    int right_sorted;
+
+    size_t index_num_vals;      // rows of indexed base column side, 0 if none
+    size_t outer_num_vals;      // rows of other side if index_num_vals set
+} JoinStats;
+
+
 /*
  * necessary fields for joining
  */
@@ -359,7 +734,13 @@ typedef struct JoinOperator {
     Result* pos_2;
     Result* val_2;
 
+    // set instead of val / pos to join on all rows of a base column
+    Column* col_1;
+    Column* col_2;
+
     JoinType type;
+    JoinMode mode;
+    int explain;          // 1 to send chosen algorithm back to client
 } JoinOperator;
 
 
@@ -372,7 +753,11 @@ typedef enum AggregateType {
     SUM,
     AVG,
     ADD,
-    SUB
+    SUB,
+    APPROX_SUM,
+    APPROX_AVG,
+    APPROX_DISTINCT,
+    BUILD_BLOOM
 } AggregateType;
 
 /*
@@ -385,6 +770,16 @@ typedef struct AggregateOperator {
 } AggregateOperator;
 
 
+/*
+ * necessary fields for sorting / top-k
+ */
+typedef struct SortOperator {
+    CHandle* chandle_1;    // values, or positions if chandle_2 set
+    CHandle* chandle_2;    // values if positions passed, else NULL
+    size_t k;              // for top-k, number of largest values to return, 0 for full sort
+} SortOperator;
+
+
 /*
  * necessary fields for printing
  */
@@ -421,6 +816,7 @@ typedef struct Comparator {
     long int p_high;    // used in range compares. 
     ComparatorType type1;
     ComparatorType type2;
+    BloomFilter* filter;    // if set, vals must also pass filter
 } Comparator;
 
 
@@ -450,7 +846,8 @@ typedef enum CreateType {
     CREATE_DB,
     CREATE_TBL,
     CREATE_COL,
-    CREATE_IDX
+    CREATE_IDX,
+    CREATE_SUMMARY
 } CreateType;
 
 
@@ -483,6 +880,7 @@ typedef union OperatorFields {
     JoinOperator join_operator;
     UpdateOperator update_operator;
     DeleteOperator delete_operator;
+    SortOperator sort_operator;
 } OperatorFields;
 
 /*
@@ -527,13 +925,45 @@ void hash_insert(HashTable* hash_table, int key, int val);
  * Returns NULL if not found, else returns int pointer to value.
  **/
 int* hash_probe(HashTable* hash_table, int key, int* num_results);
+
+
+/**
+ * Initializes a join hash table that fits num_tuples build tuples.
+ **/
+JoinHashTable* init_join_hashtable(size_t num_tuples);
+
+
+/**
+ * Empties join hash table for reuse with num_tuples build
+ * tuples, growing it if needed.
+ **/
+void reset_join_hashtable(JoinHashTable* hash_table, size_t num_tuples);
+
+
+/**
+ * Given join hash table, key and position, inserts into table.
+ **/
+void join_hash_insert(JoinHashTable* hash_table, int key, int position);
+
+
+/**
+ * Given join hash table and key, returns index + 1 of first build
+ * tuple with key, or 0 if none. Remaining matches follow next.
+ **/
+unsigned int join_hash_probe(JoinHashTable* hash_table, int key);
+
+
+/**
+ * Frees join hash table.
+ **/
+void free_join_hashtable(JoinHashTable* hash_table);
 /**********************************************************/
 
 
 /***********************************************************/
 /* Functions for dumping and loading database to/from disk */
-void* load_bptree(FILE* fd, int* base_data);
-void dump_bptree(FILE* fd, BPTreeNode* root, int* base_data); 
+BPTreeNode* load_bptree(FILE* fd);
+void dump_bptree(FILE* fd, BPTreeNode* root);
 void free_node(BPTreeNode* node);
 
 /**
@@ -558,6 +988,7 @@ void create_db(const char* db_name, Status* status);
 Table* create_table(const char* name, const char* db_name, unsigned int col_capacity, Status* status);
 Column* create_column(const char* name, const char* table_name, Status* status);
 void create_idx(const char* col_name, IndexType index_type, Status* status);
+void create_summary(const char* col_name, Status* status);
 
 
 void insert_object(LookupTable* lookup_table, const char* object_name, void* object, LookupType type);
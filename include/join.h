@@ -0,0 +1,52 @@
+/**
+ * Contains function definitions for the join
+ * kernels used by the join operator.
+ **/
+
+#include "cs165_api.h"
+
+void init_join_output(JoinOutput* output);
+void join_output_splice(JoinOutput* output, JoinOutput* other);
+size_t join_output_materialize(JoinOutput* output, int** left_positions, int** right_positions);
+
+void nested_loop_join(
+        int* smaller_vals, int* smaller_positions, int smaller_num_vals,
+        int* bigger_vals, int* bigger_positions, int bigger_num_vals,
+        int smaller_left, JoinOutput* output
+    );
+
+void hash_join(
+        int* smaller_vals, int* smaller_positions, int smaller_num_vals,
+        int* bigger_vals, int* bigger_positions, int bigger_num_vals,
+        int smaller_left, JoinOutput* output
+    );
+
+void radix_join(
+        int* left_vals, int* left_positions, int left_num_vals,
+        int* right_vals, int* right_positions, int right_num_vals,
+        JoinOutput* output
+    );
+
+void sort_merge_join(
+        int* left_vals, int* left_positions, int left_num_vals,
+        int* right_vals, int* right_positions, int right_num_vals,
+        JoinOutput* output
+    );
+
+void index_nested_loop_join(
+        int* outer_vals, int* outer_positions, int outer_num_vals, Column* inner_column,
+        int outer_left, JoinOutput* output
+    );
+
+size_t semi_join(
+        int* outer_vals, int* outer_positions, int outer_num_vals,
+        int* inner_vals, int inner_num_vals,
+        int anti, int** result
+    );
+
+size_t join_memory_budget(void);
+size_t estimate_distinct(int* vals, size_t num_vals);
+int estimate_sorted(int* vals, size_t num_vals);
+double estimate_join_cost(JoinStats* stats, JoinType type);
+JoinType choose_join_type(JoinStats* stats, JoinType hint);
+const char* join_type_name(JoinType type);
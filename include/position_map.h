@@ -0,0 +1,17 @@
+/**
+ * Contains function definitions for mapping
+ * stable row ids to current row positions.
+ **/
+
+#include "cs165_api.h"
+
+PositionMap* create_position_map(size_t num_rows);
+int position_map_insert(PositionMap* map, int pos);
+int position_map_remove(PositionMap* map, int pos);
+int position_of(PositionMap* map, int row_id);
+int row_id_at(PositionMap* map, int pos);
+void position_map_row_ids(PositionMap* map, int* row_ids);
+void positions_of(PositionMap* map, int* ids, size_t num_ids);
+void dump_position_map(FILE* fd, PositionMap* map);
+PositionMap* load_position_map(FILE* fd);
+void free_position_map(PositionMap* map);
@@ -0,0 +1,13 @@
+/**
+ * Contains function definitions for slab
+ * allocation of fixed size objects.
+ **/
+
+#include "cs165_api.h"
+
+Slab* create_slab(size_t object_size, int huge_pages);
+Slab* map_slab(int fd, off_t offset, size_t num_objects, size_t object_size);
+void* slab_alloc(Slab* slab);
+void* slab_object(Slab* slab, size_t index);
+Slab* slab_of(void* object);
+void free_slab(Slab* slab);
@@ -0,0 +1,11 @@
+/**
+ * Contains function definitions for sorting
+ * values along with their positions.
+ **/
+
+#include "cs165_api.h"
+
+int is_sorted(int* data, size_t num_items);
+
+void radix_sort_pairs(int* keys, int* vals, size_t num_items);
+size_t top_k_pairs(int* keys, int* vals, size_t num_items, size_t k, int* top_keys, int* top_vals);
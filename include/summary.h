@@ -0,0 +1,15 @@
+/**
+ * Contains function definitions for maintaining
+ * per column aggregate summaries.
+ **/
+
+#include "cs165_api.h"
+
+ColumnSummary* build_summary(int* data, size_t num_items);
+void free_summary(ColumnSummary* summary);
+
+void summary_append(ColumnSummary* summary, int val);
+void summary_refresh(ColumnSummary* summary, int* data, size_t num_items, size_t from_pos);
+
+void summary_range(ColumnSummary* summary, int* data, size_t start, size_t end, long* sum, int* min, int* max);
+size_t summary_range_positions(ColumnSummary* summary, int* data, size_t start, size_t end, int val, int* positions);
@@ -0,0 +1,20 @@
+/**
+ * Contains function definitions for column synopses:
+ * reservoir samples and HyperLogLog sketches used for
+ * approximate aggregates.
+ **/
+
+#include "cs165_api.h"
+
+ColumnSynopsis* build_synopsis(int* data, size_t num_items);
+void free_synopsis(ColumnSynopsis* synopsis);
+void synopsis_add(ColumnSynopsis* synopsis, int val);
+void synopsis_refresh(ColumnSynopsis* synopsis, int* data, size_t num_items);
+
+unsigned long next_random(unsigned long* state);
+void sample_rows(int* data, size_t num_rows, int* sample, size_t sample_size, unsigned long* rng_state);
+
+void hll_add(unsigned char* registers, int val);
+double hll_estimate(unsigned char* registers, double* error_bound);
+
+double sample_estimate(int* sample, size_t sample_size, size_t num_rows, AggregateType type, double* error_bound);
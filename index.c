@@ -4,6 +4,7 @@
  **/
 
 #include "index.h"
+#include "position_map.h"
 
 
 /**
@@ -113,18 +114,19 @@ void sorted_insert(UnclusteredIndex* index, int num_items, int val, int pos, int
 
 
 /**
- * Given val and pos and a column,
- * insert's into index if applicable.
+ * Given val, its row's pos and row id, and a column,
+ * insert's into index if applicable. B+ trees and ARTs
+ * store row ids, so only sorted arrays shift positions.
  **/
-void index_value(Column* column, int val, int pos, int dont_update) {
-    int update_vals = 0;
-
+void index_value(Column* column, int val, int pos, int row_id, int dont_update) {
     switch (column->index_type) {
         case BTREE_UNCLUSTERED:
-            update_vals = !dont_update && column->clustered && (unsigned int) pos != column->col_size;        
         case BTREE_CLUSTERED: {
             // insert into btree
-            column->index = bplus_insert((BPTreeNode*) column->index, val, pos, update_vals);
+            column->index = bplus_insert((BPTreeNode*) column->index, val, row_id);
+            break;
+        } case ART: {
+            art_insert((ArtTree*) column->index, val, row_id);
             break;
         } case SORTED_UNCLUSTERED: {
             sorted_insert((UnclusteredIndex*) column->index, column->col_size, val, pos, column->clustered && !dont_update);
@@ -133,3 +135,30 @@ void index_value(Column* column, int val, int pos, int dont_update) {
             break;
     }
 }
+
+
+/**
+ * Returns table's position map, creating it over the table's
+ * current rows if it has none yet. Returns NULL if no column
+ * has a b+ tree or ART index, when there are no row ids to map.
+ **/
+PositionMap* table_position_map(Table* table) {
+    if (table->position_map != NULL) {
+        return table->position_map;
+    }
+
+    int has_row_ids = 0;
+    for (size_t i = 0; i < table->col_count; i++) {
+        IndexType index_type = table->columns[i].index_type;
+        has_row_ids |= index_type == BTREE_CLUSTERED || index_type == BTREE_UNCLUSTERED || index_type == ART;
+    }
+    if (!has_row_ids) {
+        return NULL;
+    }
+
+    table->position_map = create_position_map(table->table_length);
+    for (size_t i = 0; i < table->col_count; i++) {
+        table->columns[i].position_map = table->position_map;
+    }
+    return table->position_map;
+}
@@ -0,0 +1,1860 @@
+#define _XOPEN_SOURCE 600
+/**
+ * Contains all join kernels: nested loop, index nested
+ * loop, one pass hash, radix partitioned hash and sort-merge joins.
+ **/
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "join.h"
+#if NESTED_LOOP_SIMD && defined(__AVX2__)
+#include <immintrin.h>
+#elif NESTED_LOOP_SIMD && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "hash_table.h"
+#include "sort.h"
+#include "bplus.h"
+#include "art.h"
+#include "arena.h"
+#include "position_map.h"
+
+// max partitioning fan-out per pass, kept small so the
+// write-combining buffers and their pages stay in L1 / TLB
+#define RADIX_BITS_PER_PASS 7
+#define MAX_RADIX_PASSES 2
+
+// target number of tuples of smaller side per final partition,
+// so each partition's hash table fits in L2
+#define PARTITION_TARGET_TUPLES 8192
+
+// tuples per write-combining buffer, one cache line
+#define SWWC_TUPLES (64 / sizeof(JoinTuple))
+
+#define MAX_JOIN_THREADS 8
+
+// below this many total input vals join on a single thread
+#define PARALLEL_JOIN_THRESHOLD (1 << 16)
+
+// inner vals compared against each outer val per vector step
+#define NESTED_LOOP_STEP 16
+
+// semi joins use a bitmap over the inner key range if it needs no
+// more than this many bits per inner val, else a hash set
+#define SEMI_JOIN_BITMAP_BITS 16
+
+// number of outer vals whose index probes are interleaved
+#define INDEX_PROBE_BATCH 16
+
+// rough per tuple costs used by the join cost model, in ns
+#define COST_COMPARE 0.1          // one vectorized nested loop comparison
+#define COST_SEQUENTIAL 1.0       // one tuple of a sequential pass
+#define COST_CACHED_PROBE 4.0     // hash table access that hits cache
+#define COST_RANDOM_PROBE 25.0    // hash table access that misses cache
+#define COST_INDEX_STEP 6.0       // one binary search / tree step
+
+// bytes per build tuple of a join hash table
+#define JOIN_TABLE_TUPLE_BYTES 26
+
+// a hinted algorithm is overridden if this many times costlier than best
+#define JOIN_HINT_OVERRIDE_FACTOR 4.0
+
+// number of vals sampled to estimate distinct count
+#define DISTINCT_SAMPLE_SIZE 1024
+
+// partitioning fan-out per spill pass, bounds open temp files
+#define SPILL_BITS_PER_PASS 6
+// tuples buffered per spill partition before one sequential write
+#define SPILL_BUFFER_TUPLES 8192
+// cost of writing a tuple to a spill file and reading it back
+#define COST_SPILL 20.0
+
+// vals sampled per side to find heavy hitter keys
+#define HEAVY_SAMPLE_SIZE 4096
+// a key is heavy if it is at least 1 / HEAVY_HITTER_SHARE of the
+// sample and estimated to overflow a partition on its own
+#define HEAVY_HITTER_SHARE 64
+#define MAX_HEAVY_HITTERS 16
+// slots of heavy hitter lookup table, power of 2
+#define HEAVY_TABLE_SLOTS 64
+
+
+/**
+ * (val, position) pair that is partitioned together.
+ **/
+typedef struct JoinTuple {
+    int val;
+    int pos;
+} JoinTuple;
+
+
+/**
+ * Keys frequent enough to skew partitioning, with a small
+ * open addressing table from key hash to index in keys.
+ **/
+typedef struct HeavyHitters {
+    int num_keys;
+    int keys[MAX_HEAVY_HITTERS];
+    signed char slots[HEAVY_TABLE_SLOTS];
+} HeavyHitters;
+
+
+/**
+ * One join input split into tuples of light keys, which are
+ * partitioned as usual, and positions of each heavy key.
+ **/
+typedef struct SkewSplit {
+    int* light_vals;
+    int* light_positions;
+    size_t num_light;
+    int* heavy_positions;
+    size_t heavy_offsets[MAX_HEAVY_HITTERS + 1];
+} SkewSplit;
+
+
+/**
+ * Cache line sized software write-combining buffer.
+ **/
+typedef struct SWWCBuffer {
+    JoinTuple tuples[SWWC_TUPLES];
+} __attribute__((aligned(64))) SWWCBuffer;
+
+
+/**
+ * First level partitions of both join sides, plus the
+ * queue of partitions that worker threads pull from.
+ **/
+typedef struct RadixJoinState {
+    JoinTuple* left_tuples;
+    JoinTuple* left_scratch;
+    size_t* left_offsets;
+    JoinTuple* right_tuples;
+    JoinTuple* right_scratch;
+    size_t* right_offsets;
+
+    int total_bits;
+    int first_bits;
+
+    size_t* tasks;          // first level partitions, largest first
+    size_t num_tasks;
+    size_t next_task;
+    pthread_mutex_t task_lock;
+} RadixJoinState;
+
+
+/**
+ * Simple struct for radix join thread function parameters.
+ **/
+typedef struct radixJoinParams {
+    // partitioning phase
+    int* vals;
+    int* positions;
+    JoinTuple* tuples_in;
+    JoinTuple* tuples_out;
+    size_t start;
+    size_t end;
+    int shift;
+    int bits;
+    size_t* histogram;    // per partition counts, turned into offsets before scatter
+
+    // build / probe phase
+    RadixJoinState* state;
+    JoinOutput output;
+} radixJoinParams;
+
+
+// chunks must tile arena blocks exactly, fails to compile otherwise
+typedef char join_chunks_fill_arena_block[JOIN_ARENA_BLOCK_SIZE % sizeof(JoinChunk) == 0 ? 1 : -1];
+
+/**
+ * Initializes empty join output with its own arena.
+ **/
+void init_join_output(JoinOutput* output) {
+    output->arena = create_arena(JOIN_ARENA_BLOCK_SIZE);
+    output->head = NULL;
+    output->tail = NULL;
+    output->num_results = 0;
+}
+
+
+/**
+ * Appends one pair of matching positions to output,
+ * starting a new chunk from the arena if the last is full.
+ **/
+static inline void join_output_append(JoinOutput* output, int left_position, int right_position) {
+    JoinChunk* chunk = output->tail;
+    if (chunk == NULL || chunk->num_results == JOIN_CHUNK_SIZE) {
+        chunk = arena_alloc(output->arena, sizeof(JoinChunk));
+        chunk->next = NULL;
+        chunk->num_results = 0;
+        if (output->tail == NULL) {
+            output->head = chunk;
+        } else {
+            output->tail->next = chunk;
+        }
+        output->tail = chunk;
+    }
+
+    chunk->left_positions[chunk->num_results] = left_position;
+    chunk->right_positions[chunk->num_results] = right_position;
+    chunk->num_results++;
+    output->num_results++;
+}
+
+
+/**
+ * Appends pair of positions where first is left side's if first_left.
+ **/
+static inline void join_output_add(JoinOutput* output, int first_position, int second_position, int first_left) {
+    if (first_left) {
+        join_output_append(output, first_position, second_position);
+    } else {
+        join_output_append(output, second_position, first_position);
+    }
+}
+
+
+/**
+ * Moves other's chunks onto end of output, taking over its arena.
+ **/
+void join_output_splice(JoinOutput* output, JoinOutput* other) {
+    if (other->head != NULL) {
+        if (output->tail == NULL) {
+            output->head = other->head;
+        } else {
+            output->tail->next = other->head;
+        }
+        output->tail = other->tail;
+        output->num_results += other->num_results;
+    }
+    arena_absorb(output->arena, other->arena);
+
+    other->arena = NULL;
+    other->head = NULL;
+    other->tail = NULL;
+    other->num_results = 0;
+}
+
+
+/**
+ * Stitches output's chunks into new left and right position
+ * arrays, then frees output's arena. Returns number of results.
+ **/
+size_t join_output_materialize(JoinOutput* output, int** left_positions, int** right_positions) {
+    *left_positions = malloc(sizeof(int) * (output->num_results + 1));
+    *right_positions = malloc(sizeof(int) * (output->num_results + 1));
+
+    size_t num_copied = 0;
+    for (JoinChunk* chunk = output->head; chunk != NULL; chunk = chunk->next) {
+        memcpy(&(*left_positions)[num_copied], chunk->left_positions, sizeof(int) * chunk->num_results);
+        memcpy(&(*right_positions)[num_copied], chunk->right_positions, sizeof(int) * chunk->num_results);
+        num_copied += chunk->num_results;
+    }
+
+    free_arena(output->arena);
+    output->arena = NULL;
+    output->head = NULL;
+    output->tail = NULL;
+    return num_copied;
+}
+
+
+/**
+ * Returns number of bytes of a cache level, or default if unknown.
+ **/
+static size_t cache_size(int name, size_t default_size) {
+    long size = sysconf(name);
+    return size > 0 ? (size_t) size : default_size;
+}
+
+
+/**
+ * Returns inner and outer block sizes, in vals, for the nested loop
+ * join. Inner blocks stay in L1 while each outer val is compared
+ * against them and outer blocks stay in L2 across inner blocks.
+ * Sizes are read from the cache sizes once, on first use.
+ **/
+static void nested_loop_block_sizes(size_t* inner_block, size_t* outer_block) {
+    static size_t inner = 0;
+    static size_t outer = 0;
+    if (!inner) {
+        // half of each cache for vals, rest for positions and output
+        outer = cache_size(_SC_LEVEL2_CACHE_SIZE, 1 << 20) / (2 * sizeof(int));
+        inner = cache_size(_SC_LEVEL1_DCACHE_SIZE, 32 << 10) / (2 * sizeof(int));
+        // whole number of vector steps per block
+        inner -= inner % NESTED_LOOP_STEP;
+    }
+    *inner_block = inner;
+    *outer_block = outer;
+}
+
+
+/**
+ * Returns bitmask of which of the NESTED_LOOP_STEP vals
+ * starting at vals equal key, bit i set for vals[i].
+ **/
+static inline unsigned int nested_loop_matches(int* vals, int key) {
+#if NESTED_LOOP_SIMD && defined(__AVX2__)
+    __m256i broadcast = _mm256_set1_epi32(key);
+    __m256i low = _mm256_cmpeq_epi32(_mm256_loadu_si256((__m256i*) vals), broadcast);
+    __m256i high = _mm256_cmpeq_epi32(_mm256_loadu_si256((__m256i*) &vals[8]), broadcast);
+    return (unsigned int) _mm256_movemask_ps(_mm256_castsi256_ps(low))
+        | ((unsigned int) _mm256_movemask_ps(_mm256_castsi256_ps(high)) << 8);
+#elif NESTED_LOOP_SIMD && defined(__SSE2__)
+    // compare 4 vectors, narrow results to one byte per val
+    __m128i broadcast = _mm_set1_epi32(key);
+    __m128i cmp0 = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i*) vals), broadcast);
+    __m128i cmp1 = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i*) &vals[4]), broadcast);
+    __m128i cmp2 = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i*) &vals[8]), broadcast);
+    __m128i cmp3 = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i*) &vals[12]), broadcast);
+    __m128i packed = _mm_packs_epi16(_mm_packs_epi32(cmp0, cmp1), _mm_packs_epi32(cmp2, cmp3));
+    return (unsigned int) _mm_movemask_epi8(packed);
+#else
+    unsigned int matches = 0;
+    for (int i = 0; i < NESTED_LOOP_STEP; i++) {
+        matches |= (unsigned int) (vals[i] == key) << i;
+    }
+    return matches;
+#endif
+}
+
+
+/**
+ * Given smaller vals, positions and count,
+ * bigger vals, positions and count, whether
+ * smaller is the left side and join output,
+ * execute nested loop join.
+ *
+ * Blocked so an L1 sized block of smaller vals is compared against
+ * an L2 sized block of bigger vals. Each bigger val is broadcast and
+ * compared against NESTED_LOOP_STEP smaller vals at once, and only
+ * the set bits of the match mask are turned into output.
+ **/
+void nested_loop_join(
+        int* smaller_vals, int* smaller_positions, int smaller_num_vals,
+        int* bigger_vals, int* bigger_positions, int bigger_num_vals,
+        int smaller_left, JoinOutput* output
+    ) {
+    size_t inner_block, outer_block;
+    nested_loop_block_sizes(&inner_block, &outer_block);
+
+    for (size_t bigger_start = 0; bigger_start < (size_t) bigger_num_vals; bigger_start += outer_block) {
+        size_t bigger_end = bigger_start + outer_block < (size_t) bigger_num_vals
+            ? bigger_start + outer_block : (size_t) bigger_num_vals;
+
+        for (size_t smaller_start = 0; smaller_start < (size_t) smaller_num_vals; smaller_start += inner_block) {
+            size_t smaller_end = smaller_start + inner_block < (size_t) smaller_num_vals
+                ? smaller_start + inner_block : (size_t) smaller_num_vals;
+            // vals past last full step are compared one at a time
+            size_t vector_end = smaller_start + (smaller_end - smaller_start) / NESTED_LOOP_STEP * NESTED_LOOP_STEP;
+
+            for (size_t bigger_pos = bigger_start; bigger_pos < bigger_end; bigger_pos++) {
+                int key = bigger_vals[bigger_pos];
+
+                for (size_t smaller_pos = smaller_start; smaller_pos < vector_end; smaller_pos += NESTED_LOOP_STEP) {
+                    unsigned int matches = nested_loop_matches(&smaller_vals[smaller_pos], key);
+                    while (matches) {
+                        size_t match_pos = smaller_pos + __builtin_ctz(matches);
+                        join_output_add(output, smaller_positions[match_pos], bigger_positions[bigger_pos], smaller_left);
+                        matches &= matches - 1;
+                    }
+                }
+
+                for (size_t smaller_pos = vector_end; smaller_pos < smaller_end; smaller_pos++) {
+                    if (smaller_vals[smaller_pos] == key) {
+                        join_output_add(output, smaller_positions[smaller_pos], bigger_positions[bigger_pos], smaller_left);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+/**
+ * Given smaller vals, positions and count,
+ * bigger vals, positions and count, whether
+ * smaller is the left side and join output,
+ * execute one pass hash join.
+ **/
+void hash_join(
+        int* smaller_vals, int* smaller_positions, int smaller_num_vals,
+        int* bigger_vals, int* bigger_positions, int bigger_num_vals,
+        int smaller_left, JoinOutput* output
+    ) {
+
+    // build hash table on smaller vals
+    JoinHashTable* hash_table = init_join_hashtable(smaller_num_vals);
+    for (int i = 0; i < smaller_num_vals; i++) {
+        join_hash_insert(hash_table, smaller_vals[i], smaller_positions[i]);
+    }
+
+    // probe table on bigger vals
+    for (int i = 0; i < bigger_num_vals; i++) {
+        for (unsigned int j = join_hash_probe(hash_table, bigger_vals[i]); j; j = hash_table->next[j - 1]) {
+            join_output_add(output, hash_table->positions[j - 1], bigger_positions[i], smaller_left);
+        }
+    }
+
+    free_join_hashtable(hash_table);
+}
+
+
+/**
+ * Hashes join key, high bits pick partitions.
+ * Works on the key's bits so negative keys are fine.
+ **/
+static inline unsigned int join_hash(int key) {
+    unsigned int hash = (unsigned int) key;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+
+/**
+ * Returns partition of key for given shift and bits.
+ **/
+static inline unsigned int radix_partition_of(int key, int shift, int bits) {
+    if (!bits) {
+        return 0;
+    }
+    return (join_hash(key) >> shift) & ((1u << bits) - 1);
+}
+
+
+/**
+ * Counts tuples of in[start:end] per partition into histogram.
+ **/
+void radix_histogram_chunk(JoinTuple* in, size_t start, size_t end, int shift, int bits, size_t* histogram) {
+    memset(histogram, 0, sizeof(size_t) * (1 << bits));
+    for (size_t i = start; i < end; i++) {
+        histogram[radix_partition_of(in[i].val, shift, bits)]++;
+    }
+}
+
+
+/**
+ * Scatters tuples of in[start:end] to out starting at each
+ * partition's dest offset, through write-combining buffers
+ * so partitions are written a cache line at a time.
+ **/
+void radix_scatter_chunk(JoinTuple* in, JoinTuple* out, size_t start, size_t end, int shift, int bits, size_t* dest) {
+    size_t num_partitions = 1 << bits;
+
+    SWWCBuffer* buffers;
+    if (posix_memalign((void**) &buffers, 64, sizeof(SWWCBuffer) * num_partitions)) {
+        buffers = malloc(sizeof(SWWCBuffer) * num_partitions);
+    }
+    unsigned char* buffer_sizes = calloc(num_partitions, sizeof(unsigned char));
+
+    for (size_t i = start; i < end; i++) {
+        unsigned int p = radix_partition_of(in[i].val, shift, bits);
+        buffers[p].tuples[buffer_sizes[p]++] = in[i];
+
+        // flush full line to partition
+        if (buffer_sizes[p] == SWWC_TUPLES) {
+            memcpy(&out[dest[p]], buffers[p].tuples, sizeof(SWWCBuffer));
+            dest[p] += SWWC_TUPLES;
+            buffer_sizes[p] = 0;
+        }
+    }
+
+    // flush remaining partial lines
+    for (size_t p = 0; p < num_partitions; p++) {
+        memcpy(&out[dest[p]], buffers[p].tuples, sizeof(JoinTuple) * buffer_sizes[p]);
+        dest[p] += buffer_sizes[p];
+    }
+
+    free(buffers);
+    free(buffer_sizes);
+}
+
+
+/**
+ * Partitions num_tuples tuples from in to out on the given
+ * hash bits on the calling thread. Histograms first so each
+ * partition's exact offset is known, then scatters.
+ * Fills offsets with num_partitions + 1 starting offsets.
+ **/
+void radix_partition(JoinTuple* in, JoinTuple* out, size_t num_tuples, int shift, int bits, size_t* offsets) {
+    size_t num_partitions = 1 << bits;
+
+    radix_histogram_chunk(in, 0, num_tuples, shift, bits, offsets);
+
+    // prefix sum into starting offsets
+    size_t total = 0;
+    for (size_t p = 0; p < num_partitions; p++) {
+        size_t count = offsets[p];
+        offsets[p] = total;
+        total += count;
+    }
+    offsets[num_partitions] = total;
+
+    size_t* dest = malloc(sizeof(size_t) * num_partitions);
+    memcpy(dest, offsets, sizeof(size_t) * num_partitions);
+    radix_scatter_chunk(in, out, 0, num_tuples, shift, bits, dest);
+    free(dest);
+}
+
+
+/**
+ * Thread function to pack one chunk of vals and positions
+ * into tuples and histogram it.
+ **/
+void* join_histogram_thread(void* context) {
+    radixJoinParams* params = (radixJoinParams*) context;
+
+    for (size_t i = params->start; i < params->end; i++) {
+        params->tuples_in[i].val = params->vals[i];
+        params->tuples_in[i].pos = params->positions[i];
+    }
+    radix_histogram_chunk(params->tuples_in, params->start, params->end, params->shift, params->bits, params->histogram);
+    return NULL;
+}
+
+
+/**
+ * Thread function to scatter one chunk of tuples
+ * using its precomputed offsets.
+ **/
+void* join_scatter_thread(void* context) {
+    radixJoinParams* params = (radixJoinParams*) context;
+    radix_scatter_chunk(params->tuples_in, params->tuples_out, params->start, params->end, params->shift, params->bits, params->histogram);
+    return NULL;
+}
+
+
+/**
+ * Returns number of threads to join num_vals total vals with.
+ **/
+int num_join_threads(size_t num_vals) {
+    if (num_vals < PARALLEL_JOIN_THRESHOLD) {
+        return 1;
+    }
+
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_cpus < 1) {
+        num_cpus = 1;
+    }
+    return num_cpus > MAX_JOIN_THREADS ? MAX_JOIN_THREADS : (int) num_cpus;
+}
+
+
+/**
+ * Runs func over all params, on threads if more than one.
+ **/
+void run_join_phase(void* (*func)(void*), radixJoinParams* params, int num_threads) {
+    if (num_threads == 1) {
+        func(&params[0]);
+        return;
+    }
+
+    pthread_t threads[MAX_JOIN_THREADS];
+    for (int t = 0; t < num_threads; t++) {
+        pthread_create(&threads[t], NULL, func, &params[t]);
+    }
+    for (int t = 0; t < num_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+}
+
+
+/**
+ * Packs vals and positions into tuples and partitions them into
+ * scratch on the first pass bits, every thread histogramming and
+ * then scattering its own chunk. Fills offsets with 2^bits + 1
+ * starting offsets into scratch.
+ **/
+void radix_partition_side(
+        int* vals, int* positions, size_t num_vals, JoinTuple* tuples, JoinTuple* scratch,
+        int shift, int bits, size_t* offsets, radixJoinParams* params, int num_threads
+    ) {
+    size_t num_partitions = 1 << bits;
+    size_t* histograms = malloc(sizeof(size_t) * num_partitions * num_threads);
+
+    // split vals into a chunk per thread
+    size_t chunk_size = num_vals / num_threads;
+    for (int t = 0; t < num_threads; t++) {
+        params[t].vals = vals;
+        params[t].positions = positions;
+        params[t].tuples_in = tuples;
+        params[t].tuples_out = scratch;
+        params[t].start = t * chunk_size;
+        params[t].end = t == num_threads - 1 ? num_vals : (t + 1) * chunk_size;
+        params[t].shift = shift;
+        params[t].bits = bits;
+        params[t].histogram = &histograms[t * num_partitions];
+    }
+
+    run_join_phase(join_histogram_thread, params, num_threads);
+
+    // prefix sum into offsets, partition major then thread
+    size_t offset = 0;
+    for (size_t p = 0; p < num_partitions; p++) {
+        offsets[p] = offset;
+        for (int t = 0; t < num_threads; t++) {
+            size_t count = params[t].histogram[p];
+            params[t].histogram[p] = offset;
+            offset += count;
+        }
+    }
+    offsets[num_partitions] = offset;
+
+    run_join_phase(join_scatter_thread, params, num_threads);
+
+    free(histograms);
+}
+
+
+/**
+ * Joins one pair of co-partitioned tuple runs, building the given
+ * join hash table on the build side and probing with the other.
+ * Appends matches to output, build side is left if build_left.
+ **/
+void join_partition(
+        JoinTuple* build, size_t build_size,
+        JoinTuple* probe, size_t probe_size,
+        int build_left, JoinHashTable* hash_table, JoinOutput* output
+    ) {
+    if (!build_size || !probe_size) {
+        return;
+    }
+
+    reset_join_hashtable(hash_table, build_size);
+    for (size_t i = 0; i < build_size; i++) {
+        join_hash_insert(hash_table, build[i].val, build[i].pos);
+    }
+
+    for (size_t i = 0; i < probe_size; i++) {
+        for (unsigned int j = join_hash_probe(hash_table, probe[i].val); j; j = hash_table->next[j - 1]) {
+            join_output_add(output, hash_table->positions[j - 1], probe[i].pos, build_left);
+        }
+    }
+}
+
+
+/**
+ * Joins a pair of co-partitioned runs, building on the smaller one.
+ **/
+static inline void join_partition_pair(
+        JoinTuple* left, size_t left_size,
+        JoinTuple* right, size_t right_size,
+        JoinHashTable* hash_table, JoinOutput* output
+    ) {
+    if (left_size < right_size) {
+        join_partition(left, left_size, right, right_size, 1, hash_table, output);
+    } else {
+        join_partition(right, right_size, left, left_size, 0, hash_table, output);
+    }
+}
+
+
+/**
+ * Worker thread function for the build / probe phase. Repeatedly
+ * takes the next first level partition off the shared queue, refines
+ * it with a second partitioning pass if needed and joins it, so
+ * large partitions don't leave other threads idle.
+ **/
+void* join_partition_thread(void* context) {
+    radixJoinParams* params = (radixJoinParams*) context;
+    RadixJoinState* state = params->state;
+
+    int second_bits = state->total_bits - state->first_bits;
+    size_t num_second = 1 << second_bits;
+    size_t* left_sub_offsets = malloc(sizeof(size_t) * (num_second + 1));
+    size_t* right_sub_offsets = malloc(sizeof(size_t) * (num_second + 1));
+
+    // one table per thread, reset for each partition
+    JoinHashTable* hash_table = init_join_hashtable(PARTITION_TARGET_TUPLES);
+
+    while (1) {
+        // get next partition
+        pthread_mutex_lock(&state->task_lock);
+        size_t task = state->next_task++;
+        pthread_mutex_unlock(&state->task_lock);
+        if (task >= state->num_tasks) {
+            break;
+        }
+
+        size_t p = state->tasks[task];
+        size_t left_start = state->left_offsets[p];
+        size_t left_size = state->left_offsets[p + 1] - left_start;
+        size_t right_start = state->right_offsets[p];
+        size_t right_size = state->right_offsets[p + 1] - right_start;
+
+        if (!left_size || !right_size) {
+            continue;
+        }
+
+        if (!second_bits) {
+            join_partition_pair(
+                &state->left_scratch[left_start], left_size,
+                &state->right_scratch[right_start], right_size,
+                hash_table, &params->output
+            );
+            continue;
+        }
+
+        // second pass back into original tuple arrays
+        JoinTuple* left_sub = &state->left_tuples[left_start];
+        JoinTuple* right_sub = &state->right_tuples[right_start];
+        int shift = 32 - state->total_bits;
+        radix_partition(&state->left_scratch[left_start], left_sub, left_size, shift, second_bits, left_sub_offsets);
+        radix_partition(&state->right_scratch[right_start], right_sub, right_size, shift, second_bits, right_sub_offsets);
+
+        for (size_t s = 0; s < num_second; s++) {
+            join_partition_pair(
+                &left_sub[left_sub_offsets[s]], left_sub_offsets[s + 1] - left_sub_offsets[s],
+                &right_sub[right_sub_offsets[s]], right_sub_offsets[s + 1] - right_sub_offsets[s],
+                hash_table, &params->output
+            );
+        }
+    }
+
+    free_join_hashtable(hash_table);
+    free(left_sub_offsets);
+    free(right_sub_offsets);
+    return NULL;
+}
+
+
+/**
+ * Orders partition sizes largest first.
+ **/
+static int compare_partition_sizes(const void* a, const void* b) {
+    size_t size_a = ((const size_t*) a)[0];
+    size_t size_b = ((const size_t*) b)[0];
+    return (size_a < size_b) - (size_a > size_b);
+}
+
+
+/**
+ * Returns bytes of working memory joins may use, JOIN_MEMORY_BUDGET
+ * unless overridden by the JOIN_MEMORY_BUDGET environment variable.
+ **/
+size_t join_memory_budget(void) {
+    static size_t budget = 0;
+    if (!budget) {
+        char* env = getenv("JOIN_MEMORY_BUDGET");
+        unsigned long long env_budget = env ? strtoull(env, NULL, 10) : 0;
+        budget = env_budget ? (size_t) env_budget : JOIN_MEMORY_BUDGET;
+    }
+    return budget;
+}
+
+
+/**
+ * Returns bytes the in memory radix join needs for given inputs,
+ * tuple and scratch arrays plus a partition table per thread.
+ **/
+static size_t radix_join_bytes(size_t left_num_vals, size_t right_num_vals) {
+    return (left_num_vals + right_num_vals) * 2 * sizeof(JoinTuple)
+        + MAX_JOIN_THREADS * PARTITION_TARGET_TUPLES * JOIN_TABLE_TUPLE_BYTES;
+}
+
+
+/**
+ * Run of tuples written to a temp file.
+ **/
+typedef struct SpillFile {
+    FILE* file;
+    size_t num_tuples;
+} SpillFile;
+
+
+/**
+ * Partitions a stream of tuples into temp files, buffering each
+ * partition so files are only written in large sequential blocks.
+ **/
+typedef struct SpillPartitioner {
+    SpillFile* files;
+    JoinTuple* buffers;
+    size_t* buffer_sizes;
+    int shift;
+    int bits;
+} SpillPartitioner;
+
+
+/**
+ * Closes all partition files and frees them.
+ **/
+static void free_spill_files(SpillFile* files, size_t num_files) {
+    for (size_t i = 0; i < num_files; i++) {
+        if (files[i].file) {
+            fclose(files[i].file);
+        }
+    }
+    free(files);
+}
+
+
+/**
+ * Sets up partitioner writing 1 << bits partitions on
+ * hash bits starting at shift. Returns 0 if temp files
+ * couldn't be created.
+ **/
+static int init_spill_partitioner(SpillPartitioner* partitioner, int shift, int bits) {
+    size_t num_partitions = 1 << bits;
+    partitioner->shift = shift;
+    partitioner->bits = bits;
+    partitioner->files = calloc(num_partitions, sizeof(SpillFile));
+    partitioner->buffers = malloc(sizeof(JoinTuple) * SPILL_BUFFER_TUPLES * num_partitions);
+    partitioner->buffer_sizes = calloc(num_partitions, sizeof(size_t));
+
+    for (size_t p = 0; p < num_partitions; p++) {
+        partitioner->files[p].file = tmpfile();
+        if (!partitioner->files[p].file) {
+            free_spill_files(partitioner->files, p);
+            free(partitioner->buffers);
+            free(partitioner->buffer_sizes);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/**
+ * Writes partition p's buffered tuples to its file.
+ **/
+static void spill_flush(SpillPartitioner* partitioner, size_t p) {
+    size_t count = partitioner->buffer_sizes[p];
+    if (count) {
+        fwrite(&partitioner->buffers[p * SPILL_BUFFER_TUPLES], sizeof(JoinTuple), count, partitioner->files[p].file);
+        partitioner->files[p].num_tuples += count;
+        partitioner->buffer_sizes[p] = 0;
+    }
+}
+
+
+/**
+ * Adds tuple to its partition's buffer, flushing when full.
+ **/
+static inline void spill_add(SpillPartitioner* partitioner, int val, int pos) {
+    size_t p = radix_partition_of(val, partitioner->shift, partitioner->bits);
+    JoinTuple* tuple = &partitioner->buffers[p * SPILL_BUFFER_TUPLES + partitioner->buffer_sizes[p]];
+    tuple->val = val;
+    tuple->pos = pos;
+    if (++partitioner->buffer_sizes[p] == SPILL_BUFFER_TUPLES) {
+        spill_flush(partitioner, p);
+    }
+}
+
+
+/**
+ * Flushes all buffers, rewinds the partition files for
+ * reading and returns them. Frees the partitioner's buffers.
+ **/
+static SpillFile* finish_spill_partitioner(SpillPartitioner* partitioner) {
+    size_t num_partitions = 1 << partitioner->bits;
+    for (size_t p = 0; p < num_partitions; p++) {
+        spill_flush(partitioner, p);
+        rewind(partitioner->files[p].file);
+    }
+    free(partitioner->buffers);
+    free(partitioner->buffer_sizes);
+    return partitioner->files;
+}
+
+
+/**
+ * Reads up to max_tuples of file into tuples, returns number read.
+ **/
+static size_t spill_read(SpillFile* file, JoinTuple* tuples, size_t max_tuples) {
+    return fread(tuples, sizeof(JoinTuple), max_tuples, file->file);
+}
+
+
+/**
+ * Repartitions a spilled run into 1 << bits new runs on the
+ * hash bits starting at shift, reading it in large blocks.
+ * Returns NULL if temp files couldn't be created.
+ **/
+static SpillFile* spill_repartition(SpillFile* in, int shift, int bits) {
+    SpillPartitioner partitioner;
+    if (!init_spill_partitioner(&partitioner, shift, bits)) {
+        return NULL;
+    }
+
+    JoinTuple* block = malloc(sizeof(JoinTuple) * SPILL_BUFFER_TUPLES);
+    size_t count;
+    while ((count = spill_read(in, block, SPILL_BUFFER_TUPLES))) {
+        for (size_t i = 0; i < count; i++) {
+            spill_add(&partitioner, block[i].val, block[i].pos);
+        }
+    }
+    free(block);
+    return finish_spill_partitioner(&partitioner);
+}
+
+
+/**
+ * Joins a pair of spilled runs that can't be split further, e.g.
+ * a single heavy key. Loads build run a budget sized block at a time
+ * and streams the probe run past each block.
+ **/
+static void spill_block_join(SpillFile* left, SpillFile* right, size_t budget, JoinOutput* output) {
+    int build_left = left->num_tuples <= right->num_tuples;
+    SpillFile* build = build_left ? left : right;
+    SpillFile* probe = build_left ? right : left;
+
+    size_t block_tuples = budget / (sizeof(JoinTuple) + JOIN_TABLE_TUPLE_BYTES);
+    if (block_tuples < SPILL_BUFFER_TUPLES) {
+        block_tuples = SPILL_BUFFER_TUPLES;
+    }
+    if (block_tuples > build->num_tuples) {
+        block_tuples = build->num_tuples;
+    }
+
+    JoinTuple* build_block = malloc(sizeof(JoinTuple) * block_tuples);
+    JoinTuple* probe_block = malloc(sizeof(JoinTuple) * SPILL_BUFFER_TUPLES);
+    JoinHashTable* hash_table = init_join_hashtable(block_tuples);
+
+    size_t build_count;
+    while ((build_count = spill_read(build, build_block, block_tuples))) {
+        reset_join_hashtable(hash_table, build_count);
+        for (size_t i = 0; i < build_count; i++) {
+            join_hash_insert(hash_table, build_block[i].val, build_block[i].pos);
+        }
+
+        rewind(probe->file);
+        size_t probe_count;
+        while ((probe_count = spill_read(probe, probe_block, SPILL_BUFFER_TUPLES))) {
+            for (size_t i = 0; i < probe_count; i++) {
+                for (unsigned int j = join_hash_probe(hash_table, probe_block[i].val); j; j = hash_table->next[j - 1]) {
+                    join_output_add(output, hash_table->positions[j - 1], probe_block[i].pos, build_left);
+                }
+            }
+        }
+    }
+
+    free_join_hashtable(hash_table);
+    free(build_block);
+    free(probe_block);
+}
+
+
+/**
+ * Joins a pair of co-partitioned spilled runs. Runs that fit in
+ * budget are loaded and joined in memory, bigger ones are split
+ * on the next hash bits and joined pairwise recursively.
+ **/
+static void spill_join_runs(SpillFile* left, SpillFile* right, int shift, size_t budget, JoinOutput* output) {
+    if (!left->num_tuples || !right->num_tuples) {
+        return;
+    }
+
+    size_t smaller = left->num_tuples < right->num_tuples ? left->num_tuples : right->num_tuples;
+    size_t bytes = (left->num_tuples + right->num_tuples) * sizeof(JoinTuple) + smaller * JOIN_TABLE_TUPLE_BYTES;
+    if (bytes <= budget) {
+        JoinTuple* left_tuples = malloc(sizeof(JoinTuple) * left->num_tuples);
+        JoinTuple* right_tuples = malloc(sizeof(JoinTuple) * right->num_tuples);
+        spill_read(left, left_tuples, left->num_tuples);
+        spill_read(right, right_tuples, right->num_tuples);
+
+        JoinHashTable* hash_table = init_join_hashtable(smaller);
+        join_partition_pair(left_tuples, left->num_tuples, right_tuples, right->num_tuples, hash_table, output);
+        free_join_hashtable(hash_table);
+        free(left_tuples);
+        free(right_tuples);
+        return;
+    }
+
+    // out of hash bits, keys too skewed to split
+    int bits = shift < SPILL_BITS_PER_PASS ? shift : SPILL_BITS_PER_PASS;
+    if (!bits) {
+        spill_block_join(left, right, budget, output);
+        return;
+    }
+
+    shift -= bits;
+    size_t num_partitions = 1 << bits;
+    SpillFile* left_parts = spill_repartition(left, shift, bits);
+    SpillFile* right_parts = left_parts ? spill_repartition(right, shift, bits) : NULL;
+    if (!right_parts) {
+        // no room for more temp files, join what we have in blocks
+        if (left_parts) {
+            free_spill_files(left_parts, num_partitions);
+        }
+        rewind(left->file);
+        rewind(right->file);
+        spill_block_join(left, right, budget, output);
+        return;
+    }
+
+    for (size_t p = 0; p < num_partitions; p++) {
+        spill_join_runs(&left_parts[p], &right_parts[p], shift, budget, output);
+        // done with pair, free its disk space early
+        fclose(left_parts[p].file);
+        fclose(right_parts[p].file);
+        left_parts[p].file = NULL;
+        right_parts[p].file = NULL;
+    }
+    free_spill_files(left_parts, num_partitions);
+    free_spill_files(right_parts, num_partitions);
+}
+
+
+/**
+ * Spills one join input into partition files on the top hash bits.
+ * Returns NULL if temp files couldn't be created.
+ **/
+static SpillFile* spill_join_input(int* vals, int* positions, size_t num_vals, int bits) {
+    SpillPartitioner partitioner;
+    if (!init_spill_partitioner(&partitioner, 32 - bits, bits)) {
+        return NULL;
+    }
+    for (size_t i = 0; i < num_vals; i++) {
+        spill_add(&partitioner, vals[i], positions[i]);
+    }
+    return finish_spill_partitioner(&partitioner);
+}
+
+
+/**
+ * Given left and right vals, positions and counts, executes a
+ * grace hash join within budget bytes of working memory. Both sides
+ * are hash partitioned into temp files with large sequential writes,
+ * then each partition pair is reloaded and joined on its own,
+ * repartitioning pairs that still don't fit.
+ * Returns 0 if temp files couldn't be created.
+ **/
+static int spill_join(
+        int* left_vals, int* left_positions, int left_num_vals,
+        int* right_vals, int* right_positions, int right_num_vals,
+        size_t budget, JoinOutput* output
+    ) {
+    // enough partitions that the average pair fits in budget
+    size_t total_bytes = ((size_t) left_num_vals + right_num_vals) * (sizeof(JoinTuple) + JOIN_TABLE_TUPLE_BYTES);
+    int bits = 1;
+    while ((total_bytes >> bits) > budget && bits < SPILL_BITS_PER_PASS) {
+        bits++;
+    }
+
+    size_t num_partitions = 1 << bits;
+    SpillFile* left_parts = spill_join_input(left_vals, left_positions, left_num_vals, bits);
+    if (!left_parts) {
+        return 0;
+    }
+    SpillFile* right_parts = spill_join_input(right_vals, right_positions, right_num_vals, bits);
+    if (!right_parts) {
+        free_spill_files(left_parts, num_partitions);
+        return 0;
+    }
+
+    for (size_t p = 0; p < num_partitions; p++) {
+        spill_join_runs(&left_parts[p], &right_parts[p], 32 - bits, budget, output);
+        fclose(left_parts[p].file);
+        fclose(right_parts[p].file);
+        left_parts[p].file = NULL;
+        right_parts[p].file = NULL;
+    }
+    free_spill_files(left_parts, num_partitions);
+    free_spill_files(right_parts, num_partitions);
+    return 1;
+}
+
+
+/**
+ * Returns index of key among heavy hitters, or -1 if not heavy.
+ **/
+static inline int heavy_hitter_index(HeavyHitters* heavy, int key) {
+    size_t slot = join_hash(key) & (HEAVY_TABLE_SLOTS - 1);
+    while (heavy->slots[slot] >= 0) {
+        if (heavy->keys[(int) heavy->slots[slot]] == key) {
+            return heavy->slots[slot];
+        }
+        slot = (slot + 1) & (HEAVY_TABLE_SLOTS - 1);
+    }
+    return -1;
+}
+
+
+/**
+ * Orders ints ascending.
+ **/
+static int compare_ints(const void* a, const void* b) {
+    int int_a = *(const int*) a;
+    int int_b = *(const int*) b;
+    return (int_a > int_b) - (int_a < int_b);
+}
+
+
+/**
+ * Samples vals and adds keys heavy enough to make a partition
+ * much bigger than PARTITION_TARGET_TUPLES to heavy.
+ **/
+static void find_heavy_hitters(int* vals, size_t num_vals, HeavyHitters* heavy) {
+    if (num_vals / HEAVY_HITTER_SHARE <= PARTITION_TARGET_TUPLES) {
+        return;
+    }
+
+    // strided sample, sorted so equal keys are adjacent
+    size_t stride = num_vals / HEAVY_SAMPLE_SIZE;
+    int* sample = malloc(sizeof(int) * HEAVY_SAMPLE_SIZE);
+    for (size_t i = 0; i < HEAVY_SAMPLE_SIZE; i++) {
+        sample[i] = vals[i * stride];
+    }
+    qsort(sample, HEAVY_SAMPLE_SIZE, sizeof(int), compare_ints);
+
+    size_t run_start = 0;
+    for (size_t i = 1; i <= HEAVY_SAMPLE_SIZE; i++) {
+        if (i < HEAVY_SAMPLE_SIZE && sample[i] == sample[run_start]) {
+            continue;
+        }
+
+        size_t estimated = (i - run_start) * stride;
+        int key = sample[run_start];
+        run_start = i;
+        if (estimated < num_vals / HEAVY_HITTER_SHARE || estimated <= PARTITION_TARGET_TUPLES
+                || heavy->num_keys == MAX_HEAVY_HITTERS || heavy_hitter_index(heavy, key) >= 0) {
+            continue;
+        }
+
+        size_t slot = join_hash(key) & (HEAVY_TABLE_SLOTS - 1);
+        while (heavy->slots[slot] >= 0) {
+            slot = (slot + 1) & (HEAVY_TABLE_SLOTS - 1);
+        }
+        heavy->slots[slot] = heavy->num_keys;
+        heavy->keys[heavy->num_keys++] = key;
+    }
+
+    free(sample);
+}
+
+
+/**
+ * Splits vals and positions into light tuples
+ * and positions grouped by heavy key.
+ **/
+static void split_heavy_hitters(int* vals, int* positions, size_t num_vals, HeavyHitters* heavy, SkewSplit* split) {
+    // count each heavy key to lay out its positions
+    size_t counts[MAX_HEAVY_HITTERS] = {0};
+    size_t num_heavy = 0;
+    for (size_t i = 0; i < num_vals; i++) {
+        int index = heavy_hitter_index(heavy, vals[i]);
+        if (index >= 0) {
+            counts[index]++;
+            num_heavy++;
+        }
+    }
+
+    split->heavy_offsets[0] = 0;
+    for (int k = 0; k < heavy->num_keys; k++) {
+        split->heavy_offsets[k + 1] = split->heavy_offsets[k] + counts[k];
+        counts[k] = split->heavy_offsets[k];
+    }
+
+    split->num_light = num_vals - num_heavy;
+    split->light_vals = malloc(sizeof(int) * (split->num_light + 1));
+    split->light_positions = malloc(sizeof(int) * (split->num_light + 1));
+    split->heavy_positions = malloc(sizeof(int) * (num_heavy + 1));
+
+    size_t num_light = 0;
+    for (size_t i = 0; i < num_vals; i++) {
+        int index = heavy_hitter_index(heavy, vals[i]);
+        if (index >= 0) {
+            split->heavy_positions[counts[index]++] = positions[i];
+        } else {
+            split->light_vals[num_light] = vals[i];
+            split->light_positions[num_light++] = positions[i];
+        }
+    }
+}
+
+
+/**
+ * Joins the heavy keys of both sides. Every left position of a heavy
+ * key matches every right position of it, so the matches are written
+ * out directly without hashing.
+ **/
+static void join_heavy_hitters(HeavyHitters* heavy, SkewSplit* left, SkewSplit* right, JoinOutput* output) {
+    for (int k = 0; k < heavy->num_keys; k++) {
+        for (size_t l = left->heavy_offsets[k]; l < left->heavy_offsets[k + 1]; l++) {
+            for (size_t r = right->heavy_offsets[k]; r < right->heavy_offsets[k + 1]; r++) {
+                join_output_append(output, left->heavy_positions[l], right->heavy_positions[r]);
+            }
+        }
+    }
+}
+
+
+/**
+ * Frees split's arrays.
+ **/
+static void free_skew_split(SkewSplit* split) {
+    free(split->light_vals);
+    free(split->light_positions);
+    free(split->heavy_positions);
+}
+
+
+/**
+ * Radix partitioned hash join of the light keys.
+ *
+ * Both sides are partitioned in parallel on the same hash bits, with
+ * as few passes as keep fan-out TLB friendly. Worker threads then pull
+ * first level partitions off a shared queue, largest first, finish
+ * partitioning them and join each partition pair into their own
+ * outputs, which are linked onto output at the end.
+ *
+ * If that wouldn't fit in the join memory budget, partitions
+ * are spilled to temp files and joined one at a time instead.
+ **/
+static void radix_join_partitioned(
+        int* left_vals, int* left_positions, int left_num_vals,
+        int* right_vals, int* right_positions, int right_num_vals,
+        JoinOutput* output
+    ) {
+    size_t budget = join_memory_budget();
+    if (radix_join_bytes(left_num_vals, right_num_vals) > budget
+            && spill_join(left_vals, left_positions, left_num_vals,
+                right_vals, right_positions, right_num_vals, budget, output)) {
+        return;
+    }
+
+    // pick number of bits so smaller side's partitions fit in cache
+    size_t smaller_num_vals = left_num_vals < right_num_vals ? left_num_vals : right_num_vals;
+    int total_bits = 0;
+    while ((smaller_num_vals >> total_bits) > PARTITION_TARGET_TUPLES
+            && total_bits < RADIX_BITS_PER_PASS * MAX_RADIX_PASSES) {
+        total_bits++;
+    }
+
+    RadixJoinState state;
+    state.total_bits = total_bits;
+    state.first_bits = total_bits > RADIX_BITS_PER_PASS ? RADIX_BITS_PER_PASS : total_bits;
+    size_t num_first = 1 << state.first_bits;
+
+    state.left_tuples = malloc(sizeof(JoinTuple) * (left_num_vals + 1));
+    state.left_scratch = malloc(sizeof(JoinTuple) * (left_num_vals + 1));
+    state.left_offsets = malloc(sizeof(size_t) * (num_first + 1));
+    state.right_tuples = malloc(sizeof(JoinTuple) * (right_num_vals + 1));
+    state.right_scratch = malloc(sizeof(JoinTuple) * (right_num_vals + 1));
+    state.right_offsets = malloc(sizeof(size_t) * (num_first + 1));
+
+    int num_threads = num_join_threads(left_num_vals + right_num_vals);
+    radixJoinParams params[MAX_JOIN_THREADS];
+    memset(params, 0, sizeof(params));
+
+    // first partitioning pass on highest bits
+    int shift = 32 - state.first_bits;
+    radix_partition_side(
+        left_vals, left_positions, left_num_vals, state.left_tuples, state.left_scratch,
+        shift, state.first_bits, state.left_offsets, params, num_threads
+    );
+    radix_partition_side(
+        right_vals, right_positions, right_num_vals, state.right_tuples, state.right_scratch,
+        shift, state.first_bits, state.right_offsets, params, num_threads
+    );
+
+    // queue partitions largest first
+    size_t* sizes = malloc(sizeof(size_t) * 2 * num_first);
+    for (size_t p = 0; p < num_first; p++) {
+        sizes[2 * p] = state.left_offsets[p + 1] - state.left_offsets[p]
+            + state.right_offsets[p + 1] - state.right_offsets[p];
+        sizes[2 * p + 1] = p;
+    }
+    qsort(sizes, num_first, 2 * sizeof(size_t), compare_partition_sizes);
+
+    state.tasks = malloc(sizeof(size_t) * num_first);
+    for (size_t p = 0; p < num_first; p++) {
+        state.tasks[p] = sizes[2 * p + 1];
+    }
+    state.num_tasks = num_first;
+    state.next_task = 0;
+    pthread_mutex_init(&state.task_lock, NULL);
+
+    // build / probe phase, each thread into its own output
+    for (int t = 0; t < num_threads; t++) {
+        params[t].state = &state;
+        init_join_output(&params[t].output);
+    }
+    run_join_phase(join_partition_thread, params, num_threads);
+
+    // link thread outputs together
+    for (int t = 0; t < num_threads; t++) {
+        join_output_splice(output, &params[t].output);
+    }
+
+    pthread_mutex_destroy(&state.task_lock);
+    free(sizes);
+    free(state.tasks);
+    free(state.left_tuples);
+    free(state.left_scratch);
+    free(state.left_offsets);
+    free(state.right_tuples);
+    free(state.right_scratch);
+    free(state.right_offsets);
+}
+
+
+/**
+ * Given left vals, positions and count,
+ * right vals, positions and count and
+ * join output, execute radix partitioned hash join.
+ *
+ * Heavy hitter keys of either side are found from a sample first
+ * and split off so they can't swamp one partition. Their matches
+ * are a cross product per key, written out directly, and the
+ * remaining keys are partitioned evenly.
+ **/
+void radix_join(
+        int* left_vals, int* left_positions, int left_num_vals,
+        int* right_vals, int* right_positions, int right_num_vals,
+        JoinOutput* output
+    ) {
+    HeavyHitters heavy;
+    heavy.num_keys = 0;
+    memset(heavy.slots, -1, sizeof(heavy.slots));
+    find_heavy_hitters(left_vals, left_num_vals, &heavy);
+    find_heavy_hitters(right_vals, right_num_vals, &heavy);
+
+    if (!heavy.num_keys) {
+        radix_join_partitioned(
+            left_vals, left_positions, left_num_vals,
+            right_vals, right_positions, right_num_vals, output
+        );
+        return;
+    }
+
+    SkewSplit left_split, right_split;
+    split_heavy_hitters(left_vals, left_positions, left_num_vals, &heavy, &left_split);
+    split_heavy_hitters(right_vals, right_positions, right_num_vals, &heavy, &right_split);
+
+    join_heavy_hitters(&heavy, &left_split, &right_split, output);
+    radix_join_partitioned(
+        left_split.light_vals, left_split.light_positions, left_split.num_light,
+        right_split.light_vals, right_split.light_positions, right_split.num_light, output
+    );
+
+    free_skew_split(&left_split);
+    free_skew_split(&right_split);
+}
+
+
+/**
+ * Given vals and positions, returns them sorted by val in
+ * sorted_vals and sorted_positions. Returns 1 if copies were
+ * made and sorted, 0 if input was already in order and used as is.
+ **/
+int sort_join_input(int* vals, int* positions, size_t num_vals, int** sorted_vals, int** sorted_positions) {
+    if (is_sorted(vals, num_vals)) {
+        *sorted_vals = vals;
+        *sorted_positions = positions;
+        return 0;
+    }
+
+    *sorted_vals = malloc(sizeof(int) * num_vals);
+    *sorted_positions = malloc(sizeof(int) * num_vals);
+    memcpy(*sorted_vals, vals, sizeof(int) * num_vals);
+    memcpy(*sorted_positions, positions, sizeof(int) * num_vals);
+    radix_sort_pairs(*sorted_vals, *sorted_positions, num_vals);
+    return 1;
+}
+
+
+/**
+ * Given left vals, positions and count,
+ * right vals, positions and count and
+ * join output, execute sort-merge join.
+ *
+ * Sides that aren't already in order (e.g. fetched from sorted or
+ * clustered columns) are copied and radix sorted in parallel first.
+ * The merge emits the cross product of each run of equal keys.
+ **/
+void sort_merge_join(
+        int* left_vals, int* left_positions, int left_num_vals,
+        int* right_vals, int* right_positions, int right_num_vals,
+        JoinOutput* output
+    ) {
+    int* left_sorted_vals;
+    int* left_sorted_positions;
+    int* right_sorted_vals;
+    int* right_sorted_positions;
+    int left_copied = sort_join_input(left_vals, left_positions, left_num_vals, &left_sorted_vals, &left_sorted_positions);
+    int right_copied = sort_join_input(right_vals, right_positions, right_num_vals, &right_sorted_vals, &right_sorted_positions);
+
+    int left_pos = 0;
+    int right_pos = 0;
+    while (left_pos < left_num_vals && right_pos < right_num_vals) {
+        int left_val = left_sorted_vals[left_pos];
+        int right_val = right_sorted_vals[right_pos];
+
+        if (left_val < right_val) {
+            left_pos++;
+        } else if (left_val > right_val) {
+            right_pos++;
+        } else {
+            // find end of run of equal keys on each side
+            int left_end = left_pos + 1;
+            while (left_end < left_num_vals && left_sorted_vals[left_end] == left_val) {
+                left_end++;
+            }
+            int right_end = right_pos + 1;
+            while (right_end < right_num_vals && right_sorted_vals[right_end] == right_val) {
+                right_end++;
+            }
+
+            for (int l = left_pos; l < left_end; l++) {
+                for (int r = right_pos; r < right_end; r++) {
+                    join_output_append(output, left_sorted_positions[l], right_sorted_positions[r]);
+                }
+            }
+
+            left_pos = left_end;
+            right_pos = right_end;
+        }
+    }
+
+    if (left_copied) {
+        free(left_sorted_vals);
+        free(left_sorted_positions);
+    }
+    if (right_copied) {
+        free(right_sorted_vals);
+        free(right_sorted_positions);
+    }
+}
+
+
+/**
+ * Probes a sorted index for a batch of outer vals. Binary searches
+ * run in lock step, prefetching every search's next probe so their
+ * cache misses overlap. Sets starts to each val's first index.
+ **/
+void sorted_probe_batch(int* sorted_vals, int num_items, int* outer_vals, int batch_size, int* starts) {
+    int lows[INDEX_PROBE_BATCH];
+    int highs[INDEX_PROBE_BATCH];
+    for (int b = 0; b < batch_size; b++) {
+        lows[b] = 0;
+        highs[b] = num_items;
+    }
+
+    int searching = 1;
+    while (searching) {
+        searching = 0;
+        for (int b = 0; b < batch_size; b++) {
+            if (lows[b] >= highs[b]) {
+                continue;
+            }
+
+            int middle = (lows[b] + highs[b]) / 2;
+            if (sorted_vals[middle] < outer_vals[b]) {
+                lows[b] = middle + 1;
+            } else {
+                highs[b] = middle;
+            }
+
+            if (lows[b] < highs[b]) {
+                __builtin_prefetch(&sorted_vals[(lows[b] + highs[b]) / 2]);
+                searching = 1;
+            }
+        }
+    }
+
+    memcpy(starts, lows, sizeof(int) * batch_size);
+}
+
+
+/**
+ * Given outer vals, positions and count, a base column with
+ * a sorted, b+ tree or ART index, whether outer is the left side
+ * and join output, execute index nested loop join.
+ *
+ * Outer vals are probed against the index in batches, so cost is
+ * proportional to the outer side rather than the indexed column.
+ **/
+void index_nested_loop_join(
+        int* outer_vals, int* outer_positions, int outer_num_vals, Column* inner_column,
+        int outer_left, JoinOutput* output
+    ) {
+    int starts[INDEX_PROBE_BATCH];
+    BPTreeSpan spans[INDEX_PROBE_BATCH];
+    int* span_ids = NULL;
+    int span_ids_capacity = 0;
+    int num_items = inner_column->col_size;
+
+    for (int batch_start = 0; batch_start < outer_num_vals; batch_start += INDEX_PROBE_BATCH) {
+        int batch_size = outer_num_vals - batch_start < INDEX_PROBE_BATCH ? outer_num_vals - batch_start : INDEX_PROBE_BATCH;
+        int* batch_vals = &outer_vals[batch_start];
+
+        switch (inner_column->index_type) {
+            case SORTED_CLUSTERED:
+            case SORTED_UNCLUSTERED: {
+                int* sorted_vals = inner_column->data;
+                int* sorted_positions = NULL;
+                if (inner_column->index_type == SORTED_UNCLUSTERED) {
+                    sorted_vals = ((UnclusteredIndex*) inner_column->index)->values;
+                    sorted_positions = ((UnclusteredIndex*) inner_column->index)->positions;
+                }
+
+                sorted_probe_batch(sorted_vals, num_items, batch_vals, batch_size, starts);
+
+                for (int b = 0; b < batch_size; b++) {
+                    for (int i = starts[b]; i < num_items && sorted_vals[i] == batch_vals[b]; i++) {
+                        join_output_add(output, outer_positions[batch_start + b], sorted_positions != NULL ? sorted_positions[i] : i, outer_left);
+                    }
+                }
+                break;
+            } case BTREE_CLUSTERED:
+              case BTREE_UNCLUSTERED: {
+                if (inner_column->index == NULL) {
+                    return;
+                }
+
+                find_spans((BPTreeNode*) inner_column->index, batch_vals, batch_size, spans);
+
+                for (int b = 0; b < batch_size; b++) {
+                    // copy span's row ids, finding it again if a leaf changed since
+                    while (spans[b].count > span_ids_capacity || !span_row_ids(&spans[b], span_ids)) {
+                        if (spans[b].count > span_ids_capacity) {
+                            span_ids_capacity = spans[b].count;
+                            span_ids = realloc(span_ids, sizeof(int) * span_ids_capacity);
+                        } else {
+                            find_span((BPTreeNode*) inner_column->index, batch_vals[b], &spans[b]);
+                        }
+                    }
+
+                    for (int i = 0; i < spans[b].count; i++) {
+                        int inner_position = position_of(inner_column->position_map, span_ids[i]);
+                        join_output_add(output, outer_positions[batch_start + b], inner_position, outer_left);
+                    }
+                }
+                break;
+            } case ART: {
+                ArtTree* tree = (ArtTree*) inner_column->index;
+
+                // each outer val's matches are all under its one entry
+                for (int b = 0; b < batch_size; b++) {
+                    int packed_row_id;
+                    int* row_ids;
+                    int num_row_ids = art_search(tree, batch_vals[b], &packed_row_id, &row_ids);
+                    for (int i = 0; i < num_row_ids; i++) {
+                        int inner_position = position_of(inner_column->position_map, row_ids[i]);
+                        join_output_add(output, outer_positions[batch_start + b], inner_position, outer_left);
+                    }
+                }
+                break;
+            } default:
+                return;
+        }
+    }
+
+    free(span_ids);
+}
+
+
+/**
+ * Set of inner keys for semi and anti joins. Either a bitmap over
+ * [min, max] or an open addressing hash set of distinct keys, which
+ * uses 0 as empty and tracks whether 0 itself is in the set.
+ **/
+typedef struct JoinKeySet {
+    unsigned long long* bitmap;
+    int min;
+    unsigned long long range;
+    int* keys;
+    size_t mask;
+    int has_zero;
+} JoinKeySet;
+
+
+/**
+ * Builds key set of vals, a bitmap if the key range is dense enough.
+ **/
+static void build_join_key_set(JoinKeySet* set, int* vals, size_t num_vals) {
+    memset(set, 0, sizeof(JoinKeySet));
+    if (!num_vals) {
+        return;
+    }
+
+    int min = vals[0];
+    int max = vals[0];
+    for (size_t i = 1; i < num_vals; i++) {
+        min = vals[i] < min ? vals[i] : min;
+        max = vals[i] > max ? vals[i] : max;
+    }
+
+    set->min = min;
+    set->range = (unsigned long long) ((long long) max - min) + 1;
+    if (set->range <= (unsigned long long) num_vals * SEMI_JOIN_BITMAP_BITS) {
+        set->bitmap = calloc((set->range + 63) / 64, sizeof(unsigned long long));
+        for (size_t i = 0; i < num_vals; i++) {
+            unsigned long long bit = (unsigned long long) ((long long) vals[i] - min);
+            set->bitmap[bit >> 6] |= 1ull << (bit & 63);
+        }
+        return;
+    }
+
+    // at most half full
+    size_t num_slots = 2;
+    while (num_slots < 2 * num_vals) {
+        num_slots <<= 1;
+    }
+    set->mask = num_slots - 1;
+    set->keys = calloc(num_slots, sizeof(int));
+    for (size_t i = 0; i < num_vals; i++) {
+        int key = vals[i];
+        if (!key) {
+            set->has_zero = 1;
+            continue;
+        }
+        size_t slot = join_hash(key) & set->mask;
+        while (set->keys[slot] && set->keys[slot] != key) {
+            slot = (slot + 1) & set->mask;
+        }
+        set->keys[slot] = key;
+    }
+}
+
+
+/**
+ * Returns 1 if key is in set, stopping at the first match.
+ **/
+static inline int join_key_set_contains(JoinKeySet* set, int key) {
+    if (set->bitmap != NULL) {
+        unsigned long long bit = (unsigned long long) ((long long) key - set->min);
+        return bit < set->range && (set->bitmap[bit >> 6] >> (bit & 63)) & 1;
+    }
+    if (set->keys == NULL) {
+        return 0;
+    }
+    if (!key) {
+        return set->has_zero;
+    }
+
+    size_t slot = join_hash(key) & set->mask;
+    while (set->keys[slot]) {
+        if (set->keys[slot] == key) {
+            return 1;
+        }
+        slot = (slot + 1) & set->mask;
+    }
+    return 0;
+}
+
+
+/**
+ * Given outer vals, positions and count, inner vals and
+ * count and whether this is an anti join, sets result to the
+ * outer positions that have a match in inner (or have none
+ * for an anti join), in outer order and each at most once.
+ * Returns number of positions in result.
+ **/
+size_t semi_join(
+        int* outer_vals, int* outer_positions, int outer_num_vals,
+        int* inner_vals, int inner_num_vals,
+        int anti, int** result
+    ) {
+    JoinKeySet set;
+    build_join_key_set(&set, inner_vals, inner_num_vals);
+
+    *result = malloc(sizeof(int) * (outer_num_vals + 1));
+    size_t num_results = 0;
+    for (int i = 0; i < outer_num_vals; i++) {
+        // branch free append
+        (*result)[num_results] = outer_positions[i];
+        num_results += join_key_set_contains(&set, outer_vals[i]) != anti;
+    }
+
+    free(set.bitmap);
+    free(set.keys);
+    return num_results;
+}
+
+
+/**
+ * Estimates number of distinct vals from an evenly strided sample.
+ * Keys are assumed unique unless the sample repeats, else uses the
+ * GEE estimator: vals seen once in the sample are scaled up by
+ * sqrt(num_vals / sample_size), vals seen more than once count once.
+ **/
+size_t estimate_distinct(int* vals, size_t num_vals) {
+    if (num_vals <= 1) {
+        return num_vals;
+    }
+
+    size_t sample_size = num_vals < DISTINCT_SAMPLE_SIZE ? num_vals : DISTINCT_SAMPLE_SIZE;
+    int* sample = malloc(sizeof(int) * sample_size);
+    int* positions = malloc(sizeof(int) * sample_size);
+    size_t stride = num_vals / sample_size;
+    for (size_t i = 0; i < sample_size; i++) {
+        sample[i] = vals[i * stride];
+        positions[i] = i;
+    }
+    radix_sort_pairs(sample, positions, sample_size);
+
+    // count vals seen once and vals seen more than once
+    size_t num_singles = 0;
+    size_t num_repeated = 0;
+    size_t run_start = 0;
+    for (size_t i = 1; i <= sample_size; i++) {
+        if (i == sample_size || sample[i] != sample[run_start]) {
+            if (i - run_start == 1) {
+                num_singles++;
+            } else {
+                num_repeated++;
+            }
+            run_start = i;
+        }
+    }
+    free(sample);
+    free(positions);
+
+    if (num_singles == sample_size) {
+        return num_vals;
+    }
+    return (size_t) (sqrt((double) num_vals / sample_size) * num_singles) + num_repeated;
+}
+
+
+/**
+ * Estimates whether vals are in order from an evenly strided sample
+ * and the leading run of vals, so cost is independent of num_vals.
+ * Only feeds the cost model, sort-merge still checks its inputs.
+ **/
+int estimate_sorted(int* vals, size_t num_vals) {
+    size_t sample_size = num_vals < DISTINCT_SAMPLE_SIZE ? num_vals : DISTINCT_SAMPLE_SIZE;
+    if (!is_sorted(vals, sample_size)) {
+        return 0;
+    }
+
+    size_t stride = sample_size ? num_vals / sample_size : 0;
+    for (size_t i = 1; i < sample_size; i++) {
+        if (vals[(i - 1) * stride] > vals[i * stride]) {
+            return 0;
+        }
+    }
+    return !num_vals || vals[(sample_size - 1) * stride] <= vals[num_vals - 1];
+}
+
+
+/**
+ * Returns number of radix partitioning passes needed for smaller side.
+ **/
+static int radix_passes(size_t smaller_num_vals) {
+    int total_bits = 0;
+    while ((smaller_num_vals >> total_bits) > PARTITION_TARGET_TUPLES
+            && total_bits < RADIX_BITS_PER_PASS * MAX_RADIX_PASSES) {
+        total_bits++;
+    }
+    return total_bits ? (total_bits + RADIX_BITS_PER_PASS - 1) / RADIX_BITS_PER_PASS : 0;
+}
+
+
+/**
+ * Returns estimated cost in ns of joining with given algorithm,
+ * or INFINITY if it can't run on these inputs.
+ **/
+double estimate_join_cost(JoinStats* stats, JoinType type) {
+    double left = stats->left_num_vals;
+    double right = stats->right_num_vals;
+    double smaller = left < right ? left : right;
+
+    // every algorithm writes the same output
+    double max_distinct = stats->left_distinct > stats->right_distinct ? stats->left_distinct : stats->right_distinct;
+    double output = max_distinct ? left * right / max_distinct : 0;
+    double cost = output * COST_SEQUENTIAL;
+
+    switch (type) {
+        case NESTED_LOOP:
+            // every pair compared, plus a pass to broadcast each outer val
+            return cost + left * right * COST_COMPARE + (left + right) * COST_SEQUENTIAL;
+        case ONE_PASS_HASH: {
+            // table built on smaller side, misses once it outgrows cache
+            size_t table_bytes = smaller * JOIN_TABLE_TUPLE_BYTES;
+            double probe = table_bytes <= cache_size(_SC_LEVEL2_CACHE_SIZE, 1 << 20) ? COST_CACHED_PROBE : COST_RANDOM_PROBE;
+            double available = (double) sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE);
+            if ((available > 0 && table_bytes > available) || table_bytes > join_memory_budget()) {
+                return INFINITY;
+            }
+            return cost + (left + right) * probe;
+        } case HASH: {
+            // histogram and scatter per pass, then joins in cache
+            int passes = radix_passes(smaller);
+            cost += (left + right) * (1 + 2 * passes) * COST_SEQUENTIAL + (left + right) * COST_CACHED_PROBE;
+            // each tuple written out and read back once when spilling
+            if (radix_join_bytes(left, right) > join_memory_budget()) {
+                cost += (left + right) * COST_SPILL;
+            }
+            return cost;
+        } case SORT_MERGE: {
+            // four 8 bit radix passes, histogram and scatter each
+            double sort = 0;
+            if (!stats->left_sorted) {
+                sort += left * 8 * COST_SEQUENTIAL;
+            }
+            if (!stats->right_sorted) {
+                sort += right * 8 * COST_SEQUENTIAL;
+            }
+            return cost + sort + (left + right) * COST_SEQUENTIAL;
+        } case INDEX_NESTED_LOOP:
+            if (!stats->index_num_vals) {
+                return INFINITY;
+            }
+            return cost + stats->outer_num_vals * log2((double) stats->index_num_vals + 1) * COST_INDEX_STEP;
+        default:
+            return INFINITY;
+    }
+}
+
+
+/**
+ * Returns join algorithm to use. Picks cheapest under the cost
+ * model for auto, else keeps the hinted algorithm unless it can't
+ * run or is JOIN_HINT_OVERRIDE_FACTOR times costlier than cheapest.
+ **/
+JoinType choose_join_type(JoinStats* stats, JoinType hint) {
+    JoinType candidates[] = {HASH, ONE_PASS_HASH, SORT_MERGE, INDEX_NESTED_LOOP, NESTED_LOOP};
+
+    JoinType best = HASH;
+    double best_cost = INFINITY;
+    for (size_t i = 0; i < sizeof(candidates) / sizeof(JoinType); i++) {
+        double cost = estimate_join_cost(stats, candidates[i]);
+        if (cost < best_cost) {
+            best = candidates[i];
+            best_cost = cost;
+        }
+    }
+
+    if (hint == AUTO_JOIN) {
+        return best;
+    }
+
+    double hint_cost = estimate_join_cost(stats, hint);
+    if (isinf(hint_cost) || hint_cost > best_cost * JOIN_HINT_OVERRIDE_FACTOR) {
+        return best;
+    }
+    return hint;
+}
+
+
+/**
+ * Returns name of join algorithm as used in queries.
+ **/
+const char* join_type_name(JoinType type) {
+    switch (type) {
+        case HASH:
+            return "hash";
+        case NESTED_LOOP:
+            return "nested-loop";
+        case SORT_MERGE:
+            return "sort-merge";
+        case INDEX_NESTED_LOOP:
+            return "index-nested-loop";
+        case ONE_PASS_HASH:
+            return "one-pass-hash";
+        case AUTO_JOIN:
+            return "auto";
+        default:
+            return "unknown";
+    }
+}
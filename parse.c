@@ -124,35 +124,75 @@ DbOperator* parse_update(char* update_arguments, LookupTable* client_lookup_tabl
 
 /**
  * parse_join reads arguments for a join query, then validates
- * those args and creates a DbOperator to be executed
+ * those args and creates a DbOperator to be executed. Semi and
+ * anti joins take no join type and output left positions only.
  */
-DbOperator* parse_join(char* join_arguments, LookupTable* client_lookup_table, Status* status) {
+DbOperator* parse_join(char* join_arguments, LookupTable* client_lookup_table, JoinMode mode, Status* status) {
     // strip join_arguments of parens
     join_arguments = trim_parenthesis(join_arguments);
 
-    // get required 5 args
+    // get required 5 args, 4 for semi / anti joins, inner
+    // joins take optional 6th explain arg
     char pos_1_name[MAX_SIZE_NAME];
     char pos_2_name[MAX_SIZE_NAME];
     char val_1_name[MAX_SIZE_NAME];
     char val_2_name[MAX_SIZE_NAME];
-    char join_type_name[20];
+    char join_type_name[20] = "auto";
+    char explain_name[20] = "";
 
-    unsigned int num_args = sscanf(join_arguments, "%[^,],%[^,],%[^,],%[^,],%[^,]", val_1_name, pos_1_name, val_2_name, pos_2_name, join_type_name);
+    unsigned int num_args = sscanf(join_arguments, "%[^,],%[^,],%[^,],%[^,],%19[^,],%19[^,]", val_1_name, pos_1_name, val_2_name, pos_2_name, join_type_name, explain_name);
 
-    if (num_args != 5) {
+    if (mode == INNER_JOIN ? num_args != 5 && num_args != 6 : num_args != 4) {
         status->code = INCORRECT_FORMAT;
         return NULL;
     }
+    if (num_args == 6 && strcmp(explain_name, "explain") != 0) {
+        status->code = UNKNOWN_COMMAND;
+        return NULL;
+    }
 
-    // look up all objects
-    CHandle* pos_1_chandle = (CHandle*) lookup_object(client_lookup_table, pos_1_name, RESULT);
-    CHandle* val_1_chandle = (CHandle*) lookup_object(client_lookup_table, val_1_name, RESULT);
-    CHandle* pos_2_chandle = (CHandle*) lookup_object(client_lookup_table, pos_2_name, RESULT);
-    CHandle* val_2_chandle = (CHandle*) lookup_object(client_lookup_table, val_2_name, RESULT);
+    // look up all objects, a column with null positions joins on all its rows
+    Column* col_1 = NULL;
+    Column* col_2 = NULL;
+    Result* pos_1 = NULL;
+    Result* val_1 = NULL;
+    Result* pos_2 = NULL;
+    Result* val_2 = NULL;
 
-    if (pos_1_chandle == NULL || val_1_chandle == NULL || pos_2_chandle == NULL || val_2_chandle == NULL) {
-        status->code = OBJECT_DOES_NOT_EXIST;
-        return NULL;
+    if (strcmp(pos_1_name, "null") == 0) {
+        CHandle* col_1_chandle = (CHandle*) lookup_object(db_catalog, val_1_name, COLUMN);
+        if (col_1_chandle == NULL) {
+            status->code = OBJECT_DOES_NOT_EXIST;
+            return NULL;
+        }
+        col_1 = col_1_chandle->pointer.column;
+    } else {
+        CHandle* pos_1_chandle = (CHandle*) lookup_object(client_lookup_table, pos_1_name, RESULT);
+        CHandle* val_1_chandle = (CHandle*) lookup_object(client_lookup_table, val_1_name, RESULT);
+        if (pos_1_chandle == NULL || val_1_chandle == NULL) {
+            status->code = OBJECT_DOES_NOT_EXIST;
+            return NULL;
+        }
+        pos_1 = pos_1_chandle->pointer.result;
+        val_1 = val_1_chandle->pointer.result;
+    }
+
+    if (strcmp(pos_2_name, "null") == 0) {
+        CHandle* col_2_chandle = (CHandle*) lookup_object(db_catalog, val_2_name, COLUMN);
+        if (col_2_chandle == NULL) {
+            status->code = OBJECT_DOES_NOT_EXIST;
+            return NULL;
+        }
+        col_2 = col_2_chandle->pointer.column;
+    } else {
+        CHandle* pos_2_chandle = (CHandle*) lookup_object(client_lookup_table, pos_2_name, RESULT);
+        CHandle* val_2_chandle = (CHandle*) lookup_object(client_lookup_table, val_2_name, RESULT);
+        if (pos_2_chandle == NULL || val_2_chandle == NULL) {
+            status->code = OBJECT_DOES_NOT_EXIST;
+            return NULL;
+        }
+        pos_2 = pos_2_chandle->pointer.result;
+        val_2 = val_2_chandle->pointer.result;
     }
 
     JoinType join_type = 0;
@@ -161,6 +201,14 @@ DbOperator* parse_join(char* join_arguments, LookupTable* client_lookup_table, S
         join_type = HASH;
     } else if (strcmp(join_type_name, "nested-loop") == 0) {
         join_type = NESTED_LOOP;
+    } else if (strcmp(join_type_name, "sort-merge") == 0 || strcmp(join_type_name, "sort_merge") == 0) {
+        join_type = SORT_MERGE;
+    } else if (strcmp(join_type_name, "index-nested-loop") == 0) {
+        join_type = INDEX_NESTED_LOOP;
+    } else if (strcmp(join_type_name, "one-pass-hash") == 0) {
+        join_type = ONE_PASS_HASH;
+    } else if (strcmp(join_type_name, "auto") == 0) {
+        join_type = AUTO_JOIN;
     } else {
         status->code = UNKNOWN_COMMAND;
         return NULL;
@@ -169,11 +217,15 @@ DbOperator* parse_join(char* join_arguments, LookupTable* client_lookup_table, S
     // create DbOperator
     DbOperator* dbo = calloc(1, sizeof(DbOperator));
     dbo->type = JOIN;
-    dbo->operator_fields.join_operator.pos_1 = pos_1_chandle->pointer.result;
-    dbo->operator_fields.join_operator.val_1 = val_1_chandle->pointer.result;
-    dbo->operator_fields.join_operator.pos_2 = pos_2_chandle->pointer.result;
-    dbo->operator_fields.join_operator.val_2 = val_2_chandle->pointer.result;
+    dbo->operator_fields.join_operator.pos_1 = pos_1;
+    dbo->operator_fields.join_operator.val_1 = val_1;
+    dbo->operator_fields.join_operator.pos_2 = pos_2;
+    dbo->operator_fields.join_operator.val_2 = val_2;
+    dbo->operator_fields.join_operator.col_1 = col_1;
+    dbo->operator_fields.join_operator.col_2 = col_2;
     dbo->operator_fields.join_operator.type = join_type;
+    dbo->operator_fields.join_operator.mode = mode;
+    dbo->operator_fields.join_operator.explain = num_args == 6;
 
     return dbo;
 }
@@ -193,7 +245,8 @@ DbOperator* parse_aggregate(char* aggregate_arguments, LookupTable* client_looku
 
     unsigned int num_args = sscanf(aggregate_arguments, "%[^,],%[^,]", arg1, arg2);
 
-    if (num_args == 0 || ((type == ADD || type == SUB) && num_args == 1)) {
+    if (num_args == 0 || ((type == ADD || type == SUB) && num_args == 1)
+            || ((type == APPROX_SUM || type == APPROX_AVG || type == APPROX_DISTINCT || type == BUILD_BLOOM) && num_args != 1)) {
         status->code = INCORRECT_FORMAT;
         return NULL;
     }
@@ -244,6 +297,61 @@ DbOperator* parse_aggregate(char* aggregate_arguments, LookupTable* client_looku
 }
 
 
+/**
+ * parse_sort reads arguments for a sort or top-k query, then validates
+ * those args and creates a DbOperator to be executed.
+ * Takes one or two handles (vals, or positions then vals), and for top-k
+ * a trailing k.
+ */
+DbOperator* parse_sort(char* sort_arguments, LookupTable* client_lookup_table, int top_k, Status* status) {
+    // strip sort_arguments of parens
+    sort_arguments = trim_parenthesis(sort_arguments);
+
+    // get up to three args
+    char args[3][MAX_SIZE_NAME];
+    int num_args = sscanf(sort_arguments, "%[^,],%[^,],%[^,]", args[0], args[1], args[2]);
+
+    // top-k needs a trailing k
+    int num_handles = top_k ? num_args - 1 : num_args;
+    if (num_handles < 1 || num_handles > 2) {
+        status->code = INCORRECT_FORMAT;
+        return NULL;
+    }
+
+    int k = 0;
+    if (top_k) {
+        k = atoi(args[num_args - 1]);
+        if (k <= 0) {
+            status->code = INCORRECT_FORMAT;
+            return NULL;
+        }
+    }
+
+    // look up handles, either columns or results
+    CHandle* chandles[2] = {NULL, NULL};
+    for (int i = 0; i < num_handles; i++) {
+        chandles[i] = lookup_object(db_catalog, args[i], COLUMN);
+        if (chandles[i] == NULL) {
+            chandles[i] = lookup_object(client_lookup_table, args[i], RESULT);
+        }
+
+        if (chandles[i] == NULL) {
+            status->code = OBJECT_DOES_NOT_EXIST;
+            return NULL;
+        }
+    }
+
+    // create DbOperator
+    DbOperator* dbo = calloc(1, sizeof(DbOperator));
+    dbo->type = SORT;
+    dbo->operator_fields.sort_operator.chandle_1 = chandles[0];
+    dbo->operator_fields.sort_operator.chandle_2 = chandles[1];
+    dbo->operator_fields.sort_operator.k = k;
+
+    return dbo;
+}
+
+
 /**
  * parse_print reads arguments to print, then creates
  * DbOperator to execute print.
@@ -331,8 +439,8 @@ DbOperator* parse_select(char* select_arguments, LookupTable* client_lookup_tabl
     select_arguments = trim_parenthesis(select_arguments);
 
     // read args
-    char arg1[MAX_SIZE_NAME], arg2[MAX_SIZE_NAME], arg3[MAX_SIZE_NAME], arg4[MAX_SIZE_NAME];
-    int num_args = sscanf(select_arguments, "%[^,],%[^,],%[^,],%[^,]", arg1, arg2, arg3, arg4);
+    char arg1[MAX_SIZE_NAME], arg2[MAX_SIZE_NAME], arg3[MAX_SIZE_NAME], arg4[MAX_SIZE_NAME], arg5[MAX_SIZE_NAME];
+    int num_args = sscanf(select_arguments, "%[^,],%[^,],%[^,],%[^,],%[^,]", arg1, arg2, arg3, arg4, arg5);
 
     if (num_args < 3) {
         status->code = INCORRECT_FORMAT;
@@ -348,14 +456,20 @@ DbOperator* parse_select(char* select_arguments, LookupTable* client_lookup_tabl
     ComparatorType type1 = NO_COMPARISON;
     ComparatorType type2 = NO_COMPARISON;
 
-    // if only 3 args, chandle should be col
-    if (num_args == 3) {
-        chandle_1 = (CHandle*) lookup_object(db_catalog, arg1, COLUMN);
+    // last arg may name a bloom filter vals must also pass,
+    // select on a column has 3 other args, on results 4
+    char* filter_name = NULL;
 
-        if (chandle_1 == NULL) {
-            status->code = OBJECT_DOES_NOT_EXIST;
+    // if first arg is a col, chandle should be col
+    chandle_1 = (CHandle*) lookup_object(db_catalog, arg1, COLUMN);
+    if (chandle_1 != NULL) {
+        if (num_args > 4) {
+            status->code = INCORRECT_FORMAT;
             return NULL;
         }
+        if (num_args == 4) {
+            filter_name = arg4;
+        }
 
         if (strcmp(arg2, "null") != 0) {
             type1 = GREATER_THAN_OR_EQUAL;            
@@ -368,6 +482,14 @@ DbOperator* parse_select(char* select_arguments, LookupTable* client_lookup_tabl
         }
     // else should be two chandles for result cols
     } else {
+        if (num_args < 4) {
+            status->code = OBJECT_DOES_NOT_EXIST;
+            return NULL;
+        }
+        if (num_args == 5) {
+            filter_name = arg5;
+        }
+
         chandle_1 = (CHandle*) lookup_object(client_lookup_table, arg1, RESULT);
         chandle_2 = (CHandle*) lookup_object(client_lookup_table, arg2, RESULT);
 
@@ -387,6 +509,17 @@ DbOperator* parse_select(char* select_arguments, LookupTable* client_lookup_tabl
         }
     }
 
+    // look up filter
+    BloomFilter* filter = NULL;
+    if (filter_name != NULL) {
+        CHandle* filter_chandle = (CHandle*) lookup_object(client_lookup_table, filter_name, RESULT);
+        if (filter_chandle == NULL || filter_chandle->pointer.result->data_type != BLOOM) {
+            status->code = OBJECT_DOES_NOT_EXIST;
+            return NULL;
+        }
+        filter = (BloomFilter*) filter_chandle->pointer.result->payload;
+    }
+
     // create DbOperator
     DbOperator* dbo = calloc(1, sizeof(DbOperator));
     dbo->type = SELECT;
@@ -396,6 +529,7 @@ DbOperator* parse_select(char* select_arguments, LookupTable* client_lookup_tabl
     dbo->operator_fields.select_operator.comparator.p_high = p_high;
     dbo->operator_fields.select_operator.comparator.type1 = type1;
     dbo->operator_fields.select_operator.comparator.type2 = type2;
+    dbo->operator_fields.select_operator.comparator.filter = filter;
     return dbo;   
 }
 
@@ -480,6 +614,11 @@ DbOperator* parse_create_idx(char* create_arguments, Status* status) {
         } else if (strcmp(clustered_arg, "unclustered") == 0) {
             index_type = BTREE_UNCLUSTERED;
         }
+    } else if (strcmp(index, "art") == 0) {
+        // ART holds row ids, no clustered variant
+        if (strcmp(clustered_arg, "unclustered") == 0) {
+            index_type = ART;
+        }
     }
 
     // if no index type, args are invalid
@@ -498,6 +637,29 @@ DbOperator* parse_create_idx(char* create_arguments, Status* status) {
 }
 
 
+/**
+ * Parses args for creating a column summary.
+ **/
+DbOperator* parse_create_summary(char* create_arguments, Status* status) {
+    // args needed 
+    char col_name[MAX_SIZE_NAME];
+    int num_args = sscanf(create_arguments, "%[^,]", col_name);
+
+    // if didnt get all args
+    if (num_args != 1) {
+        status->code = INCORRECT_FORMAT;
+        return NULL;
+    }
+
+    DbOperator* dbo = calloc(1, sizeof(DbOperator));
+    dbo->type = CREATE;
+    strcpy(dbo->operator_fields.create_operator.col_name, col_name);  
+    dbo->operator_fields.create_operator.type = CREATE_SUMMARY;
+
+    return dbo;
+}
+
+
 /**
  * This method takes in a string representing the arguments to create a column.
  * It parses those arguments, checks that they are valid, and creates 
@@ -608,6 +770,8 @@ DbOperator* parse_create(char* create_arguments, Status* status) {
             dbo = parse_create_col(tokenizer_copy, status);
         } else if (strcmp(token, "idx") == 0) {
             dbo = parse_create_idx(tokenizer_copy, status);
+        } else if (strcmp(token, "summary") == 0) {
+            dbo = parse_create_summary(tokenizer_copy, status);
         } else {
             status->code = UNKNOWN_COMMAND;
         }
@@ -691,9 +855,33 @@ DbOperator* parse_command(char* query_command, Status* status, LookupTable* clie
     } else if (strncmp(query_command, "sub", 3) == 0) {
         query_command += 3;
         dbo = parse_aggregate(query_command, client_lookup_table, SUB, status);
+    } else if (strncmp(query_command, "approx_sum", 10) == 0) {
+        query_command += 10;
+        dbo = parse_aggregate(query_command, client_lookup_table, APPROX_SUM, status);
+    } else if (strncmp(query_command, "approx_avg", 10) == 0) {
+        query_command += 10;
+        dbo = parse_aggregate(query_command, client_lookup_table, APPROX_AVG, status);
+    } else if (strncmp(query_command, "approx_distinct", 15) == 0) {
+        query_command += 15;
+        dbo = parse_aggregate(query_command, client_lookup_table, APPROX_DISTINCT, status);
+    } else if (strncmp(query_command, "bloom", 5) == 0) {
+        query_command += 5;
+        dbo = parse_aggregate(query_command, client_lookup_table, BUILD_BLOOM, status);
     } else if (strncmp(query_command, "join", 4) == 0) {
         query_command += 4;
-        dbo = parse_join(query_command, client_lookup_table, status);
+        dbo = parse_join(query_command, client_lookup_table, INNER_JOIN, status);
+    } else if (strncmp(query_command, "semijoin", 8) == 0) {
+        query_command += 8;
+        dbo = parse_join(query_command, client_lookup_table, SEMI_JOIN, status);
+    } else if (strncmp(query_command, "antijoin", 8) == 0) {
+        query_command += 8;
+        dbo = parse_join(query_command, client_lookup_table, ANTI_JOIN, status);
+    } else if (strncmp(query_command, "sort", 4) == 0) {
+        query_command += 4;
+        dbo = parse_sort(query_command, client_lookup_table, 0, status);
+    } else if (strncmp(query_command, "topk", 4) == 0) {
+        query_command += 4;
+        dbo = parse_sort(query_command, client_lookup_table, 1, status);
     } else if (strncmp(query_command, "relational_delete", 17) == 0) {
         query_command += 17;
         dbo = parse_delete(query_command, client_lookup_table, status);
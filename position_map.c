@@ -0,0 +1,348 @@
+/**
+ * Contains all functionality for position maps, which
+ * map stable row ids stored in b+ tree indexes to the
+ * rows' current positions in their table.
+ *
+ * The map is an implicit treap holding row ids in position
+ * order: a row's position is the number of rows before it
+ * in order, kept by subtree sizes. Node arrays are indexed
+ * by row id, so a row's node is found directly and its
+ * position computed walking up parent links.
+ **/
+
+#include "position_map.h"
+
+
+/**
+ * Returns next pseudo random treap priority.
+ **/
+static unsigned int next_priority(PositionMap* map) {
+    map->rng_state ^= map->rng_state << 13;
+    map->rng_state ^= map->rng_state >> 17;
+    map->rng_state ^= map->rng_state << 5;
+    return map->rng_state;
+}
+
+
+/**
+ * Returns number of rows in subtree rooted at node.
+ **/
+static inline int subtree_size(PositionMap* map, int node) {
+    return node < 0 ? 0 : map->size[node];
+}
+
+
+/**
+ * Recomputes node's size and points its children back at it.
+ **/
+static inline void update_node(PositionMap* map, int node) {
+    int left = map->left[node];
+    int right = map->right[node];
+    map->size[node] = 1 + subtree_size(map, left) + subtree_size(map, right);
+    if (left >= 0) {
+        map->parent[left] = node;
+    }
+    if (right >= 0) {
+        map->parent[right] = node;
+    }
+}
+
+
+/**
+ * Splits treap rooted at node into its first num_rows rows, in
+ * first, and the rest, in second.
+ **/
+static void split(PositionMap* map, int node, int num_rows, int* first, int* second) {
+    if (node < 0) {
+        *first = -1;
+        *second = -1;
+        return;
+    }
+
+    int left_size = subtree_size(map, map->left[node]);
+    if (left_size < num_rows) {
+        split(map, map->right[node], num_rows - left_size - 1, &map->right[node], second);
+        *first = node;
+    } else {
+        split(map, map->left[node], num_rows, first, &map->left[node]);
+        *second = node;
+    }
+    update_node(map, node);
+}
+
+
+/**
+ * Joins treaps first and second, all of first's rows
+ * before second's, and returns root of result.
+ **/
+static int merge(PositionMap* map, int first, int second) {
+    if (first < 0) {
+        return second;
+    }
+    if (second < 0) {
+        return first;
+    }
+
+    if (map->priority[first] > map->priority[second]) {
+        map->right[first] = merge(map, map->right[first], second);
+        update_node(map, first);
+        return first;
+    }
+    map->left[second] = merge(map, first, map->left[second]);
+    update_node(map, second);
+    return second;
+}
+
+
+/**
+ * Makes node array room for at least num_row_ids row ids.
+ **/
+static void reserve_row_ids(PositionMap* map, size_t num_row_ids) {
+    if (num_row_ids <= map->capacity) {
+        return;
+    }
+    while (map->capacity < num_row_ids) {
+        map->capacity = map->capacity ? map->capacity * 2 : 1024;
+    }
+    map->left = realloc(map->left, sizeof(int) * map->capacity);
+    map->right = realloc(map->right, sizeof(int) * map->capacity);
+    map->parent = realloc(map->parent, sizeof(int) * map->capacity);
+    map->size = realloc(map->size, sizeof(int) * map->capacity);
+    map->priority = realloc(map->priority, sizeof(unsigned int) * map->capacity);
+}
+
+
+/**
+ * Creates position map over num_rows rows where row i has row id
+ * i, the ids indexes hold before any row has moved. Builds the
+ * treap in linear time from the rows in order with a stack of its
+ * right spine, then sizes nodes children first.
+ **/
+PositionMap* create_position_map(size_t num_rows) {
+    PositionMap* map = calloc(1, sizeof(PositionMap));
+    map->rng_state = 2463534242u;
+    map->root = -1;
+    reserve_row_ids(map, num_rows);
+    map->num_row_ids = num_rows;
+
+    int* spine = malloc(sizeof(int) * (num_rows + 1));
+    int spine_size = 0;
+    for (size_t i = 0; i < num_rows; i++) {
+        int node = (int) i;
+        map->priority[node] = next_priority(map);
+        map->left[node] = -1;
+        map->right[node] = -1;
+        map->parent[node] = -1;
+
+        // pop lower priority nodes off spine, they become left child
+        int last_popped = -1;
+        while (spine_size && map->priority[spine[spine_size - 1]] < map->priority[node]) {
+            last_popped = spine[--spine_size];
+        }
+        map->left[node] = last_popped;
+        if (spine_size) {
+            map->right[spine[spine_size - 1]] = node;
+        }
+        spine[spine_size++] = node;
+    }
+    map->root = spine_size ? spine[0] : -1;
+
+    // preorder, then size in reverse so children come first
+    int* order = spine;
+    size_t num_ordered = 0;
+    int* stack = malloc(sizeof(int) * (num_rows + 1));
+    int stack_size = 0;
+    if (map->root >= 0) {
+        stack[stack_size++] = map->root;
+    }
+    while (stack_size) {
+        int node = stack[--stack_size];
+        order[num_ordered++] = node;
+        if (map->left[node] >= 0) {
+            stack[stack_size++] = map->left[node];
+        }
+        if (map->right[node] >= 0) {
+            stack[stack_size++] = map->right[node];
+        }
+    }
+    for (size_t i = num_ordered; i > 0; i--) {
+        update_node(map, order[i - 1]);
+    }
+    if (map->root >= 0) {
+        map->parent[map->root] = -1;
+    }
+
+    free(stack);
+    free(order);
+    return map;
+}
+
+
+/**
+ * Inserts a new row at pos, moving rows at pos and after back
+ * one position. Returns new row's id.
+ **/
+int position_map_insert(PositionMap* map, int pos) {
+    reserve_row_ids(map, map->num_row_ids + 1);
+    int node = (int) map->num_row_ids++;
+    map->left[node] = -1;
+    map->right[node] = -1;
+    map->parent[node] = -1;
+    map->size[node] = 1;
+    map->priority[node] = next_priority(map);
+
+    int first, second;
+    split(map, map->root, pos, &first, &second);
+    map->root = merge(map, merge(map, first, node), second);
+    map->parent[map->root] = -1;
+    return node;
+}
+
+
+/**
+ * Removes row at pos, moving rows after it forward
+ * one position. Returns removed row's id.
+ **/
+int position_map_remove(PositionMap* map, int pos) {
+    int first, rest, removed, second;
+    split(map, map->root, pos, &first, &rest);
+    split(map, rest, 1, &removed, &second);
+    map->root = merge(map, first, second);
+    if (map->root >= 0) {
+        map->parent[map->root] = -1;
+    }
+    return removed;
+}
+
+
+/**
+ * Returns current position of row with given id,
+ * which is its position if map is NULL.
+ **/
+int position_of(PositionMap* map, int row_id) {
+    if (map == NULL) {
+        return row_id;
+    }
+
+    int pos = subtree_size(map, map->left[row_id]);
+    for (int node = row_id; map->parent[node] >= 0; node = map->parent[node]) {
+        int parent = map->parent[node];
+        if (map->right[parent] == node) {
+            pos += subtree_size(map, map->left[parent]) + 1;
+        }
+    }
+    return pos;
+}
+
+
+/**
+ * Returns id of row at pos.
+ **/
+int row_id_at(PositionMap* map, int pos) {
+    int node = map->root;
+    while (node >= 0) {
+        int left_size = subtree_size(map, map->left[node]);
+        if (pos < left_size) {
+            node = map->left[node];
+        } else if (pos == left_size) {
+            return node;
+        } else {
+            pos -= left_size + 1;
+            node = map->right[node];
+        }
+    }
+    return -1;
+}
+
+
+/**
+ * Sets row_ids to the id of every row in position order.
+ **/
+void position_map_row_ids(PositionMap* map, int* row_ids) {
+    size_t num_rows = 0;
+    int* stack = malloc(sizeof(int) * (subtree_size(map, map->root) + 1));
+    int stack_size = 0;
+    int node = map->root;
+    while (node >= 0 || stack_size) {
+        while (node >= 0) {
+            stack[stack_size++] = node;
+            node = map->left[node];
+        }
+        node = stack[--stack_size];
+        row_ids[num_rows++] = node;
+        node = map->right[node];
+    }
+    free(stack);
+}
+
+
+/**
+ * Replaces the num_ids row ids in ids with their rows' positions.
+ **/
+void positions_of(PositionMap* map, int* ids, size_t num_ids) {
+    if (map == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < num_ids; i++) {
+        ids[i] = position_of(map, ids[i]);
+    }
+}
+
+
+/**
+ * Dumps map to fd, writing no rows for a NULL map.
+ **/
+void dump_position_map(FILE* fd, PositionMap* map) {
+    size_t num_row_ids = map != NULL ? map->num_row_ids : 0;
+    fwrite(&num_row_ids, sizeof(size_t), 1, fd);
+    if (!num_row_ids) {
+        return;
+    }
+
+    fwrite(&map->root, sizeof(int), 1, fd);
+    fwrite(&map->rng_state, sizeof(unsigned int), 1, fd);
+    fwrite(map->left, sizeof(int), num_row_ids, fd);
+    fwrite(map->right, sizeof(int), num_row_ids, fd);
+    fwrite(map->parent, sizeof(int), num_row_ids, fd);
+    fwrite(map->size, sizeof(int), num_row_ids, fd);
+    fwrite(map->priority, sizeof(unsigned int), num_row_ids, fd);
+}
+
+
+/**
+ * Loads map dumped at fd's position, NULL if it had no rows.
+ **/
+PositionMap* load_position_map(FILE* fd) {
+    size_t num_row_ids = 0;
+    if (fread(&num_row_ids, sizeof(size_t), 1, fd) != 1 || !num_row_ids) {
+        return NULL;
+    }
+
+    PositionMap* map = calloc(1, sizeof(PositionMap));
+    reserve_row_ids(map, num_row_ids);
+    map->num_row_ids = num_row_ids;
+    fread(&map->root, sizeof(int), 1, fd);
+    fread(&map->rng_state, sizeof(unsigned int), 1, fd);
+    fread(map->left, sizeof(int), num_row_ids, fd);
+    fread(map->right, sizeof(int), num_row_ids, fd);
+    fread(map->parent, sizeof(int), num_row_ids, fd);
+    fread(map->size, sizeof(int), num_row_ids, fd);
+    fread(map->priority, sizeof(unsigned int), num_row_ids, fd);
+    return map;
+}
+
+
+/**
+ * Frees position map.
+ **/
+void free_position_map(PositionMap* map) {
+    if (map == NULL) {
+        return;
+    }
+    free(map->left);
+    free(map->right);
+    free(map->parent);
+    free(map->size);
+    free(map->priority);
+    free(map);
+}
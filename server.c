@@ -209,7 +209,7 @@ void test_b_plus_tree() {
     for (int pos = 0; pos < num_test; pos++) {
         int val = vals[pos];
         printf("%d: %d\n", val, pos);
-        root = bplus_insert(root, val, pos, 0);
+        root = bplus_insert(root, val, pos);
     }
 
     // remove 3 s
@@ -221,7 +221,7 @@ void test_b_plus_tree() {
 
     for (int i = 0; i < 4; i++) {
         int val = new_vals[i];
-        int pos = find_pos(root, val, 0);
+        int pos = find_pos(root, val, 0, NULL);
         printf("%d: %d\n", val, pos);
     }
 
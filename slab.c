@@ -0,0 +1,164 @@
+#define _GNU_SOURCE
+/**
+ * Contains all functionality for slabs, allocators of
+ * fixed size objects such as b+ tree nodes that are
+ * all released together.
+ **/
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include "slab.h"
+
+
+/**
+ * Reserves SLAB_REGION_BYTES of address space aligned to its own
+ * size, none of it usable yet. Returns NULL if it couldn't be.
+ **/
+static char* reserve_region() {
+    // over reserve so an aligned region fits, then trim both ends
+    size_t reserve_bytes = 2 * SLAB_REGION_BYTES;
+    char* reserved = mmap(NULL, reserve_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED) {
+        return NULL;
+    }
+
+    char* region = (char*) (((size_t) reserved + SLAB_REGION_BYTES - 1) & ~(SLAB_REGION_BYTES - 1));
+    if (region > reserved) {
+        munmap(reserved, region - reserved);
+    }
+    munmap(region + SLAB_REGION_BYTES, reserved + reserve_bytes - region - SLAB_REGION_BYTES);
+    return region;
+}
+
+
+/**
+ * Fills in header of slab at start of its region.
+ **/
+static void init_slab(Slab* slab, size_t object_size, size_t num_objects, size_t committed, int huge_pages) {
+    slab->object_size = object_size;
+    slab->num_objects = num_objects;
+    slab->committed = committed;
+    slab->huge_pages = huge_pages;
+    pthread_mutex_init(&slab->lock, NULL);
+}
+
+
+/**
+ * Creates an empty slab for objects of object_size bytes. Reserves
+ * SLAB_REGION_BYTES of address space aligned to its own size, so
+ * slab_of can find the slab from any object's address, but only
+ * commits memory as objects are handed out. If huge_pages is set
+ * committed memory is advised to be backed by huge pages.
+ * Returns NULL if address space couldn't be reserved.
+ **/
+Slab* create_slab(size_t object_size, int huge_pages) {
+    char* region = reserve_region();
+    if (region == NULL) {
+        return NULL;
+    }
+
+    if (mprotect(region, SLAB_COMMIT_BYTES, PROT_READ | PROT_WRITE)) {
+        munmap(region, SLAB_REGION_BYTES);
+        return NULL;
+    }
+
+    Slab* slab = (Slab*) region;
+    init_slab(slab, object_size, 0, SLAB_COMMIT_BYTES, huge_pages);
+#ifdef MADV_HUGEPAGE
+    if (huge_pages) {
+        madvise(region, SLAB_COMMIT_BYTES, MADV_HUGEPAGE);
+    }
+#endif
+    return slab;
+}
+
+
+/**
+ * Creates a slab whose first num_objects objects are an image of a
+ * slab's objects at offset in file fd, padded with zeros to a whole
+ * page. The image is mapped private,
+ * so nothing is read until touched and a page is only copied into
+ * memory of its own when first written, the file never changes.
+ * Objects allocated later come from anonymous memory past it.
+ * offset must be page aligned. Returns NULL if mapping failed.
+ **/
+Slab* map_slab(int fd, off_t offset, size_t num_objects, size_t object_size) {
+    char* region = reserve_region();
+    if (region == NULL) {
+        return NULL;
+    }
+
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t image_bytes = (num_objects * object_size + page_size - 1) & ~(page_size - 1);
+    size_t image_end = SLAB_HEADER_BYTES + image_bytes;
+    size_t committed = (image_end + SLAB_COMMIT_BYTES - 1) & ~(SLAB_COMMIT_BYTES - 1);
+
+    if ((image_bytes && mmap(region + SLAB_HEADER_BYTES, image_bytes, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_FIXED, fd, offset) == MAP_FAILED)
+        || mprotect(region, SLAB_HEADER_BYTES, PROT_READ | PROT_WRITE)
+        || (committed > image_end && mprotect(region + image_end, committed - image_end, PROT_READ | PROT_WRITE))) {
+        munmap(region, SLAB_REGION_BYTES);
+        return NULL;
+    }
+
+    Slab* slab = (Slab*) region;
+    init_slab(slab, object_size, num_objects, committed, 0);
+    return slab;
+}
+
+
+/**
+ * Returns a zeroed object from slab, committing
+ * more of its region if needed. Returns NULL if
+ * slab's region is full.
+ **/
+void* slab_alloc(Slab* slab) {
+    size_t offset = SLAB_HEADER_BYTES + slab->num_objects * slab->object_size;
+    if (offset + slab->object_size > slab->committed) {
+        if (slab->committed + SLAB_COMMIT_BYTES > SLAB_REGION_BYTES) {
+            return NULL;
+        }
+
+        char* next = (char*) slab + slab->committed;
+        if (mprotect(next, SLAB_COMMIT_BYTES, PROT_READ | PROT_WRITE)) {
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        if (slab->huge_pages) {
+            madvise(next, SLAB_COMMIT_BYTES, MADV_HUGEPAGE);
+        }
+#endif
+        slab->committed += SLAB_COMMIT_BYTES;
+    }
+
+    // fresh anonymous pages are already zero
+    slab->num_objects++;
+    return (char*) slab + offset;
+}
+
+
+/**
+ * Returns object at index, in order of allocation.
+ **/
+void* slab_object(Slab* slab, size_t index) {
+    return (char*) slab + SLAB_HEADER_BYTES + index * slab->object_size;
+}
+
+
+/**
+ * Returns slab object was allocated from.
+ **/
+Slab* slab_of(void* object) {
+    return (Slab*) ((size_t) object & ~(SLAB_REGION_BYTES - 1));
+}
+
+
+/**
+ * Releases slab and all objects allocated from it at once.
+ **/
+void free_slab(Slab* slab) {
+    if (slab != NULL) {
+        pthread_mutex_destroy(&slab->lock);
+        munmap(slab, SLAB_REGION_BYTES);
+    }
+}
@@ -0,0 +1,292 @@
+/**
+ * Contains all functionality for sorting
+ * (value, position) pairs, used by the sort
+ * and topk operators.
+ **/
+
+#include <pthread.h>
+#include <unistd.h>
+#include "sort.h"
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define MAX_SORT_THREADS 8
+
+// below this many items sort on a single thread
+#define PARALLEL_SORT_THRESHOLD (1 << 16)
+
+
+/**
+ * Simple struct for radix sort thread function parameters.
+ **/
+typedef struct radixParams {
+    int* keys_in;
+    int* vals_in;
+    int* keys_out;
+    int* vals_out;
+    size_t start;
+    size_t end;
+    int shift;
+    size_t* histogram;    // RADIX_BUCKETS counts, turned into offsets before scatter
+} radixParams;
+
+
+/**
+ * Returns 1 if data is in non-decreasing order.
+ **/
+int is_sorted(int* data, size_t num_items) {
+    for (size_t i = 1; i < num_items; i++) {
+        if (data[i - 1] > data[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/**
+ * Returns radix digit of key for given shift. Sign bit is flipped
+ * so negative keys order before positive ones.
+ **/
+static inline unsigned int radix_digit(int key, int shift) {
+    return ((((unsigned int) key) ^ 0x80000000u) >> shift) & (RADIX_BUCKETS - 1);
+}
+
+
+/**
+ * Thread function to histogram one chunk of keys.
+ **/
+void* radix_histogram(void* context) {
+    radixParams* params = (radixParams*) context;
+
+    memset(params->histogram, 0, sizeof(size_t) * RADIX_BUCKETS);
+    for (size_t i = params->start; i < params->end; i++) {
+        params->histogram[radix_digit(params->keys_in[i], params->shift)]++;
+    }
+    return NULL;
+}
+
+
+/**
+ * Thread function to scatter one chunk of pairs
+ * into place using its precomputed offsets.
+ **/
+void* radix_scatter(void* context) {
+    radixParams* params = (radixParams*) context;
+    size_t* offsets = params->histogram;
+
+    for (size_t i = params->start; i < params->end; i++) {
+        size_t dest = offsets[radix_digit(params->keys_in[i], params->shift)]++;
+        params->keys_out[dest] = params->keys_in[i];
+        params->vals_out[dest] = params->vals_in[i];
+    }
+    return NULL;
+}
+
+
+/**
+ * Returns number of threads to sort num_items with.
+ **/
+int num_sort_threads(size_t num_items) {
+    if (num_items < PARALLEL_SORT_THRESHOLD) {
+        return 1;
+    }
+
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_cpus < 1) {
+        num_cpus = 1;
+    }
+    return num_cpus > MAX_SORT_THREADS ? MAX_SORT_THREADS : (int) num_cpus;
+}
+
+
+/**
+ * Runs func over all params, on threads if more than one.
+ **/
+void run_radix_phase(void* (*func)(void*), radixParams* params, int num_threads) {
+    if (num_threads == 1) {
+        func(&params[0]);
+        return;
+    }
+
+    pthread_t threads[MAX_SORT_THREADS];
+    for (int t = 0; t < num_threads; t++) {
+        pthread_create(&threads[t], NULL, func, &params[t]);
+    }
+    for (int t = 0; t < num_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+}
+
+
+/**
+ * Given keys and vals arrays and number of items, sorts both
+ * arrays in place by keys using a parallel LSD radix sort.
+ * Stable, so equal keys keep their relative order.
+ *
+ * Each pass every thread histograms its chunk, then the per thread
+ * histograms are prefix summed into exact output offsets and every
+ * thread scatters its chunk. Passes where all keys share a digit are skipped.
+ **/
+void radix_sort_pairs(int* keys, int* vals, size_t num_items) {
+    if (num_items < 2) {
+        return;
+    }
+
+    int num_threads = num_sort_threads(num_items);
+
+    int* tmp_keys = malloc(sizeof(int) * num_items);
+    int* tmp_vals = malloc(sizeof(int) * num_items);
+
+    radixParams params[MAX_SORT_THREADS];
+    size_t* histograms = malloc(sizeof(size_t) * RADIX_BUCKETS * num_threads);
+
+    // split items into a chunk per thread
+    size_t chunk_size = num_items / num_threads;
+    for (int t = 0; t < num_threads; t++) {
+        params[t].start = t * chunk_size;
+        params[t].end = t == num_threads - 1 ? num_items : (t + 1) * chunk_size;
+        params[t].histogram = &histograms[t * RADIX_BUCKETS];
+    }
+
+    int* keys_in = keys;
+    int* vals_in = vals;
+    int* keys_out = tmp_keys;
+    int* vals_out = tmp_vals;
+
+    for (int shift = 0; shift < 32; shift += RADIX_BITS) {
+        for (int t = 0; t < num_threads; t++) {
+            params[t].keys_in = keys_in;
+            params[t].vals_in = vals_in;
+            params[t].keys_out = keys_out;
+            params[t].vals_out = vals_out;
+            params[t].shift = shift;
+        }
+
+        // histogram pass
+        run_radix_phase(radix_histogram, params, num_threads);
+
+        // skip pass if every key has the same digit
+        int skip = 0;
+        for (int bucket = 0; bucket < RADIX_BUCKETS && !skip; bucket++) {
+            size_t bucket_total = 0;
+            for (int t = 0; t < num_threads; t++) {
+                bucket_total += params[t].histogram[bucket];
+            }
+            skip = bucket_total == num_items;
+        }
+        if (skip) {
+            continue;
+        }
+
+        // prefix sum into offsets, bucket major then thread
+        size_t offset = 0;
+        for (int bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+            for (int t = 0; t < num_threads; t++) {
+                size_t count = params[t].histogram[bucket];
+                params[t].histogram[bucket] = offset;
+                offset += count;
+            }
+        }
+
+        // scatter pass
+        run_radix_phase(radix_scatter, params, num_threads);
+
+        // swap buffers
+        int* temp = keys_in;
+        keys_in = keys_out;
+        keys_out = temp;
+        temp = vals_in;
+        vals_in = vals_out;
+        vals_out = temp;
+    }
+
+    // if sorted data ended up in temp buffers copy back
+    if (keys_in != keys) {
+        memcpy(keys, keys_in, sizeof(int) * num_items);
+        memcpy(vals, vals_in, sizeof(int) * num_items);
+    }
+
+    free(histograms);
+    free(tmp_keys);
+    free(tmp_vals);
+}
+
+
+/**
+ * Moves item at idx down min heap of size heap_size.
+ **/
+void heap_sift_down(int* heap_keys, int* heap_vals, size_t heap_size, size_t idx) {
+    while (1) {
+        size_t smallest = idx;
+        size_t left = 2 * idx + 1;
+        size_t right = left + 1;
+
+        if (left < heap_size && heap_keys[left] < heap_keys[smallest]) {
+            smallest = left;
+        }
+        if (right < heap_size && heap_keys[right] < heap_keys[smallest]) {
+            smallest = right;
+        }
+        if (smallest == idx) {
+            return;
+        }
+
+        int temp = heap_keys[idx];
+        heap_keys[idx] = heap_keys[smallest];
+        heap_keys[smallest] = temp;
+        temp = heap_vals[idx];
+        heap_vals[idx] = heap_vals[smallest];
+        heap_vals[smallest] = temp;
+
+        idx = smallest;
+    }
+}
+
+
+/**
+ * Given keys and vals arrays, number of items and k, puts the k
+ * largest keys (and their vals) into top_keys/top_vals in descending
+ * order. Uses a bounded min heap of size k, so only items larger than
+ * the current k-th largest cost more than one compare.
+ *
+ * Returns number of items written (min of k and num_items).
+ **/
+size_t top_k_pairs(int* keys, int* vals, size_t num_items, size_t k, int* top_keys, int* top_vals) {
+    if (k > num_items) {
+        k = num_items;
+    }
+    if (!k) {
+        return 0;
+    }
+
+    // fill heap with first k items
+    memcpy(top_keys, keys, sizeof(int) * k);
+    memcpy(top_vals, vals, sizeof(int) * k);
+    for (size_t i = k / 2; i > 0; i--) {
+        heap_sift_down(top_keys, top_vals, k, i - 1);
+    }
+
+    // replace heap min with any larger key
+    for (size_t i = k; i < num_items; i++) {
+        if (keys[i] > top_keys[0]) {
+            top_keys[0] = keys[i];
+            top_vals[0] = vals[i];
+            heap_sift_down(top_keys, top_vals, k, 0);
+        }
+    }
+
+    // pop min to the back until heap empty, leaving descending order
+    for (size_t heap_size = k; heap_size > 1; heap_size--) {
+        int temp = top_keys[0];
+        top_keys[0] = top_keys[heap_size - 1];
+        top_keys[heap_size - 1] = temp;
+        temp = top_vals[0];
+        top_vals[0] = top_vals[heap_size - 1];
+        top_vals[heap_size - 1] = temp;
+
+        heap_sift_down(top_keys, top_vals, heap_size - 1, 0);
+    }
+
+    return k;
+}
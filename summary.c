@@ -0,0 +1,197 @@
+/**
+ * Contains all functionality for
+ * column aggregate summaries.
+ **/
+
+#include "summary.h"
+
+
+/**
+ * Makes sure summary has room for num_blocks partials.
+ **/
+void reserve_summary_blocks(ColumnSummary* summary, size_t num_blocks) {
+    if (num_blocks <= summary->blocks_capacity) {
+        return;
+    }
+
+    while (summary->blocks_capacity < num_blocks) {
+        summary->blocks_capacity = summary->blocks_capacity ? summary->blocks_capacity * 2 : 16;
+    }
+
+    summary->block_sums = realloc(summary->block_sums, sizeof(long) * summary->blocks_capacity);
+    summary->block_mins = realloc(summary->block_mins, sizeof(int) * summary->blocks_capacity);
+    summary->block_maxs = realloc(summary->block_maxs, sizeof(int) * summary->blocks_capacity);
+}
+
+
+/**
+ * Given a summary, recomputes count, sum, min
+ * and max from the per block partials.
+ **/
+void summary_totals_from_blocks(ColumnSummary* summary, size_t num_items) {
+    summary->count = num_items;
+    summary->sum = 0;
+
+    if (!summary->num_blocks) {
+        summary->min = 0;
+        summary->max = 0;
+        return;
+    }
+
+    summary->min = summary->block_mins[0];
+    summary->max = summary->block_maxs[0];
+    for (size_t block = 0; block < summary->num_blocks; block++) {
+        summary->sum += summary->block_sums[block];
+        summary->min = summary->block_mins[block] < summary->min ? summary->block_mins[block] : summary->min;
+        summary->max = summary->block_maxs[block] > summary->max ? summary->block_maxs[block] : summary->max;
+    }
+}
+
+
+/**
+ * Given a summary, column data and size, and a position,
+ * recomputes all block partials from the block holding pos
+ * to the end of the column, then recomputes totals.
+ *
+ * Used after anything that shifts data (clustered inserts and deletes).
+ **/
+void summary_refresh(ColumnSummary* summary, int* data, size_t num_items, size_t from_pos) {
+    size_t num_blocks = (num_items + SUMMARY_BLOCK_SIZE - 1) / SUMMARY_BLOCK_SIZE;
+    reserve_summary_blocks(summary, num_blocks);
+
+    for (size_t block = from_pos / SUMMARY_BLOCK_SIZE; block < num_blocks; block++) {
+        size_t start = block * SUMMARY_BLOCK_SIZE;
+        size_t end = start + SUMMARY_BLOCK_SIZE < num_items ? start + SUMMARY_BLOCK_SIZE : num_items;
+
+        long sum = 0;
+        int min = data[start];
+        int max = data[start];
+        for (size_t i = start; i < end; i++) {
+            sum += data[i];
+            min = data[i] < min ? data[i] : min;
+            max = data[i] > max ? data[i] : max;
+        }
+
+        summary->block_sums[block] = sum;
+        summary->block_mins[block] = min;
+        summary->block_maxs[block] = max;
+    }
+    summary->num_blocks = num_blocks;
+
+    summary_totals_from_blocks(summary, num_items);
+}
+
+
+/**
+ * Given column data and number of items,
+ * builds a new summary of that data.
+ **/
+ColumnSummary* build_summary(int* data, size_t num_items) {
+    ColumnSummary* summary = calloc(1, sizeof(ColumnSummary));
+    summary_refresh(summary, data, num_items, 0);
+    return summary;
+}
+
+
+/**
+ * Frees all memory allocated for summary.
+ **/
+void free_summary(ColumnSummary* summary) {
+    if (summary != NULL) {
+        free(summary->block_sums);
+        free(summary->block_mins);
+        free(summary->block_maxs);
+        free(summary);
+    }
+}
+
+
+/**
+ * Given a summary and a val appended to
+ * the end of the column, updates summary in O(1).
+ **/
+void summary_append(ColumnSummary* summary, int val) {
+    size_t block = summary->count / SUMMARY_BLOCK_SIZE;
+
+    // start new block if needed
+    if (block == summary->num_blocks) {
+        reserve_summary_blocks(summary, block + 1);
+        summary->block_sums[block] = 0;
+        summary->block_mins[block] = val;
+        summary->block_maxs[block] = val;
+        summary->num_blocks++;
+    }
+
+    summary->block_sums[block] += val;
+    summary->block_mins[block] = val < summary->block_mins[block] ? val : summary->block_mins[block];
+    summary->block_maxs[block] = val > summary->block_maxs[block] ? val : summary->block_maxs[block];
+
+    // update totals
+    if (!summary->count) {
+        summary->min = val;
+        summary->max = val;
+    }
+    summary->sum += val;
+    summary->min = val < summary->min ? val : summary->min;
+    summary->max = val > summary->max ? val : summary->max;
+    summary->count++;
+}
+
+
+/**
+ * Given a summary, column data and a position range [start, end),
+ * start < end, sets sum, min and max of the range. Blocks wholly
+ * inside the range come from their partials, only the partly
+ * covered blocks at either end are scanned.
+ **/
+void summary_range(ColumnSummary* summary, int* data, size_t start, size_t end, long* sum, int* min, int* max) {
+    *sum = 0;
+    *min = data[start];
+    *max = data[start];
+
+    // whole blocks are [first_block, last_block)
+    size_t first_block = (start + SUMMARY_BLOCK_SIZE - 1) / SUMMARY_BLOCK_SIZE;
+    size_t last_block = end / SUMMARY_BLOCK_SIZE;
+    size_t scan_end = first_block < last_block ? first_block * SUMMARY_BLOCK_SIZE : end;
+    size_t scan_start = first_block < last_block ? last_block * SUMMARY_BLOCK_SIZE : end;
+
+    for (size_t i = start; i < scan_end; i++) {
+        *sum += data[i];
+        *min = data[i] < *min ? data[i] : *min;
+        *max = data[i] > *max ? data[i] : *max;
+    }
+    for (size_t block = first_block; block < last_block; block++) {
+        *sum += summary->block_sums[block];
+        *min = summary->block_mins[block] < *min ? summary->block_mins[block] : *min;
+        *max = summary->block_maxs[block] > *max ? summary->block_maxs[block] : *max;
+    }
+    for (size_t i = scan_start; i < end; i++) {
+        *sum += data[i];
+        *min = data[i] < *min ? data[i] : *min;
+        *max = data[i] > *max ? data[i] : *max;
+    }
+}
+
+
+/**
+ * Given a summary, column data, a position range [start, end) and
+ * a val, fills positions with where val is in range and returns
+ * their count. Blocks whose min and max rule out val are skipped.
+ **/
+size_t summary_range_positions(ColumnSummary* summary, int* data, size_t start, size_t end, int val, int* positions) {
+    size_t num_positions = 0;
+    for (size_t block = start / SUMMARY_BLOCK_SIZE; block * SUMMARY_BLOCK_SIZE < end; block++) {
+        if (val < summary->block_mins[block] || val > summary->block_maxs[block]) {
+            continue;
+        }
+
+        size_t block_start = block * SUMMARY_BLOCK_SIZE > start ? block * SUMMARY_BLOCK_SIZE : start;
+        size_t block_end = (block + 1) * SUMMARY_BLOCK_SIZE < end ? (block + 1) * SUMMARY_BLOCK_SIZE : end;
+        for (size_t i = block_start; i < block_end; i++) {
+            if (data[i] == val) {
+                positions[num_positions++] = (int) i;
+            }
+        }
+    }
+    return num_positions;
+}
@@ -0,0 +1,230 @@
+/**
+ * Contains all functionality for column synopses
+ * used to answer approximate aggregates:
+ *     - reservoir sample for approx sum/avg
+ *     - HyperLogLog sketch for approx distinct counts
+ **/
+
+#include <math.h>
+#include <string.h>
+#include "synopsis.h"
+
+// z score used for reported error bounds (95% confidence)
+#define CONFIDENCE_Z 1.96
+
+#define HLL_NUM_REGISTERS (1 << HLL_BITS)
+
+
+/**
+ * Returns next value of xorshift64 generator with given state.
+ **/
+unsigned long next_random(unsigned long* state) {
+    unsigned long x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+
+/**
+ * Returns uniform double in (0, 1) from generator with given state.
+ **/
+static double next_uniform(unsigned long* state) {
+    return ((next_random(state) >> 11) + 0.5) / 9007199254740992.0;
+}
+
+
+/**
+ * Fills sample with sample_size of num_rows data vals drawn without
+ * replacement, using reservoir sampling (algorithm L) that jumps
+ * straight to the rows that enter the reservoir, so only about
+ * sample_size * (1 + log(num_rows / sample_size)) rows are read.
+ **/
+void sample_rows(int* data, size_t num_rows, int* sample, size_t sample_size, unsigned long* rng_state) {
+    if (sample_size > num_rows) {
+        sample_size = num_rows;
+    }
+    if (!sample_size) {
+        return;
+    }
+    memcpy(sample, data, sizeof(int) * sample_size);
+
+    double weight = exp(log(next_uniform(rng_state)) / sample_size);
+    size_t row = sample_size - 1;
+    while (1) {
+        double skip = floor(log(next_uniform(rng_state)) / log(1 - weight));
+        if (skip >= (double) (num_rows - row - 1)) {
+            break;
+        }
+        row += (size_t) skip + 1;
+        sample[next_random(rng_state) % sample_size] = data[row];
+        weight *= exp(log(next_uniform(rng_state)) / sample_size);
+    }
+}
+
+
+/**
+ * 64 bit mix of an int (murmur3 finalizer), used for HyperLogLog.
+ **/
+unsigned long long mix_hash(int val) {
+    unsigned long long h = (unsigned int) val;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+
+/**
+ * Adds val to HyperLogLog registers.
+ * Top HLL_BITS of hash pick the register, which keeps the
+ * max position of the first set bit in the remaining bits.
+ **/
+void hll_add(unsigned char* registers, int val) {
+    unsigned long long hash = mix_hash(val);
+
+    unsigned int reg = hash >> (64 - HLL_BITS);
+    unsigned long long rest = (hash << HLL_BITS) | (1ULL << (HLL_BITS - 1));
+    unsigned char rank = __builtin_clzll(rest) + 1;
+
+    if (rank > registers[reg]) {
+        registers[reg] = rank;
+    }
+}
+
+
+/**
+ * Given HyperLogLog registers, returns estimated distinct count
+ * and sets error_bound to a 95% confidence half width.
+ **/
+double hll_estimate(unsigned char* registers, double* error_bound) {
+    double m = HLL_NUM_REGISTERS;
+    double alpha = 0.7213 / (1.0 + 1.079 / m);
+
+    double total = 0;
+    int num_zero = 0;
+    for (int reg = 0; reg < HLL_NUM_REGISTERS; reg++) {
+        total += ldexp(1.0, -registers[reg]);
+        num_zero += registers[reg] == 0;
+    }
+
+    double estimate = alpha * m * m / total;
+
+    // small range correction, use linear counting
+    if (estimate <= 2.5 * m && num_zero) {
+        estimate = m * log(m / num_zero);
+    }
+
+    *error_bound = CONFIDENCE_Z * 1.04 / sqrt(m) * estimate;
+    return estimate;
+}
+
+
+/**
+ * Given a sample of vals drawn from num_rows rows, returns
+ * estimated sum or avg of all rows and sets error_bound
+ * to a 95% confidence half width.
+ **/
+double sample_estimate(int* sample, size_t sample_size, size_t num_rows, AggregateType type, double* error_bound) {
+    *error_bound = 0;
+    if (!sample_size) {
+        return 0;
+    }
+
+    // get sample mean and variance
+    double mean = 0;
+    for (size_t i = 0; i < sample_size; i++) {
+        mean += sample[i];
+    }
+    mean /= sample_size;
+
+    double variance = 0;
+    for (size_t i = 0; i < sample_size; i++) {
+        variance += (sample[i] - mean) * (sample[i] - mean);
+    }
+    variance = sample_size > 1 ? variance / (sample_size - 1) : 0;
+
+    // standard error of mean with finite population correction,
+    // no error if sample covers every row
+    double std_error = 0;
+    if (sample_size < num_rows) {
+        std_error = sqrt(variance / sample_size) * sqrt(1.0 - (double) sample_size / num_rows);
+    }
+
+    if (type == APPROX_SUM) {
+        *error_bound = CONFIDENCE_Z * std_error * num_rows;
+        return mean * num_rows;
+    }
+
+    *error_bound = CONFIDENCE_Z * std_error;
+    return mean;
+}
+
+
+/**
+ * Adds a val to column synopsis: reservoir sample (algorithm R)
+ * and HyperLogLog registers.
+ **/
+void synopsis_add(ColumnSynopsis* synopsis, int val) {
+    // stale synopsis is rebuilt from data before next use
+    if (synopsis->stale) {
+        return;
+    }
+
+    if (synopsis->sample_size < SAMPLE_SIZE) {
+        synopsis->sample[synopsis->sample_size++] = val;
+    } else {
+        // replace random sample item with probability SAMPLE_SIZE / num_seen
+        unsigned long idx = next_random(&synopsis->rng_state) % (synopsis->num_seen + 1);
+        if (idx < SAMPLE_SIZE) {
+            synopsis->sample[idx] = val;
+        }
+    }
+    synopsis->num_seen++;
+
+    hll_add(synopsis->registers, val);
+}
+
+
+/**
+ * Given column data and number of items,
+ * builds a new synopsis of that data.
+ **/
+ColumnSynopsis* build_synopsis(int* data, size_t num_items) {
+    ColumnSynopsis* synopsis = malloc(sizeof(ColumnSynopsis));
+    synopsis->stale = 1;
+    synopsis_refresh(synopsis, data, num_items);
+    return synopsis;
+}
+
+
+/**
+ * Given a synopsis and its column's data, rebuilds synopsis
+ * in place if vals were removed since it was built. Removed
+ * vals can't be taken out of sample/sketch, so deletes just
+ * mark it stale and the rebuild waits for the next reader.
+ **/
+void synopsis_refresh(ColumnSynopsis* synopsis, int* data, size_t num_items) {
+    if (!synopsis->stale) {
+        return;
+    }
+
+    memset(synopsis, 0, sizeof(ColumnSynopsis));
+    synopsis->rng_state = 0x9E3779B97F4A7C15UL;
+
+    for (size_t i = 0; i < num_items; i++) {
+        synopsis_add(synopsis, data[i]);
+    }
+}
+
+
+/**
+ * Frees all memory allocated for synopsis.
+ **/
+void free_synopsis(ColumnSynopsis* synopsis) {
+    free(synopsis);
+}